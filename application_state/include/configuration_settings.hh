@@ -75,6 +75,9 @@ struct ConfigurationSettings
     uint8_t bms_overheat_temperature;
     uint8_t cell_overheat_temperature;
 
+    /// @brief Days before a map tile is fetched from the server again, 0 to never refresh
+    uint16_t tile_max_age_days;
+
     // @brief Whether to force a C6 update on the next boot (for testing)
     bool force_c6_update;
 
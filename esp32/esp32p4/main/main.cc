@@ -1,3 +1,4 @@
+#include "affine_blitter_software.hh"
 #include "app_simulator.hh"
 #include "ble_handler.hh"
 #include "ble_server_esp32.hh"
@@ -446,9 +447,16 @@ app_main(void)
     //auto uart_gps = std::make_unique<UartGps>(*uart1);
     auto filesystem = std::make_unique<Filesystem>("/sdcard/app_data/");
 
-    auto https_client = std::make_unique<HttpsClient>();
+    // One per web thread in the tile cache
+    std::vector<std::unique_ptr<HttpsClient>> https_clients;
+    for (auto i = 0; i < TileCache::kMaxWebThreads; i++)
+    {
+        https_clients.push_back(std::make_unique<HttpsClient>());
+    }
 
     auto blitter = std::make_unique<BlitterEsp32>();
+    // Until there is a PPA backend
+    auto affine_blitter = std::make_unique<AffineBlitterSoftware>();
     auto pm = std::make_unique<PmEsp32>();
     //auto can = std::make_unique<CanEsp32>(kCanBusTxPin, kCanBusRxPin, 500000);
     auto stepper_sleep_gpio =
@@ -484,19 +492,28 @@ app_main(void)
     //auto can_bus_handler = std::make_unique<CanBusHandler>(*can, application_state);
 
     //auto gps_reader = std::make_unique<GpsReader>(application_state, *gps);
-    auto tile_cache = std::make_unique<TileCache>(
-        application_state, pm->CreateFullPowerLock(), *filesystem, *https_client);
+    auto tile_cache = std::make_unique<TileCache>(application_state,
+                                                  pm->CreateFullPowerLock(),
+                                                  *filesystem,
+                                                  std::move(https_clients),
+                                                  "/sdcard/app_data");
     auto ble_handler = std::make_unique<BleHandler>(*ble_server, application_state, *image_cache);
 
     constexpr auto kFullRotation = 2400;
 
-    auto trip_computer = std::make_unique<TripComputer>(application_state);
+    auto trip_computer = std::make_unique<TripComputer>(
+        application_state,
+        std::make_unique<TripLogStore>(
+            "trip_log",
+            [&filesystem](const auto& path) { return filesystem->ReadFile(path); },
+            [&filesystem](const auto& path, auto data) { filesystem->WriteFile(path, data); }));
 
     auto speedometer_handler =
         std::make_unique<SpeedometerHandler>(*stepper_motor, application_state, kFullRotation);
 
     auto user_interface = std::make_unique<UserInterface>(*display,
                                                           *blitter,
+                                                          *affine_blitter,
                                                           pm->CreateFullPowerLock(),
                                                           *input,
                                                           application_state,
@@ -1,3 +1,4 @@
+#include "affine_blitter_software.hh"
 #include "app_simulator.hh"
 #include "ble_handler.hh"
 #include "ble_server_esp32.hh"
@@ -662,9 +663,16 @@ app_main(void)
     auto gps = std::make_unique<UartGps>(*uart_gps);
     auto filesystem = std::make_unique<Filesystem>("/sdcard/app_data/");
 
-    auto https_client = std::make_unique<HttpsClient>();
+    // One per web thread in the tile cache
+    std::vector<std::unique_ptr<HttpsClient>> https_clients;
+    for (auto i = 0; i < TileCache::kMaxWebThreads; i++)
+    {
+        https_clients.push_back(std::make_unique<HttpsClient>());
+    }
 
     auto blitter = std::make_unique<BlitterEsp32>();
+    // Until there is a PPA backend
+    auto affine_blitter = std::make_unique<AffineBlitterSoftware>();
     auto pm = std::make_unique<PmEsp32>();
     auto can = std::make_unique<CanEsp32>(kCanBusTxPin, kCanBusRxPin, 500000);
     //auto stepper_sleep_gpio =
@@ -691,10 +699,18 @@ app_main(void)
     // Threads
     //  auto buzz_handler =
     //      std::make_unique<BuzzHandler>(*left_buzzer_gpio, *right_buzzer_gpio, application_state);
-    auto tile_cache = std::make_unique<TileCache>(
-        application_state, pm->CreateFullPowerLock(), *filesystem, *https_client);
-
-    auto trip_computer = std::make_unique<TripComputer>(application_state);
+    auto tile_cache = std::make_unique<TileCache>(application_state,
+                                                  pm->CreateFullPowerLock(),
+                                                  *filesystem,
+                                                  std::move(https_clients),
+                                                  "/sdcard/app_data");
+
+    auto trip_computer = std::make_unique<TripComputer>(
+        application_state,
+        std::make_unique<TripLogStore>(
+            "trip_log",
+            [&filesystem](const auto& path) { return filesystem->ReadFile(path); },
+            [&filesystem](const auto& path, auto data) { filesystem->WriteFile(path, data); }));
 
     //    constexpr auto kFullRotation = 2400;
     //    auto speedometer_handler =
@@ -702,6 +718,7 @@ app_main(void)
 
     auto user_interface = std::make_unique<UserInterface>(*display,
                                                           *blitter,
+                                                          *affine_blitter,
                                                           pm->CreateFullPowerLock(),
                                                           *input,
                                                           application_state,
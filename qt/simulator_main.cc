@@ -1,3 +1,4 @@
+#include "affine_blitter_host.hh"
 #include "app_simulator.hh"
 #include "ble_client_host.hh"
 #include "ble_handler.hh"
@@ -72,20 +73,35 @@ main(int argc, char* argv[])
     auto ble_client = std::make_unique<BleClientHost>();
     auto image_cache = std::make_unique<ImageCache>();
     auto filesystem = std::make_unique<Filesystem>("./app_data");
-    auto https_client = std::make_unique<HttpsClient>();
+    // One per web thread in the tile cache
+    std::vector<std::unique_ptr<HttpsClient>> https_clients;
+    for (auto i = 0; i < TileCache::kMaxWebThreads; i++)
+    {
+        https_clients.push_back(std::make_unique<HttpsClient>());
+    }
     auto pm = std::make_unique<PmHost>();
     auto nvm_host = std::make_unique<NvmHost>("nvm.txt");
     auto blitter = std::make_unique<BlitterHost>();
+    auto affine_blitter = std::make_unique<AffineBlitterHost>();
     auto wifi_client = std::make_unique<WifiClientHost>();
 
     // Threads
     auto storage = std::make_unique<Storage>(application_state, *nvm_host);
     auto wifi_handler = std::make_unique<WifiHandler>(application_state, *filesystem, *wifi_client);
     auto input = std::make_unique<Input>(window.GetButtonGpio(), window, window.GetTouch());
-    auto trip_computer = std::make_unique<TripComputer>(application_state);
+    auto trip_computer = std::make_unique<TripComputer>(
+        application_state,
+        std::make_unique<TripLogStore>(
+            "trip_log",
+            [&filesystem](const auto& path) { return filesystem->ReadFile(path); },
+            [&filesystem](const auto& path, auto data) { filesystem->WriteFile(path, data); }));
     auto app_simulator = std::make_unique<AppSimulator>(application_state, *ble_server);
-    auto tile_cache = std::make_unique<TileCache>(
-        application_state, pm->CreateFullPowerLock(), *filesystem, *https_client);
+    auto tile_cache = std::make_unique<TileCache>(application_state,
+                                                  pm->CreateFullPowerLock(),
+                                                  *filesystem,
+                                                  std::move(https_clients),
+                                                  "./app_data",
+                                                  TileCache::kMaxDecodeThreads);
     auto ble_handler =
         std::make_unique<BleHandler>(*ble_server, *ble_client, application_state, *image_cache);
     auto buzz_handler = std::make_unique<BuzzHandler>(
@@ -93,6 +109,7 @@ main(int argc, char* argv[])
     auto temperature_monitor = std::make_unique<TemperatureMonitor>(application_state);
     auto user_interface = std::make_unique<UserInterface>(window.GetDisplay(),
                                                           *blitter,
+                                                          *affine_blitter,
                                                           pm->CreateFullPowerLock(),
                                                           *input, // IInput
                                                           application_state,
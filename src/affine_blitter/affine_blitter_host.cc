@@ -0,0 +1,106 @@
+#include "affine_blitter_host.hh"
+
+#include "affine_rotation.hh"
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+
+constexpr auto kBandThreadNames = std::array {
+    "affine_band_0",
+    "affine_band_1",
+    "affine_band_2",
+    "affine_band_3",
+    "affine_band_4",
+    "affine_band_5",
+    "affine_band_6",
+    "affine_band_7",
+};
+static_assert(kBandThreadNames.size() >= AffineBlitterHost::kMaxBands);
+
+} // namespace
+
+AffineBlitterHost::AffineBlitterHost(uint8_t bands)
+{
+    bands = std::clamp<uint8_t>(bands, 1, kMaxBands);
+
+    for (auto i = 0u; i < bands; i++)
+    {
+        m_band_threads.push_back(std::make_unique<BandThread>(*this));
+        m_band_threads.back()->Start(kBandThreadNames[i]);
+    }
+}
+
+void
+AffineBlitterHost::Blit(const hal::AffineBlitOperation& operation)
+{
+    WaitForDone();
+
+    auto bands = static_cast<int32_t>(m_band_threads.size());
+    auto rows_per_band = (operation.dst_height + bands - 1) / bands;
+
+    m_pending_bands = bands;
+    m_in_flight = true;
+    for (auto i = 0; i < bands; i++)
+    {
+        auto first_row = std::min(i * rows_per_band, operation.dst_height);
+        auto last_row = std::min(first_row + rows_per_band, operation.dst_height);
+
+        m_band_threads[i]->Rotate(Band {operation, first_row, last_row});
+    }
+}
+
+void
+AffineBlitterHost::WaitForDone()
+{
+    if (m_in_flight)
+    {
+        m_done.acquire();
+        m_in_flight = false;
+    }
+}
+
+void
+AffineBlitterHost::BandDone()
+{
+    if (m_pending_bands.fetch_sub(1) == 1)
+    {
+        m_done.release();
+    }
+}
+
+
+AffineBlitterHost::BandThread::BandThread(AffineBlitterHost& parent)
+    : m_parent(parent)
+{
+}
+
+void
+AffineBlitterHost::BandThread::Rotate(const Band& band)
+{
+    // Never full, since the previous operation is always done before a new one is started
+    m_in_queue.push(band);
+    Awake();
+}
+
+void
+AffineBlitterHost::BandThread::RotateBands()
+{
+    Band band;
+
+    while (m_in_queue.pop(band))
+    {
+        affine_rotation::RotateRows(band.operation, band.first_row, band.last_row);
+        m_parent.BandDone();
+    }
+}
+
+std::optional<milliseconds>
+AffineBlitterHost::BandThread::OnActivation()
+{
+    RotateBands();
+
+    return std::nullopt;
+}
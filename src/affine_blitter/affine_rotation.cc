@@ -0,0 +1,238 @@
+#include "affine_rotation.hh"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include <utility>
+
+namespace
+{
+
+constexpr int32_t kFixedShift = 16;
+constexpr int64_t kFixedOne = int64_t {1} << kFixedShift;
+
+// RGB565 spread out as 0b00000gggggg00000rrrrr000000bbbbb, with room for a 5-bit weight
+constexpr uint32_t kSpreadMask = 0x07e0f81f;
+constexpr uint32_t kWeightShift = 5;
+constexpr uint32_t kWeightOne = 1u << kWeightShift;
+
+int64_t
+FloorDiv(int64_t a, int64_t b)
+{
+    auto q = a / b;
+    if (a % b != 0 && (a < 0) != (b < 0))
+    {
+        q--;
+    }
+
+    return q;
+}
+
+int64_t
+CeilDiv(int64_t a, int64_t b)
+{
+    auto q = a / b;
+    if (a % b != 0 && (a < 0) == (b < 0))
+    {
+        q++;
+    }
+
+    return q;
+}
+
+// The columns [first, last) for which start + step * x is within [0, limit)
+std::pair<int64_t, int64_t>
+ColumnSpan(int64_t start, int64_t step, int64_t limit)
+{
+    if (step == 0)
+    {
+        if (start >= 0 && start < limit)
+        {
+            return {std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()};
+        }
+        return {0, 0};
+    }
+
+    if (step > 0)
+    {
+        return {CeilDiv(-start, step), FloorDiv(limit - 1 - start, step) + 1};
+    }
+
+    return {CeilDiv(limit - 1 - start, step), FloorDiv(-start, step) + 1};
+}
+
+uint32_t
+Spread(uint16_t pixel)
+{
+    return (pixel | (static_cast<uint32_t>(pixel) << 16)) & kSpreadMask;
+}
+
+uint16_t
+Unspread(uint32_t spread)
+{
+    return static_cast<uint16_t>(spread | (spread >> 16));
+}
+
+uint32_t
+Lerp(uint32_t a, uint32_t b, uint32_t weight)
+{
+    return ((a * (kWeightOne - weight) + b * weight) >> kWeightShift) & kSpreadMask;
+}
+
+// u and v are where the pixels are stored, and must not wrap around within the row
+void
+NearestRow(const hal::AffineBlitOperation& op,
+           uint16_t* dst,
+           int32_t count,
+           int32_t u,
+           int32_t v,
+           int32_t du,
+           int32_t dv)
+{
+    for (auto x = 0; x < count; x++)
+    {
+        dst[x] = op.src_data[(v >> kFixedShift) * op.src_width + (u >> kFixedShift)];
+        u += du;
+        v += dv;
+    }
+}
+
+void
+BilinearRow(const hal::AffineBlitOperation& op,
+            uint16_t* dst,
+            int32_t count,
+            int32_t u,
+            int32_t v,
+            int32_t du,
+            int32_t dv)
+{
+    constexpr auto kFractionShift = kFixedShift - kWeightShift;
+
+    for (auto x = 0; x < count; x++)
+    {
+        // The neighbours can be on the other side of a ring buffer
+        auto x0 = u >> kFixedShift;
+        auto y0 = v >> kFixedShift;
+        auto x1 = x0 + 1 == op.src_width ? 0 : x0 + 1;
+        auto y1 = y0 + 1 == op.src_height ? 0 : y0 + 1;
+        const auto* row0 = op.src_data + y0 * op.src_width;
+        const auto* row1 = op.src_data + y1 * op.src_width;
+        auto wx = static_cast<uint32_t>(u >> kFractionShift) & (kWeightOne - 1);
+        auto wy = static_cast<uint32_t>(v >> kFractionShift) & (kWeightOne - 1);
+
+        auto top = Lerp(Spread(row0[x0]), Spread(row0[x1]), wx);
+        auto bottom = Lerp(Spread(row1[x0]), Spread(row1[x1]), wx);
+        dst[x] = Unspread(Lerp(top, bottom, wy));
+
+        u += du;
+        v += dv;
+    }
+}
+
+} // namespace
+
+namespace affine_rotation
+{
+
+void
+Rotate(const hal::AffineBlitOperation& operation)
+{
+    RotateRows(operation, 0, operation.dst_height);
+}
+
+void
+RotateRows(const hal::AffineBlitOperation& op, int32_t first_row, int32_t last_row)
+{
+    const auto angle_rad = static_cast<float>(op.angle_deg) * std::numbers::pi_v<float> / 180.0f;
+    // Also catches NaN
+    const auto scale = op.scale >= kMinScale ? op.scale : kMinScale;
+    const auto cos_a = static_cast<int32_t>(std::lround(std::cos(angle_rad) / scale * kFixedOne));
+    const auto sin_a = static_cast<int32_t>(std::lround(std::sin(angle_rad) / scale * kFixedOne));
+
+    // Bilinear reads one pixel to the right and below as well
+    const auto margin = op.bilinear ? 1 : 0;
+    const auto u_limit = static_cast<int64_t>(op.src_width - margin) << kFixedShift;
+    const auto v_limit = static_cast<int64_t>(op.src_height - margin) << kFixedShift;
+    const auto u_wrap = op.src_width << kFixedShift;
+    const auto v_wrap = op.src_height << kFixedShift;
+    const auto u_origin = op.src_origin_x << kFixedShift;
+    const auto v_origin = op.src_origin_y << kFixedShift;
+
+    // Relative to the pivot, for the leftmost column
+    const auto fx = -op.pivot_x;
+    auto fy = first_row - op.pivot_y;
+    const auto du = cos_a;
+    const auto dv = -sin_a;
+
+    for (auto y = first_row; y < last_row; y++, fy++)
+    {
+        // Outside of the source, this can be far out of the int32 range with small scales
+        auto u = int64_t {cos_a} * fx + int64_t {sin_a} * fy +
+                 (int64_t {op.src_center_x} << kFixedShift);
+        auto v = -int64_t {sin_a} * fx + int64_t {cos_a} * fy +
+                 (int64_t {op.src_center_y} << kFixedShift);
+
+        auto [u_first, u_last] = ColumnSpan(u, du, u_limit);
+        auto [v_first, v_last] = ColumnSpan(v, dv, v_limit);
+        auto first = static_cast<int32_t>(
+            std::clamp<int64_t>(std::max(u_first, v_first), 0, op.dst_width));
+        auto last = static_cast<int32_t>(
+            std::clamp<int64_t>(std::min(u_last, v_last), first, op.dst_width));
+
+        // The stored position wraps around at most once per direction, so split the row
+        // where it does. Without an origin, all of these are outside of [first, last).
+        auto [u_unwrapped_first, u_unwrapped_last] = ColumnSpan(u + u_origin, du, u_wrap);
+        auto [v_unwrapped_first, v_unwrapped_last] = ColumnSpan(v + v_origin, dv, v_wrap);
+        auto splits = std::array<int64_t, 6> {
+            first, last, u_unwrapped_first, u_unwrapped_last, v_unwrapped_first, v_unwrapped_last};
+        for (auto& split : splits)
+        {
+            split = std::clamp<int64_t>(split, first, last);
+        }
+        std::ranges::sort(splits);
+
+        auto* row = op.dst_data + y * op.dst_width;
+        std::fill(row, row + first, 0x0000);
+        for (auto i = 1u; i < splits.size(); i++)
+        {
+            auto from = static_cast<int32_t>(splits[i - 1]);
+            auto count = static_cast<int32_t>(splits[i]) - from;
+            if (count == 0)
+            {
+                continue;
+            }
+
+            // Within the source here, so back in the int32 range
+            auto su = u + int64_t {from} * du + u_origin;
+            auto sv = v + int64_t {from} * dv + v_origin;
+            su -= su >= u_wrap ? u_wrap : 0;
+            sv -= sv >= v_wrap ? v_wrap : 0;
+
+            if (op.bilinear)
+            {
+                BilinearRow(op,
+                            row + from,
+                            count,
+                            static_cast<int32_t>(su),
+                            static_cast<int32_t>(sv),
+                            du,
+                            dv);
+            }
+            else
+            {
+                NearestRow(op,
+                           row + from,
+                           count,
+                           static_cast<int32_t>(su),
+                           static_cast<int32_t>(sv),
+                           du,
+                           dv);
+            }
+        }
+        std::fill(row + last, row + op.dst_width, 0x0000);
+    }
+}
+
+} // namespace affine_rotation
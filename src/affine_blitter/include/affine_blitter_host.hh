@@ -0,0 +1,64 @@
+#pragma once
+
+#include "base_thread.hh"
+#include "hal/i_affine_blitter.hh"
+
+#include <atomic>
+#include <etl/queue_spsc_atomic.h>
+#include <memory>
+#include <semaphore>
+#include <vector>
+
+/**
+ * @brief Splits the destination into horizontal bands, which are rotated in parallel
+ *
+ * Each band runs the reference kernel, so the result is pixel-exact with it.
+ */
+class AffineBlitterHost : public hal::IAffineBlitter
+{
+public:
+    static constexpr auto kDefaultBands = 4;
+    static constexpr auto kMaxBands = 8;
+
+    explicit AffineBlitterHost(uint8_t bands = kDefaultBands);
+
+private:
+    friend class AffineBlitterHostFixture;
+
+    struct Band
+    {
+        hal::AffineBlitOperation operation;
+        int32_t first_row;
+        int32_t last_row;
+    };
+
+    class BandThread final : public os::BaseThread
+    {
+    public:
+        BandThread(AffineBlitterHost& parent);
+
+        void Rotate(const Band& band);
+
+        // Context: The band thread, on activation
+        void RotateBands();
+
+    private:
+        std::optional<milliseconds> OnActivation() final;
+
+        AffineBlitterHost& m_parent;
+        etl::queue_spsc_atomic<Band, 1> m_in_queue;
+    };
+
+    void Blit(const hal::AffineBlitOperation& operation) final;
+    void WaitForDone() final;
+
+    // Context: A band thread
+    void BandDone();
+
+    std::vector<std::unique_ptr<BandThread>> m_band_threads;
+
+    std::atomic<uint32_t> m_pending_bands {0};
+    std::binary_semaphore m_done {0};
+    // Only touched by the thread calling Blit()
+    bool m_in_flight {false};
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "affine_rotation.hh"
+#include "hal/i_affine_blitter.hh"
+
+/**
+ * @brief Runs the reference kernel directly on the calling thread
+ *
+ * For targets without a hardware backend, where this is what the user interface used to
+ * do by itself.
+ */
+class AffineBlitterSoftware : public hal::IAffineBlitter
+{
+public:
+    AffineBlitterSoftware() = default;
+
+private:
+    void Blit(const hal::AffineBlitOperation& operation) final
+    {
+        affine_rotation::Rotate(operation);
+    }
+
+    void WaitForDone() final
+    {
+        // Already done
+    }
+};
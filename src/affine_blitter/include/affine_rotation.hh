@@ -0,0 +1,31 @@
+#pragma once
+
+#include "hal/i_affine_blitter.hh"
+
+#include <cstdint>
+
+/**
+ * @brief Rotation of RGB565 images with an incremental fixed-point walker
+ *
+ * The source position is stepped by (cos, -sin) / scale per destination column in 16.16
+ * fixed point, and the columns which map inside the source are found analytically per
+ * row. The inner loop therefore has no float math and no bounds tests, and pixels outside
+ * of the source are filled with black.
+ *
+ * The source position is floored. The per-pixel float loop which this replaced truncated
+ * it toward zero, so left of and above the source center, pixels can be shifted by one
+ * source pixel compared to that. Positions right at a pixel edge can also end up on either
+ * side of it, since the steps are rounded to 16.16.
+ */
+namespace affine_rotation
+{
+
+// Smaller scales are clamped to this, since the 16.16 source steps would overflow
+constexpr float kMinScale = 1.0f / 64;
+
+void Rotate(const hal::AffineBlitOperation& operation);
+
+// Only the destination rows [first_row, last_row), for splitting the work into bands
+void RotateRows(const hal::AffineBlitOperation& operation, int32_t first_row, int32_t last_row);
+
+} // namespace affine_rotation
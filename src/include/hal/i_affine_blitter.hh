@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hal
+{
+
+/**
+ * @brief Rotate and scale an RGB565 image into a destination buffer
+ *
+ * The destination pixel (pivot_x, pivot_y) shows the source pixel (src_center_x,
+ * src_center_y). Destination pixels which don't map to the source are black. The result
+ * must be pixel-exact with affine_rotation::Rotate(), which is the reference
+ * implementation of this contract.
+ *
+ * The source can be a ring buffer, which wraps around in both directions. Source pixel
+ * (x, y) is then stored at ((x + src_origin_x) % src_width, (y + src_origin_y) %
+ * src_height).
+ */
+struct AffineBlitOperation
+{
+    const uint16_t* src_data;
+    int32_t src_width;
+    int32_t src_height;
+    int32_t src_origin_x;
+    int32_t src_origin_y;
+
+    uint16_t* dst_data;
+    int32_t dst_width;
+    int32_t dst_height;
+
+    int32_t angle_deg;
+    // > 1 enlarges the source. At least affine_rotation::kMinScale
+    float scale;
+
+    int32_t pivot_x;
+    int32_t pivot_y;
+    int32_t src_center_x;
+    int32_t src_center_y;
+
+    // Interpolate between the four closest source pixels
+    bool bilinear;
+};
+
+class IAffineBlitter
+{
+public:
+    virtual ~IAffineBlitter() = default;
+
+    /**
+     * @brief Start an operation, and return before it's done
+     *
+     * The buffers must be left alone until WaitForDone() has returned. Starting a new
+     * operation waits for the previous one.
+     */
+    virtual void Blit(const AffineBlitOperation& operation) = 0;
+
+    virtual void WaitForDone() = 0;
+};
+
+} // namespace hal
@@ -44,6 +44,7 @@ enum class Key
     kMotorOverheatTemperature,
     kBmsOverheatTemperature,
     kCellOverheatTemperature,
+    kTileMaxAgeDays,
 
     kValueCount,
 };
@@ -130,6 +131,10 @@ constexpr auto kKeyToString = std::array {
         Key::kHistogramMode,
         "5",
     },
+    std::pair {
+        Key::kTileMaxAgeDays,
+        "6",
+    },
 };
 
 static_assert(kKeyToString.size() == std::to_underlying(Key::kValueCount));
@@ -193,6 +198,7 @@ Storage::Storage(ApplicationState& application_state, hal::INvm& nvm)
     conf.force_c6_update = m_nvm.Get<bool>(KeyToString(Key::kForceC6Update)).value_or(false);
     conf.show_gps_speed = m_nvm.Get<bool>(KeyToString(Key::kShowGpsSpeed)).value_or(false);
     conf.home_position = home_position;
+    conf.tile_max_age_days = m_nvm.Get<uint16_t>(KeyToString(Key::kTileMaxAgeDays)).value_or(90);
 
     conf.bms_overheat_temperature =
         m_nvm.Get<uint8_t>(KeyToString(Key::kBmsOverheatTemperature)).value_or(60);
@@ -334,6 +340,10 @@ Storage::OnActivation()
         {
             m_nvm.Set<bool>(KeyToString(Key::kSpeechBubbles), new_conf.show_speech_bubbles);
         }
+        if (old_conf.tile_max_age_days != new_conf.tile_max_age_days)
+        {
+            m_nvm.Set<uint16_t>(KeyToString(Key::kTileMaxAgeDays), new_conf.tile_max_age_days);
+        }
         if (old_conf.home_position != new_conf.home_position)
         {
             m_nvm.Set<int32_t>(KeyToString(Key::kHomeXPosition), new_conf.home_position.x);
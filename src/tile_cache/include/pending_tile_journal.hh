@@ -0,0 +1,71 @@
+#pragma once
+
+#include "wgs84_to_osm_point.hh"
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Persistent set of the city tiles to download, for one zoom level
+ *
+ * New tiles are added to a small journal, and when that fills up, everything is compacted
+ * into a snapshot. There are two snapshot files which are written alternately, so a power
+ * loss during compaction leaves the previous snapshot and journal intact.
+ *
+ * The filesystem only supports whole-file writes, so appending to the journal rewrites it,
+ * but it's bounded to kMaxJournalEntries records. The journal is also written alternately
+ * to two files, so a power loss while writing one (which might truncate it) leaves the
+ * other, which only lacks the last tile.
+ */
+class PendingTileJournal
+{
+public:
+    using ReadFunction =
+        std::function<std::optional<std::vector<std::byte>>(const std::string& path)>;
+    using WriteFunction =
+        std::function<void(const std::string& path, std::span<const std::byte> data)>;
+
+    static constexpr auto kMaxJournalEntries = 32;
+
+    PendingTileJournal(std::string directory,
+                       uint8_t zoom,
+                       ReadFunction read,
+                       WriteFunction write);
+
+    /**
+     * @brief Restore the tiles from the latest snapshot and journal
+     *
+     * Migrates the old pending.bin format if there is no snapshot.
+     */
+    void Load();
+
+    // Returns false if the tile was already pending
+    bool Add(const Tile& tile);
+
+    const std::unordered_set<Tile>& Tiles() const
+    {
+        return m_tiles;
+    }
+
+private:
+    bool LoadSnapshot();
+    bool LoadLegacy();
+    void LoadJournal();
+    std::vector<Tile> ReadJournal(const std::string& path) const;
+    void WriteJournal();
+    void Compact();
+
+    const std::string m_directory;
+    const uint8_t m_zoom;
+    ReadFunction m_read;
+    WriteFunction m_write;
+
+    std::unordered_set<Tile> m_tiles;
+    uint32_t m_sequence {0};
+    std::vector<Tile> m_journal;
+};
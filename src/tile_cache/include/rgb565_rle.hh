@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * @brief Run-length encoding of RGB565 pixels
+ *
+ * Map tiles have large single-colour areas, so this typically shrinks them several times
+ * while being much cheaper to decode than PNG. The stream is a sequence of 16-bit control
+ * words. With the top bit set, the next pixel is repeated (control & 0x7fff) times,
+ * otherwise (control) literal pixels follow.
+ */
+namespace rgb565_rle
+{
+
+std::vector<uint16_t> Encode(std::span<const uint16_t> pixels);
+
+// Returns false unless the stream is valid and fills dst exactly
+bool Decode(std::span<const uint16_t> encoded, std::span<uint16_t> dst);
+
+} // namespace rgb565_rle
@@ -6,17 +6,26 @@
 #include "hal/i_pm.hh"
 #include "https_client.hh"
 #include "image.hh"
+#include "pending_tile_journal.hh"
+#include "tile_eviction_policy.hh"
+#include "tile_index.hh"
+#include "tile_pack.hh"
 #include "wgs84_to_osm_point.hh"
 
 #include <array>
 #include <atomic>
+#include <bit>
 #include <deque>
+#include <etl/circular_buffer.h>
 #include <etl/mutex.h>
 #include <etl/queue_spsc_atomic.h>
 #include <etl/unordered_set.h>
+#include <span>
 #include <unordered_map>
 #include <unordered_set>
 
+class PNG;
+
 consteval auto
 TilesBySize(auto mb)
 {
@@ -24,13 +33,10 @@ TilesBySize(auto mb)
 }
 constexpr auto kTileCacheSize = TilesBySize(8);
 
-class ITileHandle
-{
-public:
-    virtual ~ITileHandle() = default;
-
-    virtual const Image& GetImage() const = 0;
-};
+// Slots in the pre-decoded tile store on the filesystem, at most 128KiB each. 0 to disable.
+constexpr auto kDecodedTileStoreSlots = 1024;
+static_assert(std::has_single_bit(static_cast<uint32_t>(kDecodedTileStoreSlots)) ||
+              kDecodedTileStoreSlots == 0);
 
 class TileImage : public SingleColorImage
 {
@@ -42,42 +48,224 @@ public:
 
     TileImage(const TileImage&) = delete;
     TileImage& operator=(const TileImage&) = delete;
-
-    uint32_t UseCount() const
-    {
-        return m_use_count.load();
-    }
-
-    void BumpUseCount(uint32_t delta = 1)
-    {
-        m_use_count += delta;
-    }
-
-    void SetUseCount(uint32_t count)
-    {
-        m_use_count = count;
-    }
-
-private:
-    std::atomic<uint32_t> m_use_count {0};
 };
 
 class TileCache : public os::BaseThread
 {
 public:
+    // Steps the tile cache and its decoders in the unit tests
+    friend class TileCacheFixture;
+
+    struct Statistics
+    {
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t evictions;
+    };
+
+    // One per core on the ESP32-P4
+    static constexpr uint8_t kDefaultDecodeThreads = 2;
+    static constexpr uint8_t kMaxDecodeThreads = 4;
+    // Concurrent downloads, one per HTTPS client
+    static constexpr uint8_t kMaxWebThreads = 3;
+
+    /**
+     * @brief Create the tile cache
+     *
+     * @param https_clients one web thread is started per client, since a client can only
+     *        do one request at a time. At least one, and at most kMaxWebThreads.
+     * @param data_directory where the filesystem is rooted. Loose tiles are read from it
+     *        directly into reused buffers, and the tile packs are in packs/ below it.
+     */
     TileCache(ApplicationState& application_state,
               std::unique_ptr<hal::IPm::ILock> pm_lock,
               Filesystem& filesystem,
-              HttpsClient& https_client);
-
-    // Context: Another thread (the user interface)
+              std::vector<std::unique_ptr<HttpsClient>> https_clients,
+              std::string data_directory,
+              uint8_t decode_threads = kDefaultDecodeThreads);
+
+    /**
+     * @brief Get a tile, or a placeholder if it's not in the cache
+     *
+     * The placeholder is a scaled up part of a cached tile at a lower zoom level if there
+     * is one, and a black tile otherwise.
+     *
+     * Context: Another thread (the user interface)
+     */
     const Image& GetTile(const Tile& at);
 
+    /**
+     * @brief Release the tiles pinned by GetTile for the previous frame
+     *
+     * Tiles and placeholders returned by GetTile are never evicted or reused until this is
+     * called, so call it only when all blits from the previous frame are done.
+     *
+     * Context: Another thread (the user interface)
+     */
+    void BeginFrame();
+
+    // Context: Any thread
+    Statistics GetStatistics() const;
+
+    /**
+     * @brief Download the tiles in a box for offline use
+     *
+     * Replaces the ongoing region download, if any. The tiles are fetched when there is
+     * WiFi, and the progress is published in the application state.
+     *
+     * @param corner_a, corner_b opposite corners of the box, at the same zoom level
+     * @param zooms the zoom levels to download, in order
+     *
+     * Context: Any thread
+     */
+    void StartRegionDownload(const Point& corner_a,
+                             const Point& corner_b,
+                             std::span<const uint8_t> zooms);
+
+    /**
+     * @brief Download the tiles along a route for offline use
+     *
+     * As the box variant, but for the tiles within margin_tiles of the route.
+     *
+     * Context: Any thread
+     */
+    void StartRegionDownload(std::span<const Point> route,
+                             int32_t margin_tiles,
+                             std::span<const uint8_t> zooms);
+
 private:
+    // Jobs queued per decode thread, so that the next tile can be read while decoding
+    static constexpr auto kDecodeQueueSize = 2;
+    // Preallocated size of the buffers tile PNGs are read into, most tiles are smaller
+    static constexpr auto kPngBufferSize = 64 * 1024;
+    // Tiles queued per download thread
+    static constexpr auto kWebQueueSize = 16;
+    // Tiles loaded from loose files which wait for an age check, older ones are dropped
+    static constexpr auto kAgeCheckQueueSize = 16;
+    // Expired tiles waiting to be fetched again, the rest are found on a later load
+    static constexpr auto kRevalidateQueueSize = 32;
+    // Fetches of a region tile before it's given up, e.g. when the server doesn't have it
+    static constexpr auto kMaxRegionTileAttempts = 3;
+    // Scaled placeholders per frame, the rest of the missing tiles are black. Each is a full
+    // tile image of 128KiB.
+    static constexpr auto kFallbackTiles = 4;
+
+    static constexpr uint32_t kTileMetaMagic = 0x4d544252; // "RBTM"
+
+    // Stored next to each tile PNG
+    struct TileMeta
+    {
+        uint32_t magic;
+        // Of the PNG data, 0 if unknown
+        uint32_t content_hash;
+        // Seconds since the epoch, 0 if the clock wasn't set when fetched
+        int64_t fetched_at;
+    };
+
+    struct DecodeJob
+    {
+        Tile tile;
+        uint16_t slot;
+        bool prefetched;
+        // Of the slot in the pre-decoded tile store when the PNG was read. Not stored if unset.
+        std::optional<uint32_t> store_generation;
+        std::vector<std::byte> png_data;
+    };
+
+    struct DecodeResult
+    {
+        Tile tile;
+        uint16_t slot;
+        bool prefetched;
+        bool success;
+        // Written to the pre-decoded tile store
+        bool stored;
+        // Handed back for reuse
+        std::vector<std::byte> png_data;
+    };
+
+    enum class FetchReason : uint8_t
+    {
+        // Missing or expired, only written if changed
+        kUpdate,
+        // The copy on disk is corrupt, so written even if unchanged
+        kReload,
+        // Part of the region download, which is retried if it fails
+        kRegion,
+    };
+
+    struct RegionTile
+    {
+        Tile tile;
+        // Failed fetches so far, the tile is given up after kMaxRegionTileAttempts
+        uint8_t failures;
+    };
+
+    struct FetchJob
+    {
+        Tile tile;
+        FetchReason reason;
+    };
+
+    struct FetchResult
+    {
+        Tile tile;
+        FetchReason reason;
+        // Fetched and written to the filesystem
+        bool success;
+    };
+
+    class DecodeThread final : public os::BaseThread
+    {
+    public:
+        DecodeThread(TileCache& parent);
+
+        ~DecodeThread() final;
+
+        // Queued jobs plus the one being decoded, all of which can have results waiting
+        static constexpr auto kMaxJobsInFlight = kDecodeQueueSize + 1;
+
+        // Context: The tile cache thread
+        bool CanDecode() const
+        {
+            // The results must fit in the out queue even if they aren't collected for a while
+            return m_jobs_in_flight < kMaxJobsInFlight && !m_in_queue.full();
+        }
+
+        // Context: The tile cache thread
+        void Decode(DecodeJob&& job);
+
+        // Context: The tile cache thread
+        bool PollResult(DecodeResult& out)
+        {
+            if (!m_out_queue.pop(out))
+            {
+                return false;
+            }
+            m_jobs_in_flight--;
+
+            return true;
+        }
+
+        // Context: The decoder thread, on activation
+        void DecodeJobs();
+
+    private:
+        std::optional<milliseconds> OnActivation() final;
+
+        TileCache& m_parent;
+        // Reused for all tiles, it's fairly large
+        std::unique_ptr<PNG> m_png;
+        etl::queue_spsc_atomic<DecodeJob, kDecodeQueueSize> m_in_queue;
+        etl::queue_spsc_atomic<DecodeResult, kMaxJobsInFlight> m_out_queue;
+        // Handed over but not collected yet, only used by the tile cache thread
+        uint8_t m_jobs_in_flight {0};
+    };
+
     class WebThread final : public os::BaseThread
     {
     public:
-        WebThread(TileCache& parent);
+        WebThread(TileCache& parent, std::unique_ptr<HttpsClient> https_client);
 
         ~WebThread() final = default;
 
@@ -86,12 +274,32 @@ private:
             m_osm_api_key = std::move(api_key);
         }
 
+        // Queued jobs plus the one being fetched, all of which can have results waiting
+        static constexpr auto kMaxJobsInFlight = kWebQueueSize + 1;
+
+        // Context: The tile cache thread
         bool CanFetchTile() const
         {
-            return !m_in_queue.full();
+            return m_jobs_in_flight < kMaxJobsInFlight && !m_in_queue.full();
         }
 
-        void FetchTile(const Tile& t);
+        // Context: The tile cache thread
+        void FetchTile(const Tile& t, FetchReason reason = FetchReason::kUpdate);
+
+        // Context: The tile cache thread
+        bool PollResult(FetchResult& out)
+        {
+            if (!m_out_queue.pop(out))
+            {
+                return false;
+            }
+            m_jobs_in_flight--;
+
+            return true;
+        }
+
+        // Context: The web thread, on activation
+        void FetchJobs();
 
     private:
         std::string GetTileUrl(const Tile& t) const;
@@ -100,20 +308,47 @@ private:
         std::optional<milliseconds> OnActivation() final;
 
         TileCache& m_parent;
-        etl::queue_spsc_atomic<Tile, 8> m_in_queue;
+        // Only used by this thread
+        std::unique_ptr<HttpsClient> m_https_client;
+        etl::queue_spsc_atomic<FetchJob, kWebQueueSize> m_in_queue;
+        etl::queue_spsc_atomic<FetchResult, kMaxJobsInFlight> m_out_queue;
+        // Handed over but not collected yet, only used by the tile cache thread
+        uint8_t m_jobs_in_flight {0};
         std::string m_osm_api_key;
     };
 
     void OnStartup() final;
     std::optional<milliseconds> OnActivation() final;
 
+    void CompleteDecodes();
+    void CompleteFetches();
+    void PrefetchAlongPath(const GpsData& position);
+    void StartHomeRegionDownload();
+    void StartRegionDownload(std::vector<Tile> tiles);
+    void ApplyRegionDownloadRequest();
+    void LoadRegionDownload();
+    void SaveRegionDownload();
+    void PublishRegionDownloadProgress();
     void FillFromColdStore();
     void FillFromServer();
     void RefreshCityTiles(const Tile& center);
 
-    uint8_t EvictTile();
+    bool IsPinned(uint16_t slot) const;
+    std::optional<uint16_t> EvictTile();
+    std::optional<uint16_t> PinTile(const Tile& t);
+    const Image& GetFallbackTile(const Tile& at);
+    DecodeThread* SelectDecodeThread();
+    WebThread* SelectWebThread();
 
-    bool DecodePng(std::span<const std::byte> png_data, TileImage& out);
+    bool DecodePng(PNG& png, std::span<const std::byte> png_data, TileImage& out);
+
+    // The pre-decoded tile store, which is direct-mapped by tile id
+    bool LoadDecodedTile(const Tile& t, bool prefetched);
+    std::optional<uint32_t> DecodedTileStoreGeneration(uint32_t tile_id);
+    bool StoreDecodedTile(const Tile& t, uint32_t generation, const TileImage& image);
+    std::string GetDecodedTilePath(uint32_t tile_id) const;
+    void LoadDecodedTileOwners();
+    void SaveDecodedTileOwners();
 
     // helpers
     ApplicationState::ReadOnly AppState() const
@@ -123,32 +358,93 @@ private:
 
     std::string GetTilePath(const Tile& t) const;
 
-    std::optional<std::vector<std::byte>> ReadTile(const Tile& t) const;
+    // Called with m_filesystem_mutex held
+    std::optional<TileMeta> ReadTileMeta(const Tile& t) const;
+    void WriteTileMeta(const Tile& t, const TileMeta& meta);
+    void InvalidateDecodedTile(const Tile& t);
+
+    void CheckTileAges();
 
-    void SavePendingCityTiles();
+    bool ReadTile(const Tile& t, std::vector<std::byte>& out);
+    std::vector<std::byte> GetPngBuffer();
+    bool IsInTilePack(const Tile& t) const;
 
     ApplicationState& m_application_state;
     std::unique_ptr<hal::IPm::ILock> m_pm_lock;
     Filesystem& m_filesystem;
-    HttpsClient& m_https_client;
 
     std::unique_ptr<ListenerCookie> m_state_listener;
-    ApplicationState::PartialReadOnlyCache<AS::pixel_position> m_pixel_state_cache;
+    ApplicationState::PartialReadOnlyCache<AS::pixel_position,
+                                           AS::position,
+                                           AS::download_home_region>
+        m_pixel_state_cache;
 
     SingleColorImage m_black_tile {kTileSize, kTileSize, 2, 0x0000}; // Black tile
 
     std::array<TileImage, kTileCacheSize> m_image_cache;
-    std::array<uint32_t, kTileCacheSize> m_tiles;
+    std::array<std::atomic<uint32_t>, kTileCacheSize> m_tiles {};
+    std::array<std::atomic<bool>, kTileCacheSize> m_pinned {};
+    // Only used by the UI thread, and reused after BeginFrame
+    std::array<TileImage, kFallbackTiles> m_fallback_tiles;
+    size_t m_used_fallback_tiles {0};
+    // Slots reserved for tiles being decoded, only used by the tile cache thread
+    std::array<bool, kTileCacheSize> m_decoding {};
+    TileIndex<kTileCacheSize> m_tile_index;
+    ClockEvictionPolicy<kTileCacheSize> m_eviction_policy;
+    static_assert(TileEvictionPolicy<decltype(m_eviction_policy)>);
+
+    std::atomic<uint32_t> m_hits {0};
+    std::atomic<uint32_t> m_misses {0};
+    std::atomic<uint32_t> m_evictions {0};
 
     etl::queue_spsc_atomic<Tile, 8> m_get_from_coldstore;
+    // Tiles ahead on the path, nearest first. Loaded when the UI doesn't need anything.
+    std::deque<Tile> m_prefetch_tiles;
+    // The zoom level the UI currently shows
+    std::atomic<uint8_t> m_requested_zoom {kDefaultZoom};
     std::vector<Tile> m_get_from_server;
     std::vector<Tile> m_get_from_server_background;
     std::vector<Tile> m_reload_tiles_from_server;
+    // Checked in the background, so that the loads don't wait for the metadata
+    etl::circular_buffer<Tile, kAgeCheckQueueSize> m_check_tile_age;
+    // Expired tiles, fetched again when nothing else is queued
+    etl::unordered_set<Tile, kRevalidateQueueSize> m_revalidate_from_server;
+    // Offline region download, persisted to be resumed after a reboot
+    std::deque<RegionTile> m_region_download;
+    // Handed to the web threads, and put back in the queue if they fail
+    std::vector<RegionTile> m_region_download_in_flight;
+    uint32_t m_region_download_total {0};
+    // Tiles which failed too many times, and are not tried again
+    uint32_t m_region_download_failed {0};
+    uint32_t m_region_tiles_since_save {0};
     Tile m_current_city_tile {kInvalidTile};
 
-    std::unordered_map<uint8_t, std::unordered_set<Tile>> m_pending_city_tiles_by_zoom;
-
-    std::unique_ptr<WebThread> m_web_thread;
+    std::unordered_map<uint8_t, std::unique_ptr<PendingTileJournal>> m_pending_city_tiles;
+
+    std::string m_data_directory;
+    // Read-only tile archives, per zoom level
+    std::unordered_map<uint8_t, std::unique_ptr<TilePack>> m_tile_packs;
+
+    std::vector<std::unique_ptr<WebThread>> m_web_threads;
+    uint8_t m_next_web_thread {0};
+    std::vector<std::unique_ptr<DecodeThread>> m_decode_threads;
+    // Only used by the tile cache thread, grows to the maximum number of jobs in flight
+    std::vector<std::vector<std::byte>> m_free_png_buffers;
+    uint8_t m_next_decode_thread {0};
+
+    // The tile id in each slot of the pre-decoded tile store, to avoid reading other tiles.
+    // Persisted now and then, and the header in the slot is still checked when loading.
+    std::array<std::atomic<uint32_t>, kDecodedTileStoreSlots> m_decoded_tile_owners {};
+    // Bumped when a tile in the slot is fetched again, so that decodes of the old PNG which
+    // are in flight aren't stored
+    std::array<std::atomic<uint32_t>, kDecodedTileStoreSlots> m_decoded_tile_generations {};
+    // The last tile decoded from PNG per slot, only used by the tile cache thread
+    std::array<uint32_t, kDecodedTileStoreSlots> m_decoded_tile_candidates {};
+    uint32_t m_decoded_tiles_since_save {0};
 
     mutable etl::mutex m_filesystem_mutex;
+
+    // A new region download from another thread, applied by the tile cache thread
+    etl::mutex m_region_request_mutex;
+    std::optional<std::vector<Tile>> m_region_request;
 };
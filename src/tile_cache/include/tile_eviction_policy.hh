@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/**
+ * @brief What the tile cache needs from an eviction policy
+ *
+ * Touch() is called on every cache hit, from the user interface thread. The rest are
+ * called from the tile cache thread. Inserted() is for tiles which the UI asked for, and
+ * Prefetched() for tiles which it might need later. SelectVictim() must never return a
+ * slot for which the pinned predicate holds.
+ */
+template <typename T>
+concept TileEvictionPolicy = requires(T policy, uint16_t slot, bool (*is_pinned)(uint16_t)) {
+    policy.Touch(slot);
+    policy.Inserted(slot);
+    policy.Prefetched(slot);
+    { policy.SelectVictim(is_pinned) } -> std::same_as<std::optional<uint16_t>>;
+    { policy.UnreferencedSlots(is_pinned) } -> std::same_as<size_t>;
+};
+
+/**
+ * @brief CLOCK (second chance) replacement
+ *
+ * Each slot has a reference bit which is set on hits. The hand sweeps the slots, clearing
+ * reference bits, and selects the first unreferenced and unpinned slot. Amortized O(1),
+ * and at most two sweeps when everything has been referenced.
+ */
+template <size_t Slots>
+class ClockEvictionPolicy
+{
+public:
+    ClockEvictionPolicy() = default;
+    ClockEvictionPolicy(const ClockEvictionPolicy&) = delete;
+    ClockEvictionPolicy& operator=(const ClockEvictionPolicy&) = delete;
+
+    // Context: Any thread
+    void Touch(uint16_t slot)
+    {
+        m_referenced[slot].store(true, std::memory_order_relaxed);
+    }
+
+    void Inserted(uint16_t slot)
+    {
+        // Someone asked for the tile, so give it a second chance
+        m_referenced[slot].store(true, std::memory_order_relaxed);
+    }
+
+    void Prefetched(uint16_t slot)
+    {
+        // Nobody has asked for it yet, so it goes first unless it's used before that
+        m_referenced[slot].store(false, std::memory_order_relaxed);
+    }
+
+    // The slots which can be selected without taking a second chance from anyone
+    size_t UnreferencedSlots(auto is_pinned) const
+    {
+        size_t out = 0;
+
+        for (auto slot = 0u; slot < Slots; slot++)
+        {
+            if (!is_pinned(slot) && !m_referenced[slot].load(std::memory_order_relaxed))
+            {
+                out++;
+            }
+        }
+
+        return out;
+    }
+
+    std::optional<uint16_t> SelectVictim(auto is_pinned)
+    {
+        for (auto i = 0u; i < 2 * Slots; i++)
+        {
+            auto slot = m_hand;
+            m_hand = (m_hand + 1) % Slots;
+
+            if (is_pinned(slot))
+            {
+                continue;
+            }
+            if (m_referenced[slot].exchange(false, std::memory_order_relaxed))
+            {
+                continue;
+            }
+
+            return slot;
+        }
+
+        // Everything is pinned
+        return std::nullopt;
+    }
+
+private:
+    std::array<std::atomic<bool>, Slots> m_referenced {};
+    uint16_t m_hand {0};
+};
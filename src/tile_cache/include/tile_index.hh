@@ -0,0 +1,192 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <optional>
+
+/**
+ * @brief Fixed-capacity open addressing map from a tile id to a cache slot
+ *
+ * Linear probing with backward-shift deletion, so there are no tombstones and lookups
+ * stay short even after many evictions. A key of 0 marks an empty bucket, which is never
+ * a valid TileId (the zoom bits are always non-zero for the zooms we cache).
+ *
+ * There can be one writer thread and any number of reader threads. A reader which races
+ * with an update gets a miss rather than waiting, which is fine for a cache.
+ */
+template <size_t Capacity>
+class TileIndex
+{
+public:
+    static_assert(Capacity > 0, "Empty tile index");
+
+    // Keep the load factor at or below 50%
+    static constexpr size_t kBuckets = std::bit_ceil(Capacity * 2);
+    static constexpr uint32_t kEmptyKey = 0;
+
+    TileIndex()
+    {
+        Clear();
+    }
+
+    TileIndex(const TileIndex&) = delete;
+    TileIndex& operator=(const TileIndex&) = delete;
+
+    // Context: Any thread
+    std::optional<uint16_t> Find(uint32_t key) const
+    {
+        if (key == kEmptyKey)
+        {
+            return std::nullopt;
+        }
+
+        auto generation = m_generation.load(std::memory_order_acquire);
+        if (generation & 1)
+        {
+            // Update in progress
+            return std::nullopt;
+        }
+
+        std::optional<uint16_t> out;
+        for (auto i = Home(key);; i = Next(i))
+        {
+            auto bucket_key = m_buckets[i].key.load(std::memory_order_relaxed);
+
+            if (bucket_key == key)
+            {
+                out = m_buckets[i].slot.load(std::memory_order_relaxed);
+                break;
+            }
+            if (bucket_key == kEmptyKey)
+            {
+                break;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_generation.load(std::memory_order_relaxed) != generation)
+        {
+            return std::nullopt;
+        }
+
+        return out;
+    }
+
+    // Context: The writer thread
+    void Insert(uint32_t key, uint16_t slot)
+    {
+        if (key == kEmptyKey)
+        {
+            return;
+        }
+
+        auto i = Home(key);
+        while (KeyAt(i) != kEmptyKey && KeyAt(i) != key)
+        {
+            i = Next(i);
+        }
+
+        BeginUpdate();
+        Store(i, key, slot);
+        EndUpdate();
+    }
+
+    // Context: The writer thread
+    void Erase(uint32_t key)
+    {
+        if (key == kEmptyKey)
+        {
+            return;
+        }
+
+        auto hole = Home(key);
+        while (KeyAt(hole) != key)
+        {
+            if (KeyAt(hole) == kEmptyKey)
+            {
+                // Not present
+                return;
+            }
+            hole = Next(hole);
+        }
+
+        BeginUpdate();
+
+        // Shift following entries back into the hole, as long as that doesn't move them
+        // before their home bucket
+        for (auto i = Next(hole); KeyAt(i) != kEmptyKey; i = Next(i))
+        {
+            if (Distance(Home(KeyAt(i)), i) >= Distance(hole, i))
+            {
+                Store(hole, KeyAt(i), m_buckets[i].slot.load(std::memory_order_relaxed));
+                hole = i;
+            }
+        }
+        Store(hole, kEmptyKey, 0);
+
+        EndUpdate();
+    }
+
+    // Context: The writer thread
+    void Clear()
+    {
+        BeginUpdate();
+        for (auto i = 0u; i < kBuckets; i++)
+        {
+            Store(i, kEmptyKey, 0);
+        }
+        EndUpdate();
+    }
+
+private:
+    struct Bucket
+    {
+        std::atomic<uint32_t> key {kEmptyKey};
+        std::atomic<uint16_t> slot {0};
+    };
+
+    static size_t Home(uint32_t key)
+    {
+        // Fibonacci hashing, the tile id has most of its entropy in the upper bits
+        return (key * 0x9E3779B1u) >> (32 - std::countr_zero(kBuckets));
+    }
+
+    static size_t Next(size_t i)
+    {
+        return (i + 1) & (kBuckets - 1);
+    }
+
+    static size_t Distance(size_t from, size_t to)
+    {
+        return (to - from) & (kBuckets - 1);
+    }
+
+    uint32_t KeyAt(size_t i) const
+    {
+        return m_buckets[i].key.load(std::memory_order_relaxed);
+    }
+
+    void Store(size_t i, uint32_t key, uint16_t slot)
+    {
+        m_buckets[i].key.store(key, std::memory_order_relaxed);
+        m_buckets[i].slot.store(slot, std::memory_order_relaxed);
+    }
+
+    void BeginUpdate()
+    {
+        m_generation.store(m_generation.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void EndUpdate()
+    {
+        m_generation.store(m_generation.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_release);
+    }
+
+    std::array<Bucket, kBuckets> m_buckets;
+    std::atomic<uint32_t> m_generation {0};
+};
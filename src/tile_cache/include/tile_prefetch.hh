@@ -0,0 +1,23 @@
+#pragma once
+
+#include "wgs84_to_osm_point.hh"
+
+#include <etl/vector.h>
+
+constexpr auto kMaxPrefetchTiles = 24;
+
+/**
+ * @brief Predict the tiles along the path ahead
+ *
+ * Projects the path a number of seconds ahead along the heading, plus a margin for what is
+ * already visible on screen, and returns the tiles on and beside it ordered by distance.
+ *
+ * @param position the current position, at the zoom level to predict tiles for
+ * @param heading in degrees, clockwise from north
+ * @param speed in km/h
+ * @param meters_per_pixel at the current position
+ *
+ * @return the tiles, nearest first. Empty when standing still
+ */
+etl::vector<Tile, kMaxPrefetchTiles>
+PredictTiles(const Point& position, float heading, float speed, float meters_per_pixel);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "wgs84_to_osm_point.hh"
+
+#include <span>
+#include <vector>
+
+/**
+ * @brief The tiles covering a bounding box
+ *
+ * @param corner_a, corner_b opposite corners of the box, at the same zoom level
+ * @param zoom the zoom level of the tiles
+ */
+std::vector<Tile> TilesInBox(const Point& corner_a, const Point& corner_b, uint8_t zoom);
+
+/**
+ * @brief The tiles along a route, in route order and without duplicates
+ *
+ * @param route the route points, at the same zoom level
+ * @param zoom the zoom level of the tiles
+ * @param margin_tiles the number of tiles to include on each side of the route
+ */
+std::vector<Tile>
+TilesAlongRoute(std::span<const Point> route, uint8_t zoom, int32_t margin_tiles);
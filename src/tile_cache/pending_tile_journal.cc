@@ -0,0 +1,334 @@
+#include "pending_tile_journal.hh"
+
+#include <cstring>
+#include <format>
+
+namespace
+{
+
+// Bump when the format changes
+constexpr uint32_t kSnapshotMagic = 0x50534e31; // "PSN1"
+constexpr uint32_t kJournalMagic = 0x504a4e31;  // "PJN1"
+
+// The format before the journal
+constexpr int32_t kLegacyMagic = 0x43697480;
+constexpr auto kLegacyFileName = "pending.bin";
+
+struct SnapshotHeader
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t count;
+    uint32_t crc;
+};
+
+struct JournalHeader
+{
+    uint32_t magic;
+    // The snapshot sequence the journal applies to
+    uint32_t base_sequence;
+};
+
+struct Entry
+{
+    int32_t x;
+    int32_t y;
+};
+
+struct JournalRecord
+{
+    Entry entry;
+    uint32_t crc;
+};
+
+uint32_t
+Crc32(std::span<const std::byte> data, uint32_t crc = 0)
+{
+    crc = ~crc;
+    for (auto b : data)
+    {
+        crc ^= static_cast<uint8_t>(b);
+        for (auto i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+template <typename T>
+uint32_t
+Crc32Of(const T& value, uint32_t crc = 0)
+{
+    return Crc32(std::as_bytes(std::span {&value, 1}), crc);
+}
+
+// Also covers the sequence, so records from an older journal are rejected
+uint32_t
+RecordCrc(const Entry& entry, uint32_t base_sequence)
+{
+    return Crc32Of(entry, Crc32Of(base_sequence));
+}
+
+template <typename T>
+void
+Append(std::vector<std::byte>& out, const T& value)
+{
+    auto bytes = std::as_bytes(std::span {&value, 1});
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+template <typename T>
+std::optional<T>
+Extract(std::span<const std::byte> data, size_t offset)
+{
+    if (offset + sizeof(T) > data.size())
+    {
+        return std::nullopt;
+    }
+
+    T out;
+    memcpy(&out, data.data() + offset, sizeof(T));
+
+    return out;
+}
+
+} // namespace
+
+PendingTileJournal::PendingTileJournal(std::string directory,
+                                       uint8_t zoom,
+                                       ReadFunction read,
+                                       WriteFunction write)
+    : m_directory(std::move(directory))
+    , m_zoom(zoom)
+    , m_read(std::move(read))
+    , m_write(std::move(write))
+{
+}
+
+void
+PendingTileJournal::Load()
+{
+    m_tiles.clear();
+    m_journal.clear();
+    m_sequence = 0;
+
+    if (!LoadSnapshot())
+    {
+        if (LoadLegacy())
+        {
+            // Convert it once, the old file is ignored after this
+            Compact();
+        }
+        return;
+    }
+
+    LoadJournal();
+}
+
+bool
+PendingTileJournal::Add(const Tile& tile)
+{
+    if (m_tiles.contains(tile))
+    {
+        return false;
+    }
+    m_tiles.insert(tile);
+
+    if (m_journal.size() >= kMaxJournalEntries)
+    {
+        Compact();
+    }
+    else
+    {
+        m_journal.push_back(tile);
+        WriteJournal();
+    }
+
+    return true;
+}
+
+bool
+PendingTileJournal::LoadSnapshot()
+{
+    std::optional<uint32_t> best_sequence;
+    std::vector<Tile> best_tiles;
+
+    for (auto slot = 0; slot < 2; slot++)
+    {
+        auto data = m_read(std::format("{}/snapshot_{}.bin", m_directory, slot));
+        if (!data)
+        {
+            continue;
+        }
+
+        auto header = Extract<SnapshotHeader>(*data, 0);
+        if (!header || header->magic != kSnapshotMagic ||
+            data->size() != sizeof(SnapshotHeader) + header->count * sizeof(Entry))
+        {
+            continue;
+        }
+
+        auto entries = std::span {*data}.subspan(sizeof(SnapshotHeader));
+        if (Crc32(entries, Crc32Of(header->sequence)) != header->crc)
+        {
+            // Probably a torn write during compaction
+            continue;
+        }
+        if (best_sequence && header->sequence < *best_sequence)
+        {
+            continue;
+        }
+
+        best_sequence = header->sequence;
+        best_tiles.clear();
+        for (auto i = 0u; i < header->count; i++)
+        {
+            auto entry = *Extract<Entry>(entries, i * sizeof(Entry));
+            best_tiles.push_back(Tile {entry.x, entry.y, m_zoom});
+        }
+    }
+
+    if (!best_sequence)
+    {
+        return false;
+    }
+
+    m_sequence = *best_sequence;
+    m_tiles.insert(best_tiles.begin(), best_tiles.end());
+
+    return true;
+}
+
+bool
+PendingTileJournal::LoadLegacy()
+{
+    auto data = m_read(std::format("{}/{}", m_directory, kLegacyFileName));
+    if (!data)
+    {
+        return false;
+    }
+
+    auto magic = Extract<int32_t>(*data, 0);
+    if (!magic || *magic != kLegacyMagic)
+    {
+        return false;
+    }
+
+    // x, y, zoom as int32_t
+    for (auto offset = sizeof(int32_t); offset + 3 * sizeof(int32_t) <= data->size();
+         offset += 3 * sizeof(int32_t))
+    {
+        auto x = *Extract<int32_t>(*data, offset);
+        auto y = *Extract<int32_t>(*data, offset + sizeof(int32_t));
+        auto zoom = *Extract<int32_t>(*data, offset + 2 * sizeof(int32_t));
+
+        if (zoom == m_zoom)
+        {
+            m_tiles.insert(Tile {x, y, m_zoom});
+        }
+    }
+
+    return true;
+}
+
+void
+PendingTileJournal::LoadJournal()
+{
+    // Both files start with the same tiles since the snapshot, so the longest one has them all
+    for (auto slot = 0; slot < 2; slot++)
+    {
+        auto tiles = ReadJournal(std::format("{}/journal_{}.bin", m_directory, slot));
+
+        if (tiles.size() > m_journal.size())
+        {
+            m_journal = std::move(tiles);
+        }
+    }
+
+    m_tiles.insert(m_journal.begin(), m_journal.end());
+}
+
+std::vector<Tile>
+PendingTileJournal::ReadJournal(const std::string& path) const
+{
+    std::vector<Tile> out;
+
+    auto data = m_read(path);
+    if (!data)
+    {
+        return out;
+    }
+
+    auto header = Extract<JournalHeader>(*data, 0);
+    if (!header || header->magic != kJournalMagic || header->base_sequence != m_sequence)
+    {
+        // Already part of the snapshot, or torn before the header was written
+        return out;
+    }
+
+    for (auto offset = sizeof(JournalHeader);; offset += sizeof(JournalRecord))
+    {
+        auto record = Extract<JournalRecord>(*data, offset);
+
+        if (!record || record->crc != RecordCrc(record->entry, m_sequence) ||
+            out.size() >= kMaxJournalEntries)
+        {
+            // The end, or a torn write
+            break;
+        }
+
+        out.push_back(Tile {record->entry.x, record->entry.y, m_zoom});
+    }
+
+    return out;
+}
+
+void
+PendingTileJournal::WriteJournal()
+{
+    std::vector<std::byte> data;
+
+    data.reserve(sizeof(JournalHeader) + m_journal.size() * sizeof(JournalRecord));
+    Append(data, JournalHeader {kJournalMagic, m_sequence});
+    for (const auto& tile : m_journal)
+    {
+        auto entry = Entry {tile.x, tile.y};
+
+        Append(data, JournalRecord {entry, RecordCrc(entry, m_sequence)});
+    }
+
+    // Never the file with the previous version, which is then left if this write is torn
+    m_write(std::format("{}/journal_{}.bin", m_directory, m_journal.size() % 2), data);
+}
+
+void
+PendingTileJournal::Compact()
+{
+    std::vector<std::byte> entries;
+
+    entries.reserve(m_tiles.size() * sizeof(Entry));
+    for (const auto& tile : m_tiles)
+    {
+        Append(entries, Entry {tile.x, tile.y});
+    }
+
+    m_sequence++;
+
+    std::vector<std::byte> data;
+    data.reserve(sizeof(SnapshotHeader) + entries.size());
+    Append(data,
+           SnapshotHeader {kSnapshotMagic,
+                           m_sequence,
+                           static_cast<uint32_t>(m_tiles.size()),
+                           Crc32(entries, Crc32Of(m_sequence))});
+    data.insert(data.end(), entries.begin(), entries.end());
+
+    // Into the older snapshot. If this is interrupted, the newer one and the journal remain.
+    m_write(std::format("{}/snapshot_{}.bin", m_directory, m_sequence % 2), data);
+
+    // ... and then the journal is empty, it applies to the new snapshot
+    m_journal.clear();
+    WriteJournal();
+}
@@ -0,0 +1,113 @@
+#include "rgb565_rle.hh"
+
+#include <algorithm>
+
+namespace
+{
+
+constexpr uint16_t kRunBit = 0x8000;
+constexpr size_t kMaxCount = 0x7fff;
+
+// Shorter runs are cheaper as part of a literal
+constexpr size_t kMinRun = 3;
+
+size_t
+RunLength(std::span<const uint16_t> pixels, size_t at)
+{
+    auto n = 1u;
+
+    while (at + n < pixels.size() && n < kMaxCount && pixels[at + n] == pixels[at])
+    {
+        n++;
+    }
+
+    return n;
+}
+
+} // namespace
+
+namespace rgb565_rle
+{
+
+std::vector<uint16_t>
+Encode(std::span<const uint16_t> pixels)
+{
+    std::vector<uint16_t> out;
+    size_t literal_start = 0;
+    size_t i = 0;
+
+    auto flush_literal = [&](size_t end) {
+        while (literal_start < end)
+        {
+            auto n = std::min(end - literal_start, kMaxCount);
+
+            out.push_back(static_cast<uint16_t>(n));
+            out.insert(out.end(),
+                       pixels.begin() + literal_start,
+                       pixels.begin() + literal_start + n);
+            literal_start += n;
+        }
+    };
+
+    while (i < pixels.size())
+    {
+        auto run = RunLength(pixels, i);
+
+        if (run >= kMinRun)
+        {
+            flush_literal(i);
+            out.push_back(static_cast<uint16_t>(kRunBit | run));
+            out.push_back(pixels[i]);
+            i += run;
+            literal_start = i;
+        }
+        else
+        {
+            i += run;
+        }
+    }
+    flush_literal(pixels.size());
+
+    return out;
+}
+
+bool
+Decode(std::span<const uint16_t> encoded, std::span<uint16_t> dst)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < encoded.size())
+    {
+        auto control = encoded[in++];
+        size_t count = control & kMaxCount;
+
+        if (count > dst.size() - out)
+        {
+            return false;
+        }
+
+        if (control & kRunBit)
+        {
+            if (in >= encoded.size())
+            {
+                return false;
+            }
+            std::fill_n(dst.begin() + out, count, encoded[in++]);
+        }
+        else
+        {
+            if (count > encoded.size() - in)
+            {
+                return false;
+            }
+            std::copy_n(encoded.begin() + in, count, dst.begin() + out);
+            in += count;
+        }
+        out += count;
+    }
+
+    return out == dst.size();
+}
+
+} // namespace rgb565_rle
@@ -1,33 +1,115 @@
 #include "tile_cache.hh"
 
+#include "debug_assert.hh"
+#include "rgb565_rle.hh"
+#include "tile_prefetch.hh"
+#include "tile_region.hh"
+
 #include <PNGdec.h>
+#include <algorithm>
+#include <chrono>
 #include <cctype>
+#include <cstdio>
+#include <cstring>
 #include <format>
 #include <mutex>
+#include <utility>
 
 namespace
 {
 
-struct PendingData
+constexpr auto kCityTileFactor = 30;
+constexpr auto kCityTileFactorZoomedOut = 15;
+constexpr auto kLandscapeTileFactorZoomedOut = 5;
+
+constexpr auto kRuntimeOsmApiKeyFilename = "OSM_KEY.TXT";
+
+constexpr auto kRegionDownloadFileName = "pending/region.bin";
+// Bump when format changed
+constexpr uint32_t kRegionDownloadMagic = 0x52474e32; // "RGN2"
+// From the home position, in all directions
+constexpr auto kHomeRegionRadiusMeters = 10000;
+// Zoomed out first, to quickly get an overview
+constexpr auto kHomeRegionZooms = std::array<uint8_t, 3> {kLandscapeZoom, kCityZoom, kDefaultZoom};
+// Tiles handed to the web threads between saves of the queue
+constexpr auto kRegionSaveInterval = 64;
+// Tiles to look at per activation, since most might already be on disk
+constexpr auto kMaxRegionTilesPerActivation = 32;
+
+struct DecodedTileHeader
 {
     uint32_t magic;
+    uint32_t tile_id;
+    // In pixels (uint16_t)
+    uint32_t length;
+};
+constexpr uint32_t kDecodedTileMagic = 0x52443635; // "RD65"
+
+constexpr auto kDecodedTileOwnersFileName = "decoded/owners.bin";
+// Stored tiles between saves of the owners. The ones after the last save are just misses.
+constexpr auto kDecodedTileOwnersSaveInterval = 16;
+
+// The top bits of a multiplicative hash, which depend on all bits of the tile id. Same as
+// the tile index.
+uint32_t
+DecodedTileSlot(uint32_t tile_id)
+{
+    return (tile_id * 0x9E3779B1u) >>
+           (32 - std::countr_zero(static_cast<uint32_t>(kDecodedTileStoreSlots)));
+}
+
+// Before this, the clock has not been set (2024-01-01)
+constexpr auto kEarliestValidTime = std::chrono::sys_seconds {std::chrono::seconds {1704067200}};
 
-    struct TileData
+std::optional<int64_t>
+SecondsSinceEpoch()
+{
+    auto now =
+        std::chrono::time_point_cast<std::chrono::seconds>(std::chrono::system_clock::now());
+    if (now < kEarliestValidTime)
     {
-        int32_t x;
-        int32_t y;
-        int32_t zoom;
-    } tiles[];
-};
+        return std::nullopt;
+    }
 
-constexpr auto kCityTileFactor = 30;
-constexpr auto kCityTileFactorZoomedOut = 15;
-constexpr auto kLandscapeTileFactorZoomedOut = 5;
+    return now.time_since_epoch().count();
+}
 
-constexpr auto kPendingCityTilesFileName = "pending.bin";
-// Bump when format changed
-constexpr int32_t kPendingTileMagic = 0x43697480;
-constexpr auto kRuntimeOsmApiKeyFilename = "OSM_KEY.TXT";
+constexpr auto kSecondsPerDay = 24 * 60 * 60;
+// Ages are in days, so an unchanged tile fetched again within a day keeps its old metadata
+constexpr auto kTileMetaRefreshSeconds = kSecondsPerDay;
+// Metadata reads per activation, which are only done when nothing else is fetched
+constexpr auto kMaxAgeChecksPerActivation = 4;
+
+// FNV-1a, only to detect changed tiles
+uint32_t
+ContentHash(std::span<const std::byte> data)
+{
+    uint32_t hash = 0x811C9DC5u;
+
+    for (auto b : data)
+    {
+        hash ^= static_cast<uint8_t>(b);
+        hash *= 0x01000193u;
+    }
+
+    // 0 means unknown
+    return hash ? hash : 1;
+}
+
+constexpr auto kDecodeThreadNames = std::array {
+    "tile_decoder_0",
+    "tile_decoder_1",
+    "tile_decoder_2",
+    "tile_decoder_3",
+};
+static_assert(kDecodeThreadNames.size() >= TileCache::kMaxDecodeThreads);
+
+constexpr auto kWebThreadNames = std::array {
+    "web_tile_fetcher_0",
+    "web_tile_fetcher_1",
+    "web_tile_fetcher_2",
+};
+static_assert(kWebThreadNames.size() >= TileCache::kMaxWebThreads);
 
 void
 TrimAsciiWhitespace(std::string& value)
@@ -69,6 +151,28 @@ struct DecodeHelper
     size_t offset;
 };
 
+// Scale up a part of src by 2^shift to fill dst
+void
+Upsample(std::span<const uint16_t> src, int32_t src_x, int32_t src_y, int shift, uint16_t* dst)
+{
+    const auto scale = 1 << shift;
+
+    for (auto y = 0; y < kTileSize; y += scale)
+    {
+        const auto* src_row = &src[(src_y + (y >> shift)) * kTileSize + src_x];
+        auto* dst_row = dst + y * kTileSize;
+
+        for (auto x = 0; x < kTileSize; x++)
+        {
+            dst_row[x] = src_row[x >> shift];
+        }
+        for (auto i = 1; i < scale; i++)
+        {
+            memcpy(dst_row + i * kTileSize, dst_row, kTileSize * sizeof(uint16_t));
+        }
+    }
+}
+
 int
 PngDraw(PNGDRAW* pDraw)
 {
@@ -82,52 +186,61 @@ PngDraw(PNGDRAW* pDraw)
 }
 
 
-class TileHandle final : public ITileHandle
+// Round-robin over the threads which have room for more work
+template <typename Thread>
+Thread*
+SelectThread(std::vector<std::unique_ptr<Thread>>& threads,
+             uint8_t& next,
+             bool (Thread::*can_accept)() const)
 {
-public:
-    explicit TileHandle(Image& image,
-                        uint8_t cache_index,
-                        std::atomic<uint32_t>& locked_cache_entries)
-        : m_image(image)
-        , m_cache_index(cache_index)
-        , m_locked_cache_entries(locked_cache_entries)
-    {
-        m_locked_cache_entries |= (1 << m_cache_index);
-    }
-
-    ~TileHandle() final
+    for (auto i = 0u; i < threads.size(); i++)
     {
-        // Unlock the cache entry
-        m_locked_cache_entries &= ~(1 << m_cache_index);
-    }
+        auto& thread = threads[(next + i) % threads.size()];
 
-    const Image& GetImage() const final
-    {
-        return m_image;
+        if (((*thread).*can_accept)())
+        {
+            next = (next + i + 1) % threads.size();
+            return thread.get();
+        }
     }
 
-private:
-    Image& m_image;
-    const uint8_t m_cache_index;
-    std::atomic<uint32_t>& m_locked_cache_entries;
-};
-
+    return nullptr;
+}
 
 } // namespace
 
 TileCache::TileCache(ApplicationState& application_state,
                      std::unique_ptr<hal::IPm::ILock> pm_lock,
                      Filesystem& filesystem,
-                     HttpsClient& https_client)
+                     std::vector<std::unique_ptr<HttpsClient>> https_clients,
+                     std::string data_directory,
+                     uint8_t decode_threads)
     : m_application_state(application_state)
     , m_pm_lock(std::move(pm_lock))
     , m_filesystem(filesystem)
-    , m_https_client(https_client)
-    , m_state_listener(m_application_state.AttachListener<AS::pixel_position>(GetSemaphore()))
+    , m_state_listener(
+          m_application_state
+              .AttachListener<AS::pixel_position, AS::position, AS::download_home_region>(
+                  GetSemaphore()))
     , m_pixel_state_cache(m_application_state)
-    , m_web_thread(std::make_unique<WebThread>(*this))
+    , m_data_directory(std::move(data_directory))
 {
-    std::ranges::fill(m_tiles, 0);
+    debug_assert(!https_clients.empty() && https_clients.size() <= kMaxWebThreads);
+    for (auto i = 0u; i < std::min<size_t>(https_clients.size(), kMaxWebThreads); i++)
+    {
+        m_web_threads.push_back(std::make_unique<WebThread>(*this, std::move(https_clients[i])));
+    }
+
+    decode_threads = std::clamp<uint8_t>(decode_threads, 1, kMaxDecodeThreads);
+    for (auto i = 0; i < decode_threads; i++)
+    {
+        m_decode_threads.push_back(std::make_unique<DecodeThread>(*this));
+    }
+
+    for (auto i = 0; i < decode_threads * (kDecodeQueueSize + 1); i++)
+    {
+        m_free_png_buffers.push_back(GetPngBuffer());
+    }
 }
 
 void
@@ -145,49 +258,49 @@ TileCache::OnStartup()
             osm_api_key = std::move(runtime_key);
         }
     }
-    m_web_thread->SetOsmApiKey(std::move(osm_api_key));
-
-    for (auto zoom : {kDefaultZoom, kCityZoom})
+    for (auto& web_thread : m_web_threads)
     {
-        auto pending_city_tile_data =
-            m_filesystem.ReadFile(std::format("pending/{}/{}", zoom, kPendingCityTilesFileName));
+        web_thread->SetOsmApiKey(osm_api_key);
+    }
 
-        if (!pending_city_tile_data || pending_city_tile_data->size() < sizeof(PendingData::magic))
-        {
-            continue;
-        }
+    for (auto zoom : {kDefaultZoom, kCityZoom, kLandscapeZoom})
+    {
+        auto pack = TilePack::Open(std::format("{}/packs/{}.pack", m_data_directory, zoom));
 
-        auto size = pending_city_tile_data->size() - sizeof(PendingData::magic);
-        if (pending_city_tile_data && (size % (sizeof(PendingData::TileData)) == 0))
+        if (pack)
         {
-            auto* data = reinterpret_cast<const PendingData*>(pending_city_tile_data->data());
-            auto count = size / sizeof(PendingData::TileData);
-
-            if (data->magic != kPendingTileMagic)
-            {
-                printf("Invalid pending city tile file for zoom %d\n", zoom);
-                continue;
-            }
-            for (auto i = 0u; i < count; i++)
-            {
-                if (data->tiles[i].zoom != zoom)
-                {
-                    printf("Invalid tile zoom in pending city tile file for zoom %d\n", zoom);
-                    continue;
-                }
-
-                m_pending_city_tiles_by_zoom[zoom].insert(
-                    Tile {data->tiles[i].x, data->tiles[i].y, static_cast<uint8_t>(zoom)});
-            }
+            printf("TileCache: %zu tiles in the pack for zoom %d\n", pack->Size(), zoom);
+            m_tile_packs[zoom] = std::move(pack);
         }
+    }
 
-        for (auto city_tile : m_pending_city_tiles_by_zoom[zoom])
+    for (auto zoom : {kDefaultZoom, kCityZoom, kLandscapeZoom})
+    {
+        auto journal = std::make_unique<PendingTileJournal>(
+            std::format("pending/{}", zoom),
+            zoom,
+            [this](const auto& path) { return m_filesystem.ReadFile(path); },
+            [this](const auto& path, auto data) { m_filesystem.WriteFile(path, data); });
+
+        journal->Load();
+        for (auto city_tile : journal->Tiles())
         {
             RefreshCityTiles(city_tile);
         }
+        m_pending_city_tiles[zoom] = std::move(journal);
     }
 
-    m_web_thread->Start("web_tile_fetcher", 4096);
+    LoadRegionDownload();
+    LoadDecodedTileOwners();
+
+    for (auto i = 0u; i < m_decode_threads.size(); i++)
+    {
+        m_decode_threads[i]->Start(kDecodeThreadNames[i], 8192);
+    }
+    for (auto i = 0u; i < m_web_threads.size(); i++)
+    {
+        m_web_threads[i]->Start(kWebThreadNames[i], 4096);
+    }
 }
 
 std::optional<milliseconds>
@@ -205,12 +318,8 @@ TileCache::OnActivation()
 
         for (auto tile : {default_tile, city_tile, land_tile})
         {
-            if (m_pending_city_tiles_by_zoom[tile.zoom].find(tile) ==
-                m_pending_city_tiles_by_zoom[tile.zoom].end())
-            {
-                m_pending_city_tiles_by_zoom[tile.zoom].insert(tile);
-                SavePendingCityTiles();
-            }
+            // Only written when a new city tile is entered
+            m_pending_city_tiles[tile.zoom]->Add(tile);
         }
         if (AppState().Get<AS::wifi_connected>() && default_tile != m_current_city_tile)
         {
@@ -223,13 +332,23 @@ TileCache::OnActivation()
             RefreshCityTiles(center_tile_zoomed_out);
         }
     });
+    co.OnNewValue<AS::position>([this](const auto& position) { PrefetchAlongPath(position); });
+    if (co.IsChanged<AS::download_home_region>())
+    {
+        StartHomeRegionDownload();
+    }
+    ApplyRegionDownloadRequest();
 
+    CompleteDecodes();
+    CompleteFetches();
     FillFromColdStore();
+    CheckTileAges();
     FillFromServer();
     // Again, in case the server has written them to FS
     FillFromColdStore();
 
-    if (m_get_from_server.empty())
+    if (m_get_from_server.empty() &&
+        (m_region_download.empty() || !AppState().Get<AS::wifi_connected>()))
     {
         return std::nullopt;
     }
@@ -240,30 +359,28 @@ TileCache::OnActivation()
 }
 
 bool
-TileCache::DecodePng(std::span<const std::byte> png_data, TileImage& out)
+TileCache::DecodePng(PNG& png, std::span<const std::byte> png_data, TileImage& out)
 {
     auto lock = m_pm_lock->FullPower();
 
-    auto png = std::make_unique<PNG>();
-
-    auto rc = png->openFLASH((uint8_t*)png_data.data(), png_data.size(), PngDraw);
+    auto rc = png.openFLASH((uint8_t*)png_data.data(), png_data.size(), PngDraw);
     if (rc != PNG_SUCCESS)
     {
         return false;
     }
 
 
-    if (out.Data16().size() == png->getWidth() * png->getHeight())
+    if (out.Data16().size() == png.getWidth() * png.getHeight())
     {
-        DecodeHelper priv(*png, out.WritableData16());
-        rc = png->decode((void*)&priv, 0);
+        DecodeHelper priv(png, out.WritableData16());
+        rc = png.decode((void*)&priv, 0);
     }
     else
     {
         rc = PNG_MEM_ERROR;
     }
 
-    png->close();
+    png.close();
     if (rc != PNG_SUCCESS)
     {
         // Failed to decode
@@ -273,243 +390,1043 @@ TileCache::DecodePng(std::span<const std::byte> png_data, TileImage& out)
     return true;
 }
 
-std::optional<std::vector<std::byte>>
-TileCache::ReadTile(const Tile& t) const
+bool
+TileCache::ReadTile(const Tile& t, std::vector<std::byte>& out)
 {
-    auto path = GetTilePath(t);
+    if (auto it = m_tile_packs.find(t.zoom); it != m_tile_packs.end())
+    {
+        // One index lookup and one read into the existing buffer, instead of walking the
+        // directory tree
+        if (it->second->ReadInto(TileId(t), out))
+        {
+            return true;
+        }
+    }
+
+    // Read directly, since the filesystem would allocate a new buffer for each tile
+    auto path = std::format("{}/{}", m_data_directory, GetTilePath(t));
 
     // Hold the lock if the web thread is writing (see below for motivation)
     auto lock = std::lock_guard(m_filesystem_mutex);
 
-    return m_filesystem.ReadFile(path);
+    auto fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    auto size = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+    auto ok = size >= 0 && fseek(fp, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        // Only grows the buffer for the few tiles larger than kPngBufferSize
+        out.resize(size);
+        ok = fread(out.data(), 1, out.size(), fp) == out.size();
+    }
+    fclose(fp);
+
+    return ok;
 }
 
-void
-TileCache::FillFromColdStore()
+std::vector<std::byte>
+TileCache::GetPngBuffer()
 {
-    Tile t = kInvalidTile;
-
-    while (m_get_from_coldstore.pop(t))
+    if (!m_free_png_buffers.empty())
     {
-        auto tile_id = TileId(t);
-        auto cached = std::ranges::find(m_tiles, tile_id);
-        if (cached != m_tiles.end())
-        {
-            // Already cached
-            continue;
-        }
+        auto out = std::move(m_free_png_buffers.back());
 
-        //        printf("Getting tile %d,%d from cold store\n", t.x, t.y);
-        auto data = ReadTile(t);
+        m_free_png_buffers.pop_back();
+        return out;
+    }
 
-        auto wifi_connected = AppState().Get<AS::wifi_connected>();
+    std::vector<std::byte> out;
+    out.reserve(kPngBufferSize);
 
-        if (data)
+    return out;
+}
+
+void
+TileCache::CompleteDecodes()
+{
+    auto wifi_connected = AppState().Get<AS::wifi_connected>();
+    auto loaded = false;
+    DecodeResult result;
+
+    for (auto& decoder : m_decode_threads)
+    {
+        while (decoder->PollResult(result))
         {
-            auto index = EvictTile();
+            auto tile_id = TileId(result.tile);
 
-            if (DecodePng(*data, m_image_cache[index]))
+            m_free_png_buffers.push_back(std::move(result.png_data));
+            m_decoding[result.slot] = false;
+            if (result.stored)
             {
-                // Successfully decoded, otherwise the evicted tile remains evicted
-                m_tiles[index] = tile_id;
-
-                // Awake anyone waiting for tiles (i.e., the UI)
-                m_application_state.CheckoutReadWrite().Post<AS::tile_loaded>();
+                m_decoded_tiles_since_save++;
+            }
+            if (result.success)
+            {
+                // Now visible to the UI
+                m_tiles[result.slot] = tile_id;
+                if (result.prefetched)
+                {
+                    m_eviction_policy.Prefetched(result.slot);
+                }
+                else
+                {
+                    m_eviction_policy.Inserted(result.slot);
+                }
+                loaded = true;
             }
             else
             {
-                m_tiles[index] = 0;
-                m_image_cache[index].SetUseCount(0);
+                // The slot remains evicted
+                m_tile_index.Erase(tile_id);
 
                 // Reload it from the server
                 if (wifi_connected)
                 {
-                    m_reload_tiles_from_server.push_back(t);
+                    m_reload_tiles_from_server.push_back(result.tile);
                 }
             }
         }
-        else if (wifi_connected)
-        {
-            m_get_from_server.push_back(t);
-        }
+    }
+
+    if (m_decoded_tiles_since_save >= kDecodedTileOwnersSaveInterval)
+    {
+        SaveDecodedTileOwners();
+    }
+
+    if (loaded)
+    {
+        // Awake anyone waiting for tiles (i.e., the UI)
+        m_application_state.CheckoutReadWrite().Post<AS::tile_loaded>();
     }
 }
 
 void
-TileCache::RefreshCityTiles(const Tile& center)
+TileCache::CompleteFetches()
 {
-    auto factor = kDefaultZoom;
+    FetchResult result;
+    auto region_progress = false;
 
-    if (center.zoom == kCityZoom)
-    {
-        factor = kCityTileFactorZoomedOut;
-    }
-    else if (center.zoom == kLandscapeZoom)
+    for (auto& web_thread : m_web_threads)
     {
-        factor = kLandscapeTileFactorZoomedOut;
+        while (web_thread->PollResult(result))
+        {
+            auto it = std::ranges::find(
+                m_region_download_in_flight, result.tile, &RegionTile::tile);
+
+            if (result.reason != FetchReason::kRegion || it == m_region_download_in_flight.end())
+            {
+                // Not part of the (current) region download
+                continue;
+            }
+
+            auto region_tile = *it;
+
+            m_region_download_in_flight.erase(it);
+            if (!result.success && ++region_tile.failures < kMaxRegionTileAttempts)
+            {
+                // Try again after the rest
+                m_region_download.push_back(region_tile);
+            }
+            else if (!result.success)
+            {
+                // Probably not on the server, so don't keep the download going forever
+                m_region_download_failed++;
+            }
+            region_progress = true;
+        }
     }
 
-    for (int dx = -factor; dx <= factor; ++dx)
+    if (region_progress)
     {
-        for (int dy = -factor; dy <= factor; ++dy)
+        if (m_region_download.empty() && m_region_download_in_flight.empty())
         {
-            Tile t {center.x + dx, center.y + dy, center.zoom};
-
-            m_get_from_server_background.push_back(t);
+            SaveRegionDownload();
         }
+        PublishRegionDownloadProgress();
     }
 }
 
+TileCache::DecodeThread*
+TileCache::SelectDecodeThread()
+{
+    return SelectThread(m_decode_threads, m_next_decode_thread, &DecodeThread::CanDecode);
+}
+
+TileCache::WebThread*
+TileCache::SelectWebThread()
+{
+    return SelectThread(m_web_threads, m_next_web_thread, &WebThread::CanFetchTile);
+}
 
 void
-TileCache::FillFromServer()
+TileCache::PrefetchAlongPath(const GpsData& position)
 {
-    if (!AppState().Get<AS::wifi_connected>())
+    auto point = Wgs84ToOsmPoint(position.position, m_requested_zoom);
+    if (!point)
     {
         return;
     }
 
-    while ((!m_get_from_server.empty() || !m_get_from_server_background.empty()) &&
-           m_web_thread->CanFetchTile())
-    {
-        Tile t;
+    auto tiles =
+        PredictTiles(*point, position.heading, position.speed, MetersPerPixelAtPoint(*point));
 
-        if (!m_get_from_server.empty())
-        {
-            t = m_get_from_server.back();
-            m_get_from_server.pop_back();
-        }
-        else
-        {
-            // Second priority, get when the first are empty
-            t = m_get_from_server_background.back();
-            m_get_from_server_background.pop_back();
-        }
+    // Replace the old prediction, which is probably not on the path anymore
+    m_prefetch_tiles.assign(tiles.begin(), tiles.end());
+}
 
-        if (t.x < 0 || t.y < 0)
-        {
-            continue;
-        }
+void
+TileCache::StartRegionDownload(const Point& corner_a,
+                               const Point& corner_b,
+                               std::span<const uint8_t> zooms)
+{
+    std::vector<Tile> tiles;
 
-        auto path = GetTilePath(t);
-        if (m_filesystem.FileExists(path))
-        {
-            // Already got it, probably from being requested by the UI
-            continue;
-        }
-        m_web_thread->FetchTile(t);
+    for (auto zoom : zooms)
+    {
+        auto box = TilesInBox(corner_a, corner_b, zoom);
+
+        tiles.insert(tiles.end(), box.begin(), box.end());
     }
+    StartRegionDownload(std::move(tiles));
+}
 
-    while (!m_reload_tiles_from_server.empty() && m_web_thread->CanFetchTile())
-    {
-        auto t = m_reload_tiles_from_server.back();
+void
+TileCache::StartRegionDownload(std::span<const Point> route,
+                               int32_t margin_tiles,
+                               std::span<const uint8_t> zooms)
+{
+    std::vector<Tile> tiles;
 
-        // Invalid tile
-        if (t.x < 0 || t.y < 0)
-        {
-            m_reload_tiles_from_server.pop_back();
-            continue;
-        }
+    for (auto zoom : zooms)
+    {
+        auto along = TilesAlongRoute(route, zoom, margin_tiles);
 
-        m_web_thread->FetchTile(t);
-        m_reload_tiles_from_server.pop_back();
+        tiles.insert(tiles.end(), along.begin(), along.end());
     }
+    StartRegionDownload(std::move(tiles));
 }
 
-std::string
-TileCache::GetTilePath(const Tile& t) const
+void
+TileCache::StartRegionDownload(std::vector<Tile> tiles)
 {
-    return std::format("tiles/{}/{}/{}.png", t.zoom, t.x, t.y);
+    {
+        auto lock = std::lock_guard(m_region_request_mutex);
+
+        // An earlier request which hasn't been applied yet is replaced
+        m_region_request = std::move(tiles);
+    }
+    Awake();
 }
 
 void
-TileCache::SavePendingCityTiles()
+TileCache::StartHomeRegionDownload()
 {
-    std::vector<std::byte> data;
-    for (const auto& [zoom, tiles] : m_pending_city_tiles_by_zoom)
+    auto home = AppState().Get<AS::configuration>()->home_position;
+
+    if (home.x == 0 && home.y == 0)
     {
-        data.resize(tiles.size() * sizeof(Tile) + sizeof(int32_t));
-        auto ptr = reinterpret_cast<int32_t*>(data.data());
-        *ptr++ = kPendingTileMagic;
+        printf("TileCache: No home position, nothing to download\n");
+        return;
+    }
 
-        for (const auto& tile : tiles)
-        {
-            *ptr++ = tile.x;
-            *ptr++ = tile.y;
-            *ptr++ = tile.zoom;
-        }
+    auto radius = static_cast<int32_t>(kHomeRegionRadiusMeters / MetersPerPixelAtPoint(home));
 
-        m_filesystem.WriteFile(std::format("pending/{}/{}", zoom, kPendingCityTilesFileName), data);
-    }
+    StartRegionDownload(home - Point {radius, radius, home.zoom},
+                        home + Point {radius, radius, home.zoom},
+                        kHomeRegionZooms);
 }
 
-uint8_t
-TileCache::EvictTile()
+void
+TileCache::ApplyRegionDownloadRequest()
 {
-    uint32_t lowest_use_count = UINT32_MAX;
-    uint32_t highest_use_count = 0;
-    auto selected = 0u;
+    std::optional<std::vector<Tile>> request;
 
-    for (auto i = 0u; i < m_tiles.size(); ++i)
     {
-        auto& tile = m_image_cache[i];
-        auto uc = tile.UseCount();
+        auto lock = std::lock_guard(m_region_request_mutex);
 
-        /*
-         * There is the case where use count wraps, but that should only cause
-         * some extra loads from disk.
-         */
-        if (uc < lowest_use_count)
-        {
-            lowest_use_count = uc;
-            selected = i;
-        }
-        highest_use_count = std::max(highest_use_count, uc);
+        std::swap(request, m_region_request);
+    }
+    if (!request)
+    {
+        return;
     }
 
-    m_image_cache[selected].SetUseCount(highest_use_count + 1);
-    return selected;
+    // Tiles in flight are still fetched, but they are no longer part of the download
+    m_region_download.clear();
+    m_region_download_in_flight.clear();
+    for (const auto& tile : *request)
+    {
+        m_region_download.push_back(RegionTile {tile, 0});
+    }
+    m_region_download_total = m_region_download.size();
+    m_region_download_failed = 0;
+    printf("TileCache: Downloading a region of %u tiles\n", m_region_download_total);
+
+    SaveRegionDownload();
+    PublishRegionDownloadProgress();
 }
 
-const Image&
-TileCache::GetTile(const Tile& at)
+void
+TileCache::LoadRegionDownload()
 {
-    auto id = TileId(at);
-    auto cached = std::ranges::find(m_tiles, id);
+    auto data = m_filesystem.ReadFile(kRegionDownloadFileName);
 
-    if (cached != m_tiles.end())
+    if (!data || data->size() < 4 * sizeof(uint32_t))
     {
-        auto& tile = m_image_cache[cached - m_tiles.begin()];
-
-        tile.BumpUseCount();
+        return;
+    }
 
-        return tile;
+    auto* words = reinterpret_cast<const uint32_t*>(data->data());
+    auto count = words[3];
+    if (words[0] != kRegionDownloadMagic ||
+        data->size() != (4 + 3 * static_cast<size_t>(count)) * sizeof(uint32_t))
+    {
+        printf("TileCache: Invalid region download file\n");
+        return;
     }
-    else
+
+    auto* tiles = reinterpret_cast<const int32_t*>(words + 4);
+    for (auto i = 0u; i < count; i++)
     {
-        if (m_get_from_coldstore.push(at))
-        {
-            Awake();
-        }
+        // The zoom level in the low byte, the failures above it
+        auto zoom_and_failures = static_cast<uint32_t>(tiles[i * 3 + 2]);
+        auto tile =
+            Tile {tiles[i * 3], tiles[i * 3 + 1], static_cast<uint8_t>(zoom_and_failures)};
+
+        m_region_download.push_back(
+            RegionTile {tile, static_cast<uint8_t>(zoom_and_failures >> 8)});
     }
+    m_region_download_total = words[1];
+    m_region_download_failed = words[2];
 
-    return m_black_tile;
+    PublishRegionDownloadProgress();
 }
 
-
-// The tile fetcher thread
-TileCache::WebThread::WebThread(TileCache& parent)
-    : m_parent(parent)
+void
+TileCache::SaveRegionDownload()
 {
+    std::vector<uint32_t> data;
+    auto count = m_region_download_in_flight.size() + m_region_download.size();
+
+    data.reserve(4 + 3 * count);
+    data.push_back(kRegionDownloadMagic);
+    data.push_back(m_region_download_total);
+    data.push_back(m_region_download_failed);
+    data.push_back(count);
+    auto append = [&data](const RegionTile& region_tile) {
+        data.push_back(region_tile.tile.x);
+        data.push_back(region_tile.tile.y);
+        data.push_back(region_tile.tile.zoom | region_tile.failures << 8);
+    };
+
+    // The tiles in flight might fail, so they are fetched again after a reboot
+    std::ranges::for_each(m_region_download_in_flight, append);
+    std::ranges::for_each(m_region_download, append);
+
+    m_filesystem.WriteFile(kRegionDownloadFileName, std::as_bytes(std::span {data}));
+    m_region_tiles_since_save = 0;
 }
 
 void
-TileCache::WebThread::FetchTile(const Tile& t)
+TileCache::PublishRegionDownloadProgress()
 {
-    if (m_in_queue.push(t))
-    {
-        Awake();
-    }
+    auto qw = m_application_state.CheckoutQueuedWriter<AS::region_download_done,
+                                                       AS::region_download_failed,
+                                                       AS::region_download_total>();
+
+    qw.Set<AS::region_download_done>(m_region_download_total - m_region_download.size() -
+                                     m_region_download_in_flight.size() -
+                                     m_region_download_failed);
+    qw.Set<AS::region_download_failed>(m_region_download_failed);
+    qw.Set<AS::region_download_total>(m_region_download_total);
+}
+
+void
+TileCache::FillFromColdStore()
+{
+    Tile t = kInvalidTile;
+    auto loaded = false;
+    // Prefetching must not push out what the UI uses, so it only gets the unreferenced slots
+    std::optional<size_t> prefetch_slots;
+
+    // Leave the rest in the queue until a decoder is available, they will awake us when done
+    while (auto decoder = SelectDecodeThread())
+    {
+        // What the UI asks for first, and then what it will soon need
+        auto requested = m_get_from_coldstore.pop(t);
+        if (!requested)
+        {
+            if (!prefetch_slots)
+            {
+                prefetch_slots = m_eviction_policy.UnreferencedSlots(
+                    [this](uint16_t slot) { return IsPinned(slot); });
+            }
+            if (m_prefetch_tiles.empty() || *prefetch_slots == 0)
+            {
+                break;
+            }
+            t = m_prefetch_tiles.front();
+            m_prefetch_tiles.pop_front();
+        }
+
+        auto tile_id = TileId(t);
+        if (m_tile_index.Find(tile_id))
+        {
+            // Already cached, or being decoded
+            continue;
+        }
+
+        if (!requested)
+        {
+            (*prefetch_slots)--;
+        }
+
+        if (LoadDecodedTile(t, !requested))
+        {
+            if (!IsInTilePack(t))
+            {
+                m_check_tile_age.push(t);
+            }
+            loaded = true;
+            continue;
+        }
+
+        //        printf("Getting tile %d,%d from cold store\n", t.x, t.y);
+        // Before the PNG is read, so that a fetch which replaces it also cancels the store
+        auto store_generation = DecodedTileStoreGeneration(tile_id);
+        auto data = GetPngBuffer();
+
+        if (ReadTile(t, data))
+        {
+            auto index = EvictTile();
+            if (!index)
+            {
+                // Everything is in use by the UI, which will ask again on the next frame
+                m_free_png_buffers.push_back(std::move(data));
+                continue;
+            }
+
+            // Reserve the slot. The tile is not visible to the UI until m_tiles is set.
+            m_decoding[*index] = true;
+            m_tile_index.Insert(tile_id, *index);
+
+            if (!IsInTilePack(t))
+            {
+                m_check_tile_age.push(t);
+            }
+
+            // The decoder works on this while the next tile is read
+            decoder->Decode(
+                DecodeJob {t, *index, !requested, store_generation, std::move(data)});
+            continue;
+        }
+
+        m_free_png_buffers.push_back(std::move(data));
+        if (requested && AppState().Get<AS::wifi_connected>())
+        {
+            m_get_from_server.push_back(t);
+        }
+    }
+
+    if (loaded)
+    {
+        m_application_state.CheckoutReadWrite().Post<AS::tile_loaded>();
+    }
+}
+
+void
+TileCache::CheckTileAges()
+{
+    auto max_age_days = AppState().Get<AS::configuration>()->tile_max_age_days;
+    auto now = SecondsSinceEpoch();
+
+    if (max_age_days == 0 || !now)
+    {
+        m_check_tile_age.clear();
+        return;
+    }
+
+    // Expired tiles can only be fetched on wifi, and the tiles the UI waits for come first
+    if (!AppState().Get<AS::wifi_connected>() || !m_get_from_server.empty() ||
+        !m_get_from_server_background.empty())
+    {
+        return;
+    }
+
+    for (auto i = 0; i < kMaxAgeChecksPerActivation && !m_check_tile_age.empty() &&
+                     !m_revalidate_from_server.full();
+         i++)
+    {
+        auto t = m_check_tile_age.front();
+        m_check_tile_age.pop();
+
+        auto lock = std::lock_guard(m_filesystem_mutex);
+        auto meta = ReadTileMeta(t);
+
+        if (!meta || meta->fetched_at == 0)
+        {
+            // Fetched before metadata existed, or before the clock was set. Start aging it
+            // now, the content is unknown until it's fetched again.
+            WriteTileMeta(t, TileMeta {kTileMetaMagic, 0, *now});
+        }
+        else if (*now - meta->fetched_at > static_cast<int64_t>(max_age_days) * kSecondsPerDay)
+        {
+            m_revalidate_from_server.insert(t);
+        }
+    }
+}
+
+bool
+TileCache::LoadDecodedTile(const Tile& t, bool prefetched)
+{
+    if (kDecodedTileStoreSlots == 0)
+    {
+        return false;
+    }
+
+    auto tile_id = TileId(t);
+    if (m_decoded_tile_owners[DecodedTileSlot(tile_id)] != tile_id)
+    {
+        // Another tile, or nothing, in the slot. No need to read up to 128KiB to see that.
+        return false;
+    }
+
+    auto data = [this, tile_id]() {
+        auto lock = std::lock_guard(m_filesystem_mutex);
+
+        return m_filesystem.ReadFile(GetDecodedTilePath(tile_id));
+    }();
+
+    if (!data || data->size() < sizeof(DecodedTileHeader))
+    {
+        return false;
+    }
+
+    DecodedTileHeader header;
+    memcpy(&header, data->data(), sizeof(header));
+    auto payload_size = data->size() - sizeof(header);
+
+    if (header.magic != kDecodedTileMagic || header.tile_id != tile_id ||
+        header.length * sizeof(uint16_t) != payload_size)
+    {
+        // Another tile in the same slot, or a stale format
+        return false;
+    }
+
+    auto index = EvictTile();
+    if (!index)
+    {
+        return false;
+    }
+
+    auto encoded = std::span {reinterpret_cast<const uint16_t*>(data->data() + sizeof(header)),
+                              header.length};
+    if (!rgb565_rle::Decode(
+            encoded, std::span {m_image_cache[*index].WritableData16(), kTileSize * kTileSize}))
+    {
+        // Corrupt, the slot remains evicted and the PNG is used instead
+        return false;
+    }
+
+    m_tiles[*index] = tile_id;
+    m_tile_index.Insert(tile_id, *index);
+    if (prefetched)
+    {
+        m_eviction_policy.Prefetched(*index);
+    }
+    else
+    {
+        m_eviction_policy.Inserted(*index);
+    }
+
+    return true;
+}
+
+std::optional<uint32_t>
+TileCache::DecodedTileStoreGeneration(uint32_t tile_id)
+{
+    if (kDecodedTileStoreSlots == 0)
+    {
+        return std::nullopt;
+    }
+
+    auto slot = DecodedTileSlot(tile_id);
+
+    // Most tiles are only decoded once, so wait until a tile comes back before writing up to
+    // 128KiB for it. Colliding tiles then don't take turns overwriting the slot either.
+    if (std::exchange(m_decoded_tile_candidates[slot], tile_id) != tile_id)
+    {
+        return std::nullopt;
+    }
+
+    // Keep a tile which is still in use
+    auto owner = m_decoded_tile_owners[slot].load();
+    if (owner != 0 && owner != tile_id && m_tile_index.Find(owner))
+    {
+        return std::nullopt;
+    }
+
+    return m_decoded_tile_generations[slot].load();
+}
+
+bool
+TileCache::StoreDecodedTile(const Tile& t, uint32_t generation, const TileImage& image)
+{
+    auto tile_id = TileId(t);
+    auto slot = DecodedTileSlot(tile_id);
+    auto encoded = rgb565_rle::Encode(image.Data16());
+    auto header =
+        DecodedTileHeader {kDecodedTileMagic, tile_id, static_cast<uint32_t>(encoded.size())};
+
+    std::vector<std::byte> data(sizeof(header) + encoded.size() * sizeof(uint16_t));
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), encoded.data(), encoded.size() * sizeof(uint16_t));
+
+    auto lock = std::lock_guard(m_filesystem_mutex);
+    if (m_decoded_tile_generations[slot] != generation)
+    {
+        // The PNG was fetched again while this was decoded, so the pixels are stale
+        return false;
+    }
+
+    // Overwrites whatever tile was in the slot before
+    m_filesystem.WriteFile(GetDecodedTilePath(tile_id), data);
+    m_decoded_tile_owners[slot] = tile_id;
+
+    return true;
+}
+
+std::string
+TileCache::GetDecodedTilePath(uint32_t tile_id) const
+{
+    return std::format("decoded/{}.bin", DecodedTileSlot(tile_id));
+}
+
+void
+TileCache::LoadDecodedTileOwners()
+{
+    if (kDecodedTileStoreSlots == 0)
+    {
+        return;
+    }
+
+    auto data = m_filesystem.ReadFile(kDecodedTileOwnersFileName);
+    if (!data || data->size() != kDecodedTileStoreSlots * sizeof(uint32_t))
+    {
+        // All tiles are decoded from PNG again
+        return;
+    }
+
+    auto* owners = reinterpret_cast<const uint32_t*>(data->data());
+    for (auto i = 0u; i < kDecodedTileStoreSlots; i++)
+    {
+        m_decoded_tile_owners[i] = owners[i];
+    }
+}
+
+void
+TileCache::SaveDecodedTileOwners()
+{
+    std::vector<uint32_t> owners(m_decoded_tile_owners.begin(), m_decoded_tile_owners.end());
+
+    auto lock = std::lock_guard(m_filesystem_mutex);
+    m_filesystem.WriteFile(kDecodedTileOwnersFileName, std::as_bytes(std::span {owners}));
+    m_decoded_tiles_since_save = 0;
+}
+
+void
+TileCache::RefreshCityTiles(const Tile& center)
+{
+    auto factor = kDefaultZoom;
+
+    if (center.zoom == kCityZoom)
+    {
+        factor = kCityTileFactorZoomedOut;
+    }
+    else if (center.zoom == kLandscapeZoom)
+    {
+        factor = kLandscapeTileFactorZoomedOut;
+    }
+
+    for (int dx = -factor; dx <= factor; ++dx)
+    {
+        for (int dy = -factor; dy <= factor; ++dy)
+        {
+            Tile t {center.x + dx, center.y + dy, center.zoom};
+
+            m_get_from_server_background.push_back(t);
+        }
+    }
+}
+
+
+void
+TileCache::FillFromServer()
+{
+    if (!AppState().Get<AS::wifi_connected>())
+    {
+        return;
+    }
+
+    WebThread* web_thread;
+
+    while ((!m_get_from_server.empty() || !m_get_from_server_background.empty()) &&
+           (web_thread = SelectWebThread()) != nullptr)
+    {
+        Tile t;
+
+        if (!m_get_from_server.empty())
+        {
+            t = m_get_from_server.back();
+            m_get_from_server.pop_back();
+        }
+        else
+        {
+            // Second priority, get when the first are empty
+            t = m_get_from_server_background.back();
+            m_get_from_server_background.pop_back();
+        }
+
+        if (t.x < 0 || t.y < 0)
+        {
+            continue;
+        }
+
+        auto path = GetTilePath(t);
+        if (IsInTilePack(t) || m_filesystem.FileExists(path))
+        {
+            // Already got it, probably from being requested by the UI
+            continue;
+        }
+        web_thread->FetchTile(t);
+    }
+
+    auto region_tiles = 0;
+    while (!m_region_download.empty() && region_tiles < kMaxRegionTilesPerActivation &&
+           (web_thread = SelectWebThread()) != nullptr)
+    {
+        auto region_tile = m_region_download.front();
+        const auto& t = region_tile.tile;
+
+        m_region_download.pop_front();
+        region_tiles++;
+        if (IsInTilePack(t) || m_filesystem.FileExists(GetTilePath(t)))
+        {
+            continue;
+        }
+        // Done when the web thread has written it
+        m_region_download_in_flight.push_back(region_tile);
+        web_thread->FetchTile(t, FetchReason::kRegion);
+    }
+    if (region_tiles > 0)
+    {
+        m_region_tiles_since_save += region_tiles;
+        if (m_region_tiles_since_save >= kRegionSaveInterval || m_region_download.empty())
+        {
+            // After a reboot, at most the tiles since the last save are looked at again
+            SaveRegionDownload();
+        }
+        PublishRegionDownloadProgress();
+    }
+
+    while (!m_reload_tiles_from_server.empty() && (web_thread = SelectWebThread()) != nullptr)
+    {
+        auto t = m_reload_tiles_from_server.back();
+
+        // Invalid tile
+        if (t.x < 0 || t.y < 0)
+        {
+            m_reload_tiles_from_server.pop_back();
+            continue;
+        }
+
+        web_thread->FetchTile(t, FetchReason::kReload);
+        m_reload_tiles_from_server.pop_back();
+    }
+
+    // Last priority, these are already on disk
+    while (m_get_from_server.empty() && !m_revalidate_from_server.empty() &&
+           (web_thread = SelectWebThread()) != nullptr)
+    {
+        auto it = m_revalidate_from_server.begin();
+
+        web_thread->FetchTile(*it);
+        m_revalidate_from_server.erase(it);
+    }
+}
+
+bool
+TileCache::IsInTilePack(const Tile& t) const
+{
+    auto it = m_tile_packs.find(t.zoom);
+
+    return it != m_tile_packs.end() && it->second->Contains(TileId(t));
+}
+
+std::string
+TileCache::GetTilePath(const Tile& t) const
+{
+    return std::format("tiles/{}/{}/{}.png", t.zoom, t.x, t.y);
+}
+
+std::optional<TileCache::TileMeta>
+TileCache::ReadTileMeta(const Tile& t) const
+{
+    auto data = m_filesystem.ReadFile(std::format("tiles/{}/{}/{}.meta", t.zoom, t.x, t.y));
+    if (!data || data->size() != sizeof(TileMeta))
+    {
+        return std::nullopt;
+    }
+
+    TileMeta out;
+    memcpy(&out, data->data(), sizeof(out));
+    if (out.magic != kTileMetaMagic)
+    {
+        return std::nullopt;
+    }
+
+    return out;
+}
+
+void
+TileCache::WriteTileMeta(const Tile& t, const TileMeta& meta)
+{
+    m_filesystem.WriteFile(std::format("tiles/{}/{}/{}.meta", t.zoom, t.x, t.y),
+                           std::as_bytes(std::span {&meta, 1}));
+}
+
+void
+TileCache::InvalidateDecodedTile(const Tile& t)
+{
+    if (kDecodedTileStoreSlots == 0)
+    {
+        return;
+    }
+
+    auto tile_id = TileId(t);
+    auto slot = DecodedTileSlot(tile_id);
+
+    // Even if it's not stored yet, a decode of the old PNG might be
+    m_decoded_tile_generations[slot]++;
+    if (m_decoded_tile_owners[slot] != tile_id)
+    {
+        // Another tile, or nothing, in the slot
+        return;
+    }
+
+    // An empty file never matches
+    m_filesystem.WriteFile(GetDecodedTilePath(tile_id), {});
+    m_decoded_tile_owners[slot] = 0;
+}
+
+bool
+TileCache::IsPinned(uint16_t slot) const
+{
+    return m_pinned[slot].load() || m_decoding[slot];
+}
+
+std::optional<uint16_t>
+TileCache::EvictTile()
+{
+    auto is_pinned = [this](uint16_t slot) { return IsPinned(slot); };
+
+    while (auto victim = m_eviction_policy.SelectVictim(is_pinned))
+    {
+        // Invalidate first, and then check the pin again. GetTile does the opposite, so
+        // either the UI sees the invalidated slot, or we see the pin.
+        auto old_id = m_tiles[*victim].exchange(0);
+        if (is_pinned(*victim))
+        {
+            m_tiles[*victim] = old_id;
+            continue;
+        }
+
+        // Drop the old mapping before the image is overwritten
+        m_tile_index.Erase(old_id);
+        if (old_id != 0)
+        {
+            m_evictions++;
+        }
+
+        return victim;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<uint16_t>
+TileCache::PinTile(const Tile& t)
+{
+    auto id = TileId(t);
+
+    if (auto slot = m_tile_index.Find(id); slot)
+    {
+        // Pin before validating, the slot can be reused by the tile cache thread at any time
+        m_pinned[*slot] = true;
+
+        if (m_tiles[*slot] == id)
+        {
+            m_eviction_policy.Touch(*slot);
+
+            return slot;
+        }
+    }
+
+    return std::nullopt;
+}
+
+const Image&
+TileCache::GetTile(const Tile& at)
+{
+    m_requested_zoom = at.zoom;
+    if (auto slot = PinTile(at); slot)
+    {
+        m_hits++;
+
+        return m_image_cache[*slot];
+    }
+
+    m_misses++;
+    if (m_get_from_coldstore.push(at))
+    {
+        Awake();
+    }
+
+    return GetFallbackTile(at);
+}
+
+const Image&
+TileCache::GetFallbackTile(const Tile& at)
+{
+    if (m_used_fallback_tiles == m_fallback_tiles.size())
+    {
+        return m_black_tile;
+    }
+
+    // The nearest zoomed out level first
+    for (auto zoom : {kCityZoom, kLandscapeZoom})
+    {
+        if (zoom >= at.zoom)
+        {
+            continue;
+        }
+
+        auto shift = at.zoom - zoom;
+        auto slot = PinTile(Tile {at.x >> shift, at.y >> shift, static_cast<uint8_t>(zoom)});
+        if (!slot)
+        {
+            continue;
+        }
+
+        // The part of the ancestor covered by this tile
+        auto mask = (1 << shift) - 1;
+        auto src_size = kTileSize >> shift;
+        auto& out = m_fallback_tiles[m_used_fallback_tiles++];
+
+        Upsample(m_image_cache[*slot].Data16(),
+                 (at.x & mask) * src_size,
+                 (at.y & mask) * src_size,
+                 shift,
+                 out.WritableData16());
+
+        return out;
+    }
+
+    return m_black_tile;
+}
+
+void
+TileCache::BeginFrame()
+{
+    for (auto& pinned : m_pinned)
+    {
+        pinned = false;
+    }
+    m_used_fallback_tiles = 0;
+}
+
+TileCache::Statistics
+TileCache::GetStatistics() const
+{
+    return Statistics {
+        .hits = m_hits.load(),
+        .misses = m_misses.load(),
+        .evictions = m_evictions.load(),
+    };
+}
+
+
+// The PNG decoder threads
+TileCache::DecodeThread::DecodeThread(TileCache& parent)
+    : m_parent(parent)
+    , m_png(std::make_unique<PNG>())
+{
+}
+
+TileCache::DecodeThread::~DecodeThread() = default;
+
+void
+TileCache::DecodeThread::Decode(DecodeJob&& job)
+{
+    debug_assert(CanDecode());
+
+    m_in_queue.push(std::move(job));
+    m_jobs_in_flight++;
+    Awake();
+}
+
+std::optional<milliseconds>
+TileCache::DecodeThread::OnActivation()
+{
+    DecodeJobs();
+
+    return std::nullopt;
+}
+
+void
+TileCache::DecodeThread::DecodeJobs()
+{
+    DecodeJob job;
+
+    while (m_in_queue.pop(job))
+    {
+        auto& image = m_parent.m_image_cache[job.slot];
+        auto success = m_parent.DecodePng(*m_png, job.png_data, image);
+        auto stored = false;
+
+        if (success && job.store_generation)
+        {
+            // Skip the PNG decoding the next time
+            stored = m_parent.StoreDecodedTile(job.tile, *job.store_generation, image);
+        }
+        // Never full, since CanDecode() limits the jobs in flight to the size of the queue
+        [[maybe_unused]] auto pushed = m_out_queue.push(DecodeResult {
+            job.tile, job.slot, job.prefetched, success, stored, std::move(job.png_data)});
+        debug_assert(pushed);
+        m_parent.Awake();
+    }
+}
+
+
+// The tile fetcher thread
+TileCache::WebThread::WebThread(TileCache& parent, std::unique_ptr<HttpsClient> https_client)
+    : m_parent(parent)
+    , m_https_client(std::move(https_client))
+{
+}
+
+void
+TileCache::WebThread::FetchTile(const Tile& t, FetchReason reason)
+{
+    debug_assert(CanFetchTile());
+
+    m_in_queue.push(FetchJob {t, reason});
+    m_jobs_in_flight++;
+    Awake();
 }
 
 std::string
@@ -531,24 +1448,55 @@ TileCache::WebThread::GetOsmApiKey() const
 std::optional<milliseconds>
 TileCache::WebThread::OnActivation()
 {
-    Tile t;
+    FetchJobs();
+
+    return std::nullopt;
+}
+
+void
+TileCache::WebThread::FetchJobs()
+{
+    FetchJob job;
 
-    while (m_in_queue.pop(t))
+    while (m_in_queue.pop(job))
     {
+        const auto& t = job.tile;
         auto url = GetTileUrl(t);
         auto path = m_parent.GetTilePath(t);
 
         printf("TileCache: Need tile %d/%d. Getting from WEBBEN\n", t.x, t.y);
-        auto data = m_parent.m_https_client.Get(url);
+        auto data = m_https_client->Get(url);
 
         if (data)
         {
+            auto png_data =
+                std::span {reinterpret_cast<const std::byte*>(data->data()), data->size()};
+            auto meta =
+                TileMeta {kTileMetaMagic, ContentHash(png_data), SecondsSinceEpoch().value_or(0)};
+
             // Better would be to save to a temporary name and then rename, but that doesn't work in esp-idf
             auto lock = std::lock_guard(m_parent.m_filesystem_mutex);
 
-            m_parent.m_filesystem.WriteFile(path, {data->data(), data->size()});
+            auto old_meta = m_parent.ReadTileMeta(t);
+            auto changed = !old_meta || old_meta->content_hash != meta.content_hash;
+
+            // A refetched tile is often unchanged, so skip rewriting it to the SD card then
+            if (changed || job.reason == FetchReason::kReload)
+            {
+                m_parent.m_filesystem.WriteFile(path, {data->data(), data->size()});
+                m_parent.InvalidateDecodedTile(t);
+            }
+            // Same for the metadata, which only needs a new age when the old one is a day old
+            if (changed || meta.fetched_at - old_meta->fetched_at >= kTileMetaRefreshSeconds)
+            {
+                m_parent.WriteTileMeta(t, meta);
+            }
         }
-    }
 
-    return std::nullopt;
+        // Never full, since CanFetchTile() limits the jobs in flight to the size of the queue
+        [[maybe_unused]] auto pushed =
+            m_out_queue.push(FetchResult {t, job.reason, data.has_value()});
+        debug_assert(pushed);
+        m_parent.Awake();
+    }
 }
@@ -0,0 +1,61 @@
+#include "tile_prefetch.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+namespace
+{
+
+// How far ahead to look, at the current speed
+constexpr auto kPrefetchHorizonSeconds = 30.0f;
+// Roughly the distance from the position to the edge of the screen
+constexpr auto kPrefetchMarginPixels = 512.0f;
+// Below this, the heading from the GPS is mostly noise
+constexpr auto kMinimumSpeed = 5.0f;
+
+} // namespace
+
+etl::vector<Tile, kMaxPrefetchTiles>
+PredictTiles(const Point& position, float heading, float speed, float meters_per_pixel)
+{
+    etl::vector<Tile, kMaxPrefetchTiles> out;
+
+    if (speed < kMinimumSpeed || meters_per_pixel <= 0)
+    {
+        return out;
+    }
+
+    auto distance =
+        kPrefetchMarginPixels + speed / 3.6f * kPrefetchHorizonSeconds / meters_per_pixel;
+    auto radians = heading * std::numbers::pi_v<float> / 180.0f;
+
+    // OSM y grows southwards
+    auto dx = std::sin(radians);
+    auto dy = -std::cos(radians);
+
+    // Step half a tile at a time, to not miss tiles when moving diagonally
+    for (auto d = 0.0f; d <= distance && !out.full(); d += kTileSize / 2)
+    {
+        // The path, and then one tile to each side of it
+        for (auto side : {0, -1, 1})
+        {
+            auto x = position.x + dx * d - dy * side * kTileSize;
+            auto y = position.y + dy * d + dx * side * kTileSize;
+
+            if (x < 0 || y < 0)
+            {
+                continue;
+            }
+
+            auto tile = ToTile(
+                Point {static_cast<int32_t>(x), static_cast<int32_t>(y), position.zoom});
+            if (!out.full() && std::ranges::find(out, tile) == out.end())
+            {
+                out.push_back(tile);
+            }
+        }
+    }
+
+    return out;
+}
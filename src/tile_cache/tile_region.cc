@@ -0,0 +1,83 @@
+#include "tile_region.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+namespace
+{
+
+Point
+ToZoom(const Point& point, uint8_t zoom)
+{
+    return point.zoom == zoom ? point : OsmPointToPoint(point, zoom);
+}
+
+} // namespace
+
+std::vector<Tile>
+TilesInBox(const Point& corner_a, const Point& corner_b, uint8_t zoom)
+{
+    auto a = ToTile(ToZoom(corner_a, zoom));
+    auto b = ToTile(ToZoom(corner_b, zoom));
+    std::vector<Tile> out;
+
+    out.reserve((std::abs(b.x - a.x) + 1) * (std::abs(b.y - a.y) + 1));
+    for (auto y = std::max(0, std::min(a.y, b.y)); y <= std::max(a.y, b.y); y++)
+    {
+        for (auto x = std::max(0, std::min(a.x, b.x)); x <= std::max(a.x, b.x); x++)
+        {
+            out.push_back(Tile {x, y, zoom});
+        }
+    }
+
+    return out;
+}
+
+std::vector<Tile>
+TilesAlongRoute(std::span<const Point> route, uint8_t zoom, int32_t margin_tiles)
+{
+    std::vector<Tile> out;
+    std::unordered_set<Tile> seen;
+
+    auto add_around = [&](const Tile& center) {
+        for (auto dy = -margin_tiles; dy <= margin_tiles; dy++)
+        {
+            for (auto dx = -margin_tiles; dx <= margin_tiles; dx++)
+            {
+                auto t = Tile {center.x + dx, center.y + dy, zoom};
+
+                if (t.x >= 0 && t.y >= 0 && seen.insert(t).second)
+                {
+                    out.push_back(t);
+                }
+            }
+        }
+    };
+
+    for (auto i = 0u; i < route.size(); i++)
+    {
+        auto from = ToZoom(route[i], zoom);
+        auto to = i + 1 < route.size() ? ToZoom(route[i + 1], zoom) : from;
+
+        // Step at most half a tile, to not skip tiles on diagonal segments
+        auto dx = static_cast<int64_t>(to.x) - from.x;
+        auto dy = static_cast<int64_t>(to.y) - from.y;
+        auto length = std::hypot(static_cast<float>(dx), static_cast<float>(dy));
+        auto steps = std::max<int64_t>(1, std::ceil(length / (kTileSize / 2)));
+
+        for (auto step = 0; step < steps; step++)
+        {
+            auto x = static_cast<int32_t>(from.x + dx * step / steps);
+            auto y = static_cast<int32_t>(from.y + dy * step / steps);
+
+            add_around(ToTile(Point {x, y, zoom}));
+        }
+    }
+    if (!route.empty())
+    {
+        add_around(ToTile(ToZoom(route.back(), zoom)));
+    }
+
+    return out;
+}
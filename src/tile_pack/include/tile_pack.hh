@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A single-file archive of tiles, keyed by TileId
+ *
+ * Layout: a file header, the tile data back to back, then an index sorted by tile id and
+ * finally a footer which points to the index. New tiles are appended after the old footer,
+ * followed by a new index and footer, so nothing already written is overwritten. The old
+ * index and footer remain as garbage.
+ *
+ * Fields are in host byte order, which is little-endian on all supported targets.
+ */
+class TilePack
+{
+public:
+    struct Entry
+    {
+        uint32_t tile_id;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct Footer
+    {
+        uint32_t index_offset;
+        uint32_t count;
+        uint32_t magic;
+    };
+
+    // Bump when the format changes
+    static constexpr uint32_t kMagic = 0x50544252; // "RBTP"
+
+    ~TilePack();
+
+    TilePack(const TilePack&) = delete;
+    TilePack& operator=(const TilePack&) = delete;
+
+    // Returns nullptr if the file doesn't exist or is not a valid pack
+    static std::unique_ptr<TilePack> Open(const std::string& path);
+
+    bool Contains(uint32_t tile_id) const;
+
+    // Context: One thread at a time
+    std::optional<std::vector<std::byte>> Read(uint32_t tile_id);
+
+    // Read into out, which only allocates if the tile is larger than its capacity
+    bool ReadInto(uint32_t tile_id, std::vector<std::byte>& out);
+
+    size_t Size() const
+    {
+        return m_index.size();
+    }
+
+private:
+    TilePack(FILE* fp, std::vector<Entry> index);
+
+    const Entry* Find(uint32_t tile_id) const;
+
+    FILE* m_fp;
+    std::vector<Entry> m_index;
+};
+
+/**
+ * @brief Creates or appends to a tile pack (used by the offline packer)
+ *
+ * Tiles which are already in the pack are replaced, leaving the old data as garbage.
+ */
+class TilePackWriter
+{
+public:
+    ~TilePackWriter();
+
+    TilePackWriter(const TilePackWriter&) = delete;
+    TilePackWriter& operator=(const TilePackWriter&) = delete;
+
+    static std::unique_ptr<TilePackWriter> Open(const std::string& path);
+
+    bool Add(uint32_t tile_id, std::span<const std::byte> data);
+
+    // Write the index and footer after the added tiles. Nothing added is visible to readers
+    // before this.
+    bool Commit();
+
+private:
+    TilePackWriter(FILE* fp, std::vector<TilePack::Entry> index, uint32_t data_end);
+
+    FILE* m_fp;
+    std::vector<TilePack::Entry> m_index;
+    uint32_t m_data_end;
+};
@@ -0,0 +1,239 @@
+#include "tile_pack.hh"
+
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+
+constexpr uint32_t kHeaderSize = sizeof(uint32_t);
+
+// Packs are created on the host, and read on the target
+static_assert(std::endian::native == std::endian::little);
+
+std::optional<std::vector<TilePack::Entry>>
+ReadIndex(FILE* fp)
+{
+    TilePack::Footer footer;
+
+    if (fseek(fp, 0, SEEK_END) != 0)
+    {
+        return std::nullopt;
+    }
+    auto size = ftell(fp);
+    if (size < static_cast<long>(kHeaderSize + sizeof(footer)))
+    {
+        return std::nullopt;
+    }
+
+    if (fseek(fp, size - sizeof(footer), SEEK_SET) != 0 ||
+        fread(&footer, sizeof(footer), 1, fp) != 1)
+    {
+        return std::nullopt;
+    }
+
+    auto index_size = static_cast<uint64_t>(footer.count) * sizeof(TilePack::Entry);
+    if (footer.magic != TilePack::kMagic || footer.index_offset < kHeaderSize ||
+        footer.index_offset + index_size + sizeof(footer) != static_cast<uint64_t>(size))
+    {
+        return std::nullopt;
+    }
+
+    std::vector<TilePack::Entry> index(footer.count);
+    if (fseek(fp, footer.index_offset, SEEK_SET) != 0 ||
+        fread(index.data(), sizeof(TilePack::Entry), index.size(), fp) != index.size())
+    {
+        return std::nullopt;
+    }
+
+    auto valid = std::ranges::all_of(index, [&footer](const auto& entry) {
+        return static_cast<uint64_t>(entry.offset) + entry.length <= footer.index_offset;
+    });
+    if (!valid || !std::ranges::is_sorted(index, {}, &TilePack::Entry::tile_id))
+    {
+        return std::nullopt;
+    }
+
+    return index;
+}
+
+} // namespace
+
+TilePack::TilePack(FILE* fp, std::vector<Entry> index)
+    : m_fp(fp)
+    , m_index(std::move(index))
+{
+}
+
+TilePack::~TilePack()
+{
+    fclose(m_fp);
+}
+
+std::unique_ptr<TilePack>
+TilePack::Open(const std::string& path)
+{
+    auto fp = fopen(path.c_str(), "rb");
+    if (!fp)
+    {
+        return nullptr;
+    }
+
+    auto index = ReadIndex(fp);
+    if (!index)
+    {
+        printf("TilePack: Invalid pack %s\n", path.c_str());
+        fclose(fp);
+        return nullptr;
+    }
+
+    return std::unique_ptr<TilePack>(new TilePack(fp, std::move(*index)));
+}
+
+bool
+TilePack::Contains(uint32_t tile_id) const
+{
+    return Find(tile_id) != nullptr;
+}
+
+std::optional<std::vector<std::byte>>
+TilePack::Read(uint32_t tile_id)
+{
+    std::vector<std::byte> out;
+
+    if (!ReadInto(tile_id, out))
+    {
+        return std::nullopt;
+    }
+
+    return out;
+}
+
+bool
+TilePack::ReadInto(uint32_t tile_id, std::vector<std::byte>& out)
+{
+    auto entry = Find(tile_id);
+    if (!entry)
+    {
+        return false;
+    }
+
+    out.resize(entry->length);
+    if (fseek(m_fp, entry->offset, SEEK_SET) != 0 ||
+        fread(out.data(), 1, out.size(), m_fp) != out.size())
+    {
+        return false;
+    }
+
+    return true;
+}
+
+const TilePack::Entry*
+TilePack::Find(uint32_t tile_id) const
+{
+    auto it = std::ranges::lower_bound(m_index, tile_id, {}, &Entry::tile_id);
+    if (it == m_index.end() || it->tile_id != tile_id)
+    {
+        return nullptr;
+    }
+
+    return &*it;
+}
+
+
+TilePackWriter::TilePackWriter(FILE* fp, std::vector<TilePack::Entry> index, uint32_t data_end)
+    : m_fp(fp)
+    , m_index(std::move(index))
+    , m_data_end(data_end)
+{
+}
+
+TilePackWriter::~TilePackWriter()
+{
+    fclose(m_fp);
+}
+
+std::unique_ptr<TilePackWriter>
+TilePackWriter::Open(const std::string& path)
+{
+    if (auto fp = fopen(path.c_str(), "r+b"); fp)
+    {
+        auto index = ReadIndex(fp);
+        if (!index)
+        {
+            fclose(fp);
+            return nullptr;
+        }
+
+        // New data goes after the old footer, to not overwrite anything. ReadIndex has
+        // checked the size.
+        fseek(fp, 0, SEEK_END);
+        auto size = static_cast<uint32_t>(ftell(fp));
+
+        return std::unique_ptr<TilePackWriter>(new TilePackWriter(fp, std::move(*index), size));
+    }
+
+    auto fp = fopen(path.c_str(), "w+b");
+    if (!fp)
+    {
+        return nullptr;
+    }
+    auto magic = TilePack::kMagic;
+    if (fwrite(&magic, sizeof(magic), 1, fp) != 1)
+    {
+        fclose(fp);
+        return nullptr;
+    }
+
+    return std::unique_ptr<TilePackWriter>(new TilePackWriter(fp, {}, kHeaderSize));
+}
+
+bool
+TilePackWriter::Add(uint32_t tile_id, std::span<const std::byte> data)
+{
+    if (static_cast<uint64_t>(m_data_end) + data.size() > UINT32_MAX / 2)
+    {
+        // Leave room for the index
+        return false;
+    }
+
+    if (fseek(m_fp, m_data_end, SEEK_SET) != 0 ||
+        fwrite(data.data(), 1, data.size(), m_fp) != data.size())
+    {
+        return false;
+    }
+
+    auto entry = TilePack::Entry {tile_id, m_data_end, static_cast<uint32_t>(data.size())};
+    m_data_end += data.size();
+
+    auto it = std::ranges::lower_bound(m_index, tile_id, {}, &TilePack::Entry::tile_id);
+    if (it != m_index.end() && it->tile_id == tile_id)
+    {
+        *it = entry;
+    }
+    else
+    {
+        m_index.insert(it, entry);
+    }
+
+    return true;
+}
+
+bool
+TilePackWriter::Commit()
+{
+    auto footer =
+        TilePack::Footer {m_data_end, static_cast<uint32_t>(m_index.size()), TilePack::kMagic};
+
+    if (fseek(m_fp, m_data_end, SEEK_SET) != 0 ||
+        fwrite(m_index.data(), sizeof(TilePack::Entry), m_index.size(), m_fp) != m_index.size() ||
+        fwrite(&footer, sizeof(footer), 1, m_fp) != 1 || fflush(m_fp) != 0)
+    {
+        return false;
+    }
+
+    // Tiles added after this are appended after the footer, as when opened again
+    m_data_end += m_index.size() * sizeof(TilePack::Entry) + sizeof(footer);
+
+    return true;
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "debug_assert.hh"
+
+#include <array>
+#include <cstddef>
+#include <limits>
+
+/**
+ * @brief A binary min-heap of handles, where the key of any handle in it can be changed
+ *
+ * Handles are small integers in [0, Handles), and the heap keeps the position of each one,
+ * so that updating or erasing a handle is O(log n). Equal keys are ordered by handle, so
+ * the order is strict and deterministic.
+ */
+template <typename Handle, typename Key, size_t Capacity, size_t Handles>
+class IndexedMinHeap
+{
+public:
+    static_assert(Capacity < std::numeric_limits<Handle>::max() &&
+                      Handles <= std::numeric_limits<Handle>::max(),
+                  "Handle type too small for the heap");
+
+    IndexedMinHeap()
+    {
+        m_position.fill(kNotInHeap);
+    }
+
+    bool Empty() const
+    {
+        return m_size == 0;
+    }
+
+    bool Full() const
+    {
+        return m_size == Capacity;
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    bool Contains(Handle handle) const
+    {
+        return m_position[handle] != kNotInHeap;
+    }
+
+    Handle Top() const
+    {
+        debug_assert(!Empty());
+
+        return m_nodes[0].handle;
+    }
+
+    Key TopKey() const
+    {
+        debug_assert(!Empty());
+
+        return m_nodes[0].key;
+    }
+
+    void Push(Handle handle, Key key)
+    {
+        debug_assert(!Full() && !Contains(handle));
+
+        auto index = static_cast<Handle>(m_size++);
+        Place(index, Node {key, handle});
+        SiftUp(index);
+    }
+
+    void Pop()
+    {
+        Erase(Top());
+    }
+
+    void Erase(Handle handle)
+    {
+        debug_assert(Contains(handle));
+
+        auto index = m_position[handle];
+        auto last = static_cast<Handle>(--m_size);
+
+        m_position[handle] = kNotInHeap;
+        if (index != last)
+        {
+            Place(index, m_nodes[last]);
+            Fix(index);
+        }
+    }
+
+    // Both increasing and decreasing the key is fine
+    void Update(Handle handle, Key key)
+    {
+        debug_assert(Contains(handle));
+
+        auto index = m_position[handle];
+
+        m_nodes[index].key = key;
+        Fix(index);
+    }
+
+    void Clear()
+    {
+        for (auto i = 0u; i < m_size; i++)
+        {
+            m_position[m_nodes[i].handle] = kNotInHeap;
+        }
+        m_size = 0;
+    }
+
+private:
+    static constexpr Handle kNotInHeap = std::numeric_limits<Handle>::max();
+
+    struct Node
+    {
+        Key key;
+        Handle handle;
+
+        bool operator<(const Node& other) const
+        {
+            return key < other.key || (key == other.key && handle < other.handle);
+        }
+    };
+
+    void Place(Handle index, const Node& node)
+    {
+        m_nodes[index] = node;
+        m_position[node.handle] = index;
+    }
+
+    void Fix(Handle index)
+    {
+        if (index > 0 && m_nodes[index] < m_nodes[(index - 1) / 2])
+        {
+            SiftUp(index);
+        }
+        else
+        {
+            SiftDown(index);
+        }
+    }
+
+    void SiftUp(Handle index)
+    {
+        auto node = m_nodes[index];
+
+        while (index > 0)
+        {
+            auto parent = static_cast<Handle>((index - 1) / 2);
+            if (!(node < m_nodes[parent]))
+            {
+                break;
+            }
+
+            Place(index, m_nodes[parent]);
+            index = parent;
+        }
+        Place(index, node);
+    }
+
+    void SiftDown(Handle index)
+    {
+        auto node = m_nodes[index];
+
+        while (true)
+        {
+            auto child = 2 * static_cast<size_t>(index) + 1;
+            if (child >= m_size)
+            {
+                break;
+            }
+            if (child + 1 < m_size && m_nodes[child + 1] < m_nodes[child])
+            {
+                child++;
+            }
+            if (!(m_nodes[child] < node))
+            {
+                break;
+            }
+
+            Place(index, m_nodes[child]);
+            index = static_cast<Handle>(child);
+        }
+        Place(index, node);
+    }
+
+    std::array<Node, Capacity> m_nodes;
+    std::array<Handle, Handles> m_position;
+    size_t m_size {0};
+};
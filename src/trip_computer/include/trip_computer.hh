@@ -2,14 +2,18 @@
 
 #include "application_state.hh"
 #include "base_thread.hh"
+#include "indexed_min_heap.hh"
 #include "os/memory.hh"
+#include "trip_log_store.hh"
+#include "triple_buffer.hh"
 #include "wgs84_to_osm_point.hh"
 
+#include <array>
 #include <etl/circular_buffer.h>
-#include <etl/priority_queue.h>
 #include <etl/vector.h>
-#include <mutex>
+#include <functional>
 #include <optional>
+#include <span>
 #include <utility>
 
 class TripComputer : public os::BaseThread
@@ -22,6 +26,8 @@ public:
     struct TripLogEntry
     {
         Point position;
+        // Of entries in the display log, to find them in the published copies
+        uint32_t display_sequence;
         milliseconds timestamp;
         PowerType power;
         LogHandle predecessor;
@@ -41,19 +47,49 @@ public:
         float average_consumption;
     };
 
+    struct DisplayLog
+    {
+        // Oldest first
+        std::span<const DisplayTripLogEntry> entries;
+        uint32_t revision;
+    };
+
 
     // x MB of trip log entries
     static constexpr auto kNumberOfTripLogEntries = (128 * 1024) / sizeof(TripLogEntry);
-    static constexpr auto kNumberOfDisplayLogEntries = 64;
+    // One display log per map zoom, each simplified to what's visible at it
+    static constexpr auto kDisplayLogZooms = std::array {kDefaultZoom, kCityZoom, kLandscapeZoom};
+    static constexpr auto kNumberOfDisplayLogEntries = 128;
+    // The first entry is never removed, and the last one is pending
+    static constexpr auto kMaxDisplayLogEntries = kNumberOfDisplayLogEntries + 1;
+    // A log also holds the pending entry, and the new one before making room for it
     static constexpr auto kNumberOfExportLogEntries =
-        kNumberOfTripLogEntries - kNumberOfDisplayLogEntries - 2;
+        kNumberOfTripLogEntries - kDisplayLogZooms.size() * (kNumberOfDisplayLogEntries + 2) - 2;
 
     static constexpr auto kNumberOfRecentEntries = 10;
 
-    explicit TripComputer(ApplicationState& app_state);
+    using RecentEntries = etl::vector<RecentEntry, kNumberOfRecentEntries>;
 
-    std::pair<std::unique_lock<etl::mutex>, std::span<const DisplayTripLogEntry>> GetDisplayLog();
-    std::span<const RecentEntry> GetRecentEntries();
+    // Without a store, the full trip log is only kept in RAM
+    explicit TripComputer(ApplicationState& app_state,
+                          std::unique_ptr<TripLogStore> trip_log_store = nullptr);
+
+    /**
+     * @brief Get the display log with the detail needed at a map zoom
+     *
+     * Context: UI thread. The entries are valid, and unchanged, until the next call for the
+     * same zoom.
+     */
+    DisplayLog GetDisplayLog(uint8_t zoom);
+
+    // Changes whenever the display log for the zoom does, so that users can skip redrawing it
+    uint32_t GetDisplayLogRevision(uint8_t zoom) const
+    {
+        return m_display_logs[DisplayLogIndex(zoom)].published.LatestRevision();
+    }
+
+    // Context: UI thread
+    RecentEntries GetRecentEntries();
 
     const TripLogEntry& Entry(LogHandle handle) const
     {
@@ -65,61 +101,106 @@ private:
     class Log
     {
     public:
-        Log(TripComputer& parent)
+        /**
+         * @brief Create a log
+         *
+         * @param min_distance Closer positions than this are skipped (at kDefaultZoom)
+         * @param min_area Entries with smaller (doubled) triangles are dropped even if there
+         *        is room for them
+         * @param on_remove Called when the simplification drops an entry, before it's freed
+         */
+        Log(TripComputer& parent,
+            int32_t min_distance,
+            uint32_t min_area = 0,
+            std::function<void(const TripLogEntry&)> on_remove = {})
             : m_parent(parent)
+            , m_min_distance(min_distance)
+            , m_min_area(min_area)
+            , m_on_remove(std::move(on_remove))
         {
         }
 
-        struct LogQueueEntry
-        {
-            uint32_t triangle_area;
-            LogHandle handle;
-
-            int operator<(const LogQueueEntry& other) const
-            {
-                if (triangle_area == other.triangle_area)
-                {
-                    return rand() %
-                           2; // Randomize order of entries with the same area to avoid bias
-                }
-                // We want the entry with the smallest triangle area to be popped first, so we invert the comparison here
-                return triangle_area > other.triangle_area;
-            }
-        };
-
         std::optional<LogHandle>
         AddEntry(const Point& position, milliseconds timestamp, int16_t power);
 
         std::optional<LogHandle> GetLastHandle() const
         {
-            if (m_pending_log_entry)
-            {
-                return m_pending_log_entry->handle;
-            }
-
-            return std::nullopt;
+            return m_pending_log_entry;
         }
 
         void Reset()
         {
-            while (!m_log_queue.empty())
+            while (!m_log_queue.Empty())
             {
-                auto& entry = m_log_queue.top();
-                m_parent.FreeLogEntry(entry.handle);
-                m_log_queue.pop();
+                m_parent.FreeLogEntry(m_log_queue.Top());
+                m_log_queue.Pop();
             }
 
-            m_log_queue = {};
+            if (m_pending_log_entry)
+            {
+                m_parent.FreeLogEntry(*m_pending_log_entry);
+            }
             m_pending_log_entry.reset();
         }
 
     private:
         uint32_t TriangleArea(const TripLogEntry& entry) const;
+        void UpdateTriangleArea(LogHandle handle);
+        void Remove(LogHandle handle);
 
         TripComputer& m_parent;
+        const int32_t m_min_distance;
+        const uint32_t m_min_area;
+        std::function<void(const TripLogEntry&)> m_on_remove;
+
+        // Visvalingam-Whyatt: the entry with the smallest triangle is removed first
+        IndexedMinHeap<LogHandle, uint32_t, Entries, kNumberOfTripLogEntries> m_log_queue;
+        // The last entry, which gets its triangle when the next one arrives
+        std::optional<LogHandle> m_pending_log_entry;
+    };
+
+    // At kDefaultZoom, and scaled for the display logs of the other zooms
+    static constexpr auto kLogMinDistance = 5;
+    // Twice the area of a triangle that is too small to see, in pixels at the zoom
+    static constexpr auto kDisplayLogMinArea = 8;
+
+    struct PublishedDisplayLog
+    {
+        etl::vector<DisplayTripLogEntry, kMaxDisplayLogEntries> entries;
+        // The display_sequence of each entry, in increasing order
+        etl::vector<uint32_t, kMaxDisplayLogEntries> sequences;
+    };
 
-        etl::priority_queue<LogQueueEntry, Entries> m_log_queue;
-        std::optional<LogQueueEntry> m_pending_log_entry;
+    // What one accepted point changes in the display log
+    struct DisplayLogEdit
+    {
+        uint32_t revision;
+        std::optional<uint32_t> removed_sequence;
+        DisplayTripLogEntry added;
+        uint32_t added_sequence;
+    };
+
+    static constexpr auto kDisplayLogJournalSize = 8;
+
+    // One level of the display log pyramid
+    struct DisplayLogLevel
+    {
+        DisplayLogLevel(TripComputer& parent, uint8_t zoom);
+
+        Log<kNumberOfDisplayLogEntries> log;
+
+        // Kept up to date here, and the published copies are patched with the edits they have
+        // missed, or copied when they are too far behind
+        PublishedDisplayLog master;
+        etl::circular_buffer<DisplayLogEdit, kDisplayLogJournalSize> journal;
+        // Edits from this revision on are all in the journal
+        uint32_t journal_start {1};
+        uint32_t next_sequence {0};
+        // Set by the log if it drops an entry
+        std::optional<uint32_t> removed_sequence;
+
+        // Handed over to the UI without locking
+        TripleBuffer<PublishedDisplayLog> published;
     };
 
     struct RecentHistogramEntry
@@ -141,6 +222,16 @@ private:
     void UpdateRange();
     void UpdateRecentEntries(uint32_t odometer);
     void ResetTrip();
+    void PublishRecentEntries();
+    void AddDisplayLogEntry(DisplayLogLevel& level,
+                            const Point& position,
+                            milliseconds timestamp,
+                            int16_t power);
+    void PublishDisplayLog(DisplayLogLevel& level, std::optional<DisplayLogEdit> edit);
+
+    // The coarsest display log with enough detail for the zoom
+    static size_t DisplayLogIndex(uint8_t zoom);
+    static void ApplyDisplayLogEdit(PublishedDisplayLog& log, const DisplayLogEdit& edit);
 
     DistanceType RecentDistance(DistanceType distance) const;
 
@@ -168,20 +259,23 @@ private:
 
     etl::circular_buffer<uint16_t, 10> m_millivolt_history;
 
+    std::unique_ptr<TripLogStore> m_trip_log_store;
     std::unique_ptr<std::array<TripLogEntry, kNumberOfTripLogEntries>> m_trip_log_storage;
     std::vector<LogHandle> m_free_log_entries;
 
-    Log<kNumberOfDisplayLogEntries> m_display_log {*this};
-    Log<kNumberOfExportLogEntries> m_export_log {*this};
+    Log<kNumberOfExportLogEntries> m_export_log {*this, kLogMinDistance};
+    // In the order of kDisplayLogZooms
+    std::array<DisplayLogLevel, kDisplayLogZooms.size()> m_display_logs {
+        DisplayLogLevel {*this, kDisplayLogZooms[0]},
+        DisplayLogLevel {*this, kDisplayLogZooms[1]},
+        DisplayLogLevel {*this, kDisplayLogZooms[2]},
+    };
 
-    std::array<std::vector<DisplayTripLogEntry>, 2> m_display_logs;
-    std::atomic<uint8_t> m_current_display_log {0};
+    // Handed over to the UI without locking
+    TripleBuffer<RecentEntries> m_published_recent_entries;
 
 
     etl::circular_buffer<RecentEntry, kNumberOfRecentEntries> m_recent_entries {};
-    etl::vector<RecentEntry, kNumberOfRecentEntries> m_display_recent_entries;
 
     RecentHistogramEntry m_current_histogram_entry {};
-
-    etl::mutex m_log_mutex;
 };
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "time.hh"
+#include "wgs84_to_osm_point.hh"
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The full trip log, streamed to the filesystem in compact blocks
+ *
+ * Each record is stored as the difference to the one before it, as zigzag varints
+ * (x, y, milliseconds and watts), which is usually 4-6 bytes. Records are collected into
+ * blocks of at most kBlockSize bytes. Each block starts from zero, so it can be decoded
+ * on its own, and is checksummed.
+ *
+ * The filesystem only supports whole-file writes, so every block is a file of its own,
+ * which is written once when it's full. Until then, the block is kept in RAM, and every
+ * kFlushInterval records the ones since the last time are written as a small tail chunk.
+ * After a power loss, Load() rebuilds the open block from its chunks and writes it, so at
+ * most kFlushInterval records are lost, also if the block write itself was torn.
+ *
+ * Blocks are numbered in the order they are written, and each one belongs to a trip. The
+ * filesystem can't remove files, so the blocks are stored in a ring of max_blocks
+ * positions, and the oldest block is overwritten when the ring is full. That bounds the
+ * log to max_blocks * kBlockSize bytes plus the chunks of one block, and an old trip can
+ * lose its first blocks before it's gone entirely.
+ */
+class TripLogStore
+{
+public:
+    using ReadFunction =
+        std::function<std::optional<std::vector<std::byte>>(const std::string& path)>;
+    using WriteFunction =
+        std::function<void(const std::string& path, std::span<const std::byte> data)>;
+
+    struct Record
+    {
+        // At kDefaultZoom
+        Point position;
+        milliseconds timestamp;
+        int16_t power;
+    };
+
+    static constexpr size_t kBlockSize = 4096;
+    // Records per tail chunk
+    static constexpr auto kFlushInterval = 16;
+    // 4MiB, which is days of riding
+    static constexpr uint32_t kDefaultMaxBlocks = 1024;
+
+    TripLogStore(std::string directory,
+                 ReadFunction read,
+                 WriteFunction write,
+                 uint32_t max_blocks = kDefaultMaxBlocks);
+
+    // Find where the log ended, also after a power loss. Context: Startup
+    void Load();
+
+    // Records added after this belong to a new trip
+    void StartTrip();
+
+    void Add(const Record& record);
+
+    // Write the records since the last tail chunk, which is done every kFlushInterval
+    // records anyway
+    void Flush();
+
+    uint32_t CurrentTrip() const
+    {
+        return m_trip;
+    }
+
+    /**
+     * @brief Read back the records of a trip, one block at a time
+     *
+     * @return false if there are none
+     */
+    bool ForEachRecord(uint32_t trip, const std::function<void(const Record&)>& on_record) const;
+
+private:
+    struct Block
+    {
+        uint32_t sequence;
+        uint32_t trip;
+        uint16_t count;
+        std::vector<std::byte> payload;
+    };
+
+    // Write the open block, and start the next one
+    void CloseBlock();
+    // Rebuild the open block from the tail chunks, after a power loss
+    bool RecoverTail();
+
+    // The block, unless it has been overwritten
+    std::optional<Block> ReadBlock(uint32_t sequence) const;
+    // Whatever block is stored at a position in the ring
+    std::optional<Block> ReadBlockAt(uint32_t position) const;
+    // A valid tail chunk, of any block
+    std::optional<Block> ReadTailChunk(uint32_t index) const;
+    bool BlockExists(uint32_t position) const;
+    std::string BlockPath(uint32_t position) const;
+    std::string TailChunkPath(uint32_t index) const;
+    // The first block which can still be there
+    uint32_t OldestSequence() const;
+
+    const std::string m_directory;
+    ReadFunction m_read;
+    WriteFunction m_write;
+    const uint32_t m_max_blocks;
+
+    uint32_t m_trip {0};
+    // The block being filled
+    uint32_t m_sequence {0};
+    uint16_t m_count {0};
+    std::vector<std::byte> m_payload;
+    Record m_last {};
+    // Tail chunks written for the block, and how much of it they cover
+    uint32_t m_tail_chunks {0};
+    uint16_t m_tail_count {0};
+    size_t m_tail_size {0};
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Lock-free hand-off of the latest version of a value from one thread to another
+ *
+ * The writer fills the back buffer and publishes it, which swaps it with the middle one.
+ * The reader swaps its front buffer with the middle one when a newer version is there.
+ * Neither side ever waits, and the reader keeps its snapshot untouched until it reads
+ * again. Versions in between two reads are skipped.
+ *
+ * There can only be one writer thread and one reader thread.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    struct Snapshot
+    {
+        const T& value;
+        // Of the publication, starting at 1. 0 means that nothing has been published yet
+        uint32_t revision;
+    };
+
+    // Context: Writer
+    T& WriteBuffer()
+    {
+        return m_buffers[m_back];
+    }
+
+    // Context: Writer. The revision that the write buffer was last published with
+    uint32_t WriteBufferRevision() const
+    {
+        return m_revisions[m_back];
+    }
+
+    // Context: Writer
+    void Publish()
+    {
+        m_revisions[m_back] = ++m_revision;
+
+        auto old = m_middle.exchange(m_back | kFresh, std::memory_order_acq_rel);
+        m_back = old & kIndexMask;
+        m_latest_revision.store(m_revision, std::memory_order_relaxed);
+    }
+
+    // Context: Reader. The snapshot is valid until the next Read()
+    Snapshot Read()
+    {
+        if (m_middle.load(std::memory_order_relaxed) & kFresh)
+        {
+            auto old = m_middle.exchange(m_front, std::memory_order_acq_rel);
+            m_front = old & kIndexMask;
+        }
+
+        return Snapshot {m_buffers[m_front], m_revisions[m_front]};
+    }
+
+    // Context: Any. The last published revision, which Read() will return
+    uint32_t LatestRevision() const
+    {
+        return m_latest_revision.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint8_t kIndexMask = 0b011;
+    static constexpr uint8_t kFresh = 0b100;
+
+    std::array<T, 3> m_buffers {};
+    std::array<uint32_t, 3> m_revisions {};
+
+    // Index of the middle buffer, and if it's newer than the front one
+    std::atomic<uint8_t> m_middle {1};
+    std::atomic<uint32_t> m_latest_revision {0};
+
+    // Owned by the writer
+    uint8_t m_back {0};
+    uint32_t m_revision {0};
+
+    // Owned by the reader
+    uint8_t m_front {2};
+};
@@ -3,6 +3,7 @@
 #include "battery_utils.hh"
 #include "debug_assert.hh"
 
+#include <algorithm>
 #include <numeric>
 
 static_assert(TripComputer::kNumberOfTripLogEntries <=
@@ -35,9 +36,12 @@ TriangleArea(const Point& a, const Point& b, const Point& c)
 {
     debug_assert(a.zoom == kDefaultZoom && b.zoom == kDefaultZoom && c.zoom == kDefaultZoom);
 
-    // Only the relation is important, not the absolute area
-    const auto doubled_area = (a.x) * (b.y - c.y) + (b.x) * (c.y - a.y) + (c.x) * (a.y - b.y);
-    return std::abs(doubled_area);
+    // Only the relation is important, not the absolute area. Relative to a, since the
+    // absolute coordinates would overflow
+    const auto doubled_area = static_cast<int64_t>(b.x - a.x) * (c.y - a.y) -
+                              static_cast<int64_t>(c.x - a.x) * (b.y - a.y);
+    return static_cast<uint32_t>(std::min<int64_t>(std::abs(doubled_area),
+                                                   std::numeric_limits<uint32_t>::max() - 1));
 }
 
 
@@ -72,13 +76,15 @@ InterpolateSoc(uint16_t millivolts, uint8_t battery_series)
 }
 } // namespace
 
-TripComputer::TripComputer(ApplicationState& app_state)
+TripComputer::TripComputer(ApplicationState& app_state,
+                           std::unique_ptr<TripLogStore> trip_log_store)
     : m_state(app_state)
     , m_state_listener(m_state.AttachListener<AS::configuration,
                                               AS::can_bus_active,
                                               AS::odometer,
                                               AS::pixel_position>(GetSemaphore()))
     , m_state_cache(m_state)
+    , m_trip_log_store(std::move(trip_log_store))
     , m_trip_log_storage(std::make_unique<std::array<TripLogEntry, kNumberOfTripLogEntries>>())
 {
     // Fill with zeroes to start from the rightmost point
@@ -86,6 +92,16 @@ TripComputer::TripComputer(ApplicationState& app_state)
     {
         m_recent_entries.push(RecentEntry {0});
     }
+    PublishRecentEntries();
+}
+
+TripComputer::DisplayLogLevel::DisplayLogLevel(TripComputer& parent, uint8_t zoom)
+    : log(parent,
+          // The same tolerance on the screen at all zooms
+          kLogMinDistance << (kDefaultZoom - zoom),
+          kDisplayLogMinArea << (2 * (kDefaultZoom - zoom)),
+          [this](const auto& entry) { removed_sequence = entry.display_sequence; })
+{
 }
 
 void
@@ -97,6 +113,11 @@ TripComputer::OnStartup()
         m_free_log_entries.push_back(i);
     }
 
+    if (m_trip_log_store)
+    {
+        m_trip_log_store->Load();
+    }
+
     m_soc_timer = StartTimer(100ms, [this]() {
         std::optional<milliseconds> out = 100ms;
         if (m_state.CheckoutReadonly().Get<AS::can_bus_active>())
@@ -200,6 +221,8 @@ TripComputer::UpdateRecentEntries(uint32_t odometer)
         m_recent_entries.back().power = average_power;
         m_recent_entries.back().average_consumption = average_consumption;
     }
+
+    PublishRecentEntries();
 }
 
 
@@ -240,11 +263,16 @@ TripComputer::ResetTrip()
     // Set by the can bus handler
     rw.Set<AS::trip_max_speed>(0);
 
-    m_display_logs[0].clear();
-    m_display_logs[1].clear();
-    m_current_display_log = 0;
     m_export_log.Reset();
-    m_display_log.Reset();
+    for (auto& level : m_display_logs)
+    {
+        PublishDisplayLog(level, std::nullopt);
+        level.log.Reset();
+    }
+    if (m_trip_log_store)
+    {
+        m_trip_log_store->StartTrip();
+    }
 
     m_current_distance = m_trip_start_distance;
     m_current_trip_movement_second = std::chrono::duration_cast<seconds>(os::GetTimeStamp());
@@ -290,26 +318,42 @@ TripComputer::UpdateSoc(uint16_t millivolts)
     }
 }
 
-std::pair<std::unique_lock<etl::mutex>, std::span<const TripComputer::DisplayTripLogEntry>>
-TripComputer::GetDisplayLog()
+TripComputer::DisplayLog
+TripComputer::GetDisplayLog(uint8_t zoom)
 {
-    auto lock = std::unique_lock(m_log_mutex);
-    return {std::move(lock), m_display_logs[m_current_display_log]};
+    auto [log, revision] = m_display_logs[DisplayLogIndex(zoom)].published.Read();
+
+    return DisplayLog {log.entries, revision};
 }
 
-std::span<const TripComputer::RecentEntry>
-TripComputer::GetRecentEntries()
+size_t
+TripComputer::DisplayLogIndex(uint8_t zoom)
 {
-    m_display_recent_entries = {};
-    m_display_recent_entries.clear();
-
-    std::lock_guard<etl::mutex> lock(m_log_mutex);
-    for (const auto& entry : m_recent_entries)
+    // The zooms go from detailed to coarse
+    for (auto i = kDisplayLogZooms.size(); i > 0; i--)
     {
-        m_display_recent_entries.push_back(entry);
+        if (kDisplayLogZooms[i - 1] >= zoom)
+        {
+            return i - 1;
+        }
     }
 
-    return m_display_recent_entries;
+    return 0;
+}
+
+TripComputer::RecentEntries
+TripComputer::GetRecentEntries()
+{
+    return m_published_recent_entries.Read().value;
+}
+
+void
+TripComputer::PublishRecentEntries()
+{
+    auto& recent_entries = m_published_recent_entries.WriteBuffer();
+
+    recent_entries.assign(m_recent_entries.begin(), m_recent_entries.end());
+    m_published_recent_entries.Publish();
 }
 
 
@@ -410,29 +454,110 @@ TripComputer::UpdateTripLog()
     auto now = os::GetTimeStamp();
     auto power = ro.Get<AS::current_power_w>();
 
-    m_export_log.AddEntry(position, now, power);
-    auto new_entry_handle = m_display_log.AddEntry(position, now, power);
+    if (!m_export_log.AddEntry(position, now, power))
+    {
+        return;
+    }
+
+    if (m_trip_log_store)
+    {
+        m_trip_log_store->Add(
+            TripLogStore::Record {position, now, static_cast<int16_t>(power)});
+    }
+
+    // The display logs are built from what the export log takes in
+    for (auto& level : m_display_logs)
+    {
+        AddDisplayLogEntry(level, position, now, power);
+    }
+}
+
+void
+TripComputer::AddDisplayLogEntry(DisplayLogLevel& level,
+                                 const Point& position,
+                                 milliseconds timestamp,
+                                 int16_t power)
+{
+    // Set if the simplification drops an entry
+    level.removed_sequence.reset();
+
+    auto handle = level.log.AddEntry(position, timestamp, power);
+    if (!handle)
+    {
+        return;
+    }
+
+    auto sequence = level.next_sequence++;
+
+    WritableEntry(*handle).display_sequence = sequence;
+    PublishDisplayLog(level,
+                      DisplayLogEdit {
+                          .removed_sequence = level.removed_sequence,
+                          .added = DisplayTripLogEntry {position, power},
+                          .added_sequence = sequence,
+                      });
+}
+
+void
+TripComputer::PublishDisplayLog(DisplayLogLevel& level, std::optional<DisplayLogEdit> edit)
+{
+    const auto revision = level.published.LatestRevision() + 1;
 
-    if (new_entry_handle.has_value())
+    if (edit)
     {
-        const auto& new_entry = Entry(*new_entry_handle);
+        edit->revision = revision;
+        ApplyDisplayLogEdit(level.master, *edit);
 
-        auto update_log = !m_current_display_log;
-        auto& display_log = m_display_logs[update_log];
+        if (level.journal.full())
+        {
+            level.journal_start = level.journal.front().revision + 1;
+            level.journal.pop();
+        }
+        level.journal.push(*edit);
+    }
+    else
+    {
+        // Cleared, so the published copies can't be patched
+        level.master = {};
+        level.journal.clear();
+        level.journal_start = revision + 1;
+    }
 
-        display_log.clear();
-        display_log.push_back(DisplayTripLogEntry {position, ro.Get<AS::current_power_w>()});
-        auto pred_handle = new_entry.predecessor;
-        while (pred_handle != kInvalidLogHandle)
+    // Usually one or two edits behind, unless the UI has kept its snapshot for long
+    auto& log = level.published.WriteBuffer();
+    const auto log_revision = level.published.WriteBufferRevision();
+    if (log_revision + 1 >= level.journal_start)
+    {
+        for (const auto& journaled : level.journal)
         {
-            const auto& pred_entry = Entry(pred_handle);
-            display_log.push_back(DisplayTripLogEntry {pred_entry.position, pred_entry.power});
-            pred_handle = pred_entry.predecessor;
+            if (journaled.revision > log_revision)
+            {
+                ApplyDisplayLogEdit(log, journaled);
+            }
         }
+    }
+    else
+    {
+        log = level.master;
+    }
+
+    level.published.Publish();
+}
+
+void
+TripComputer::ApplyDisplayLogEdit(PublishedDisplayLog& log, const DisplayLogEdit& edit)
+{
+    if (edit.removed_sequence)
+    {
+        auto it = std::ranges::lower_bound(log.sequences, *edit.removed_sequence);
+        debug_assert(it != log.sequences.end() && *it == *edit.removed_sequence);
 
-        auto lock = std::lock_guard(m_log_mutex);
-        m_current_display_log = update_log;
+        log.entries.erase(log.entries.begin() + std::distance(log.sequences.begin(), it));
+        log.sequences.erase(it);
     }
+
+    log.entries.push_back(edit.added);
+    log.sequences.push_back(edit.added_sequence);
 }
 
 template <size_t Entries>
@@ -441,6 +566,7 @@ TripComputer::Log<Entries>::TriangleArea(const TripLogEntry& entry) const
 {
     if (entry.predecessor == kInvalidLogHandle)
     {
+        // The first entry, which is queued with this so that it's never the one removed
         return std::numeric_limits<uint32_t>::max();
     }
     debug_assert(entry.successor != kInvalidLogHandle);
@@ -450,13 +576,53 @@ TripComputer::Log<Entries>::TriangleArea(const TripLogEntry& entry) const
                           m_parent.Entry(entry.successor).position);
 }
 
+template <size_t Entries>
+void
+TripComputer::Log<Entries>::UpdateTriangleArea(LogHandle handle)
+{
+    // The pending entry is not in the queue yet. The first one is, but its area stays
+    // UINT32_MAX, which is what keeps it from being removed.
+    if (handle != kInvalidLogHandle && m_log_queue.Contains(handle))
+    {
+        m_log_queue.Update(handle, TriangleArea(m_parent.Entry(handle)));
+    }
+}
+
+template <size_t Entries>
+void
+TripComputer::Log<Entries>::Remove(LogHandle handle)
+{
+    const auto& entry = m_parent.Entry(handle);
+    debug_assert(entry.predecessor != kInvalidLogHandle && "Can't remove the first entry");
+
+    auto predecessor = entry.predecessor;
+    auto successor = entry.successor;
+
+    m_parent.WritableEntry(predecessor).successor = successor;
+    if (successor != kInvalidLogHandle)
+    {
+        m_parent.WritableEntry(successor).predecessor = predecessor;
+    }
+
+    m_log_queue.Erase(handle);
+    if (m_on_remove)
+    {
+        m_on_remove(entry);
+    }
+    m_parent.FreeLogEntry(handle);
+
+    // The neighbours now form triangles with other entries
+    UpdateTriangleArea(predecessor);
+    UpdateTriangleArea(successor);
+}
+
 template <size_t Entries>
 std::optional<TripComputer::LogHandle>
 TripComputer::Log<Entries>::AddEntry(const Point& position, milliseconds timestamp, int16_t power)
 {
     if (m_pending_log_entry &&
-        std::abs(position.x - m_parent.Entry(m_pending_log_entry->handle).position.x) < 5 &&
-        std::abs(position.y - m_parent.Entry(m_pending_log_entry->handle).position.y) < 5)
+        std::abs(position.x - m_parent.Entry(*m_pending_log_entry).position.x) < m_min_distance &&
+        std::abs(position.y - m_parent.Entry(*m_pending_log_entry).position.y) < m_min_distance)
     {
         // Wait for a position further away
         return std::nullopt;
@@ -469,45 +635,31 @@ TripComputer::Log<Entries>::AddEntry(const Point& position, milliseconds timesta
     auto& new_entry = m_parent.WritableEntry(*handle);
 
     new_entry = TripComputer::TripLogEntry {
-        position, timestamp, power, kInvalidLogHandle, kInvalidLogHandle};
+        position, 0, timestamp, power, kInvalidLogHandle, kInvalidLogHandle};
 
     if (m_pending_log_entry)
     {
         // Update the successor of the current pending entry
-        auto& last_entry = m_parent.WritableEntry(m_pending_log_entry->handle);
+        auto& last_entry = m_parent.WritableEntry(*m_pending_log_entry);
         last_entry.successor = *handle;
-        new_entry.predecessor = m_pending_log_entry->handle;
-        m_pending_log_entry->triangle_area = TriangleArea(last_entry);
+        new_entry.predecessor = *m_pending_log_entry;
 
-        if (m_log_queue.full())
+        // Make room, or drop an entry that can't be seen anyway
+        if (m_log_queue.Full() || (!m_log_queue.Empty() && m_log_queue.TopKey() < m_min_area))
         {
-            const auto& to_remove = m_log_queue.top();
-
-            auto& entry_to_remove = m_parent.Entry(to_remove.handle);
-            debug_assert(entry_to_remove.predecessor != kInvalidLogHandle &&
-                         "Can't remove the first entry");
-            m_parent.WritableEntry(entry_to_remove.predecessor).successor =
-                entry_to_remove.successor;
-            if (entry_to_remove.successor != kInvalidLogHandle)
-            {
-                m_parent.WritableEntry(entry_to_remove.successor).predecessor =
-                    entry_to_remove.predecessor;
-            }
-
-            m_parent.FreeLogEntry(to_remove.handle);
-            m_log_queue.pop();
+            Remove(m_log_queue.Top());
         }
 
-        m_log_queue.push(*m_pending_log_entry);
-        m_pending_log_entry = LogQueueEntry {0, *handle};
+        // After the removal, since that might have changed the predecessor
+        m_log_queue.Push(*m_pending_log_entry, TriangleArea(last_entry));
     }
     else
     {
-        debug_assert(m_log_queue.empty());
-
-        // This is the first entry, will be fixed up above
-        m_pending_log_entry = LogQueueEntry {0, *handle};
+        debug_assert(m_log_queue.Empty());
     }
 
+    // The first entry, or the successor of the one queued above
+    m_pending_log_entry = *handle;
+
     return *handle;
 }
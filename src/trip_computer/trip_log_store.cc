@@ -0,0 +1,532 @@
+#include "trip_log_store.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <limits>
+
+namespace
+{
+
+// Bump when the format changes
+constexpr uint32_t kBlockMagic = 0x52544c33; // "RTL3"
+constexpr uint32_t kTailChunkMagic = 0x52544c54; // "RTLT"
+
+struct BlockHeader
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t trip;
+    uint16_t count;
+    uint16_t length;
+    // Of the sequence, the trip, the count and the payload
+    uint32_t crc;
+};
+
+// The records of the open block since the chunk before
+struct TailChunkHeader
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t trip;
+    uint32_t index;
+    uint16_t count;
+    uint16_t length;
+    // Of the index and the same as for the block
+    uint32_t crc;
+};
+
+constexpr auto kMaxPayloadSize = TripLogStore::kBlockSize - sizeof(BlockHeader);
+// Four varints, the largest of which has 35 bits
+constexpr auto kMaxRecordSize = 4 * 5;
+
+uint32_t
+Crc32(std::span<const std::byte> data, uint32_t crc = 0)
+{
+    crc = ~crc;
+    for (auto b : data)
+    {
+        crc ^= static_cast<uint8_t>(b);
+        for (auto i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+template <typename T>
+uint32_t
+Crc32Of(const T& value, uint32_t crc = 0)
+{
+    return Crc32(std::as_bytes(std::span {&value, 1}), crc);
+}
+
+uint32_t
+BlockCrc(uint32_t sequence, uint32_t trip, uint16_t count, std::span<const std::byte> payload)
+{
+    return Crc32(payload, Crc32Of(count, Crc32Of(trip, Crc32Of(sequence))));
+}
+
+uint64_t
+ZigZag(int64_t value)
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t
+UnZigZag(uint64_t value)
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+void
+AppendVarint(std::vector<std::byte>& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<std::byte>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::byte>(value));
+}
+
+std::optional<uint64_t>
+ExtractVarint(std::span<const std::byte> data, size_t& offset)
+{
+    uint64_t out = 0;
+
+    for (auto shift = 0; shift < 64 && offset < data.size(); shift += 7)
+    {
+        auto b = static_cast<uint8_t>(data[offset++]);
+
+        out |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+        {
+            return out;
+        }
+    }
+
+    return std::nullopt;
+}
+
+void
+AppendRecord(std::vector<std::byte>& out,
+             const TripLogStore::Record& record,
+             const TripLogStore::Record& last)
+{
+    AppendVarint(out, ZigZag(static_cast<int64_t>(record.position.x) - last.position.x));
+    AppendVarint(out, ZigZag(static_cast<int64_t>(record.position.y) - last.position.y));
+    AppendVarint(out, ZigZag(record.timestamp.count() - last.timestamp.count()));
+    AppendVarint(out, ZigZag(static_cast<int64_t>(record.power) - last.power));
+}
+
+template <typename T>
+void
+Append(std::vector<std::byte>& out, const T& value)
+{
+    auto bytes = std::as_bytes(std::span {&value, 1});
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+template <typename T>
+std::optional<T>
+Extract(std::span<const std::byte> data, size_t offset)
+{
+    if (offset + sizeof(T) > data.size())
+    {
+        return std::nullopt;
+    }
+
+    T out;
+    memcpy(&out, data.data() + offset, sizeof(T));
+
+    return out;
+}
+
+// The header, if the data has the magic and the length in it
+template <typename Header>
+std::optional<Header>
+ExtractHeader(std::span<const std::byte> data, uint32_t magic)
+{
+    auto header = Extract<Header>(data, 0);
+    if (!header || header->magic != magic || data.size() != sizeof(Header) + header->length)
+    {
+        return std::nullopt;
+    }
+
+    return header;
+}
+
+// Decode count records from the start of a block
+uint16_t
+DecodeRecords(std::span<const std::byte> payload,
+              uint16_t count,
+              const std::function<void(const TripLogStore::Record&)>& on_record)
+{
+    TripLogStore::Record last {};
+    size_t offset = 0;
+    uint16_t decoded = 0;
+
+    for (; decoded < count; decoded++)
+    {
+        auto x = ExtractVarint(payload, offset);
+        auto y = ExtractVarint(payload, offset);
+        auto time = ExtractVarint(payload, offset);
+        auto power = ExtractVarint(payload, offset);
+        if (!x || !y || !time || !power)
+        {
+            break;
+        }
+
+        last = TripLogStore::Record {
+            Point {static_cast<int32_t>(last.position.x + UnZigZag(*x)),
+                   static_cast<int32_t>(last.position.y + UnZigZag(*y)),
+                   kDefaultZoom},
+            milliseconds(last.timestamp.count() + UnZigZag(*time)),
+            static_cast<int16_t>(last.power + UnZigZag(*power)),
+        };
+        on_record(last);
+    }
+
+    return decoded;
+}
+
+} // namespace
+
+TripLogStore::TripLogStore(std::string directory,
+                           ReadFunction read,
+                           WriteFunction write,
+                           uint32_t max_blocks)
+    : m_directory(std::move(directory))
+    , m_read(std::move(read))
+    , m_write(std::move(write))
+    , m_max_blocks(std::max(max_blocks, 1u))
+{
+    m_payload.reserve(kMaxPayloadSize);
+}
+
+void
+TripLogStore::Load()
+{
+    // The positions are used in order, so count them by galloping and then bisecting.
+    // Position present - 1 is used (or present is 0), and position missing - 1 isn't
+    uint32_t present = 0;
+    uint32_t missing = 1;
+    while (BlockExists(missing - 1))
+    {
+        present = missing;
+        missing *= 2;
+    }
+    while (missing - present > 1)
+    {
+        auto middle = present + (missing - present) / 2;
+        if (BlockExists(middle - 1))
+        {
+            present = middle;
+        }
+        else
+        {
+            missing = middle;
+        }
+    }
+
+    // Continue in a new block
+    m_sequence = present;
+    if (present == m_max_blocks)
+    {
+        // The ring is full, and the positions up to the last written one have consecutive
+        // sequence numbers. Only the last written block can be torn.
+        if (auto first = ReadBlockAt(0); first)
+        {
+            uint32_t last = 0;
+            uint32_t older = m_max_blocks;
+            while (older - last > 1)
+            {
+                auto middle = last + (older - last) / 2;
+                auto block = ReadBlockAt(middle);
+                if (block && block->sequence == first->sequence + middle)
+                {
+                    last = middle;
+                }
+                else
+                {
+                    older = middle;
+                }
+            }
+            m_sequence = first->sequence + last + 1;
+        }
+        else if (auto previous = ReadBlockAt(m_max_blocks - 1); previous)
+        {
+            // The block at position 0 is the torn one
+            m_sequence = previous->sequence + 1;
+        }
+    }
+
+    m_trip = 0;
+    for (auto sequence = m_sequence; sequence > OldestSequence(); sequence--)
+    {
+        if (auto block = ReadBlock(sequence - 1); block)
+        {
+            m_trip = block->trip;
+            break;
+        }
+    }
+
+    m_count = 0;
+    m_payload.clear();
+    m_last = {};
+    m_tail_chunks = 0;
+    m_tail_count = 0;
+    m_tail_size = 0;
+
+    if (RecoverTail())
+    {
+        // Write the records which were lost with the RAM, and continue after them
+        CloseBlock();
+    }
+}
+
+void
+TripLogStore::StartTrip()
+{
+    CloseBlock();
+    m_trip++;
+}
+
+void
+TripLogStore::Add(const Record& record)
+{
+    if (m_payload.size() + kMaxRecordSize > kMaxPayloadSize ||
+        m_count == std::numeric_limits<uint16_t>::max())
+    {
+        // Close this block, and start a new one from zero
+        CloseBlock();
+    }
+
+    AppendRecord(m_payload, record, m_last);
+    m_last = record;
+    m_count++;
+
+    if (m_count - m_tail_count >= kFlushInterval)
+    {
+        Flush();
+    }
+}
+
+void
+TripLogStore::Flush()
+{
+    if (m_count == m_tail_count)
+    {
+        return;
+    }
+
+    auto records = std::span {m_payload}.subspan(m_tail_size);
+    auto count = static_cast<uint16_t>(m_count - m_tail_count);
+    std::vector<std::byte> data;
+
+    data.reserve(sizeof(TailChunkHeader) + records.size());
+    Append(data,
+           TailChunkHeader {kTailChunkMagic,
+                            m_sequence,
+                            m_trip,
+                            m_tail_chunks,
+                            count,
+                            static_cast<uint16_t>(records.size()),
+                            Crc32Of(m_tail_chunks, BlockCrc(m_sequence, m_trip, count, records))});
+    data.insert(data.end(), records.begin(), records.end());
+
+    m_write(TailChunkPath(m_tail_chunks), data);
+    m_tail_chunks++;
+    m_tail_count = m_count;
+    m_tail_size = m_payload.size();
+}
+
+void
+TripLogStore::CloseBlock()
+{
+    if (m_count == 0)
+    {
+        return;
+    }
+
+    std::vector<std::byte> data;
+
+    data.reserve(sizeof(BlockHeader) + m_payload.size());
+    Append(data,
+           BlockHeader {kBlockMagic,
+                        m_sequence,
+                        m_trip,
+                        m_count,
+                        static_cast<uint16_t>(m_payload.size()),
+                        BlockCrc(m_sequence, m_trip, m_count, m_payload)});
+    data.insert(data.end(), m_payload.begin(), m_payload.end());
+
+    // The only write of the block. The tail chunks are left, and are told apart from the
+    // ones of the next block by the sequence number
+    m_write(BlockPath(m_sequence % m_max_blocks), data);
+
+    m_sequence++;
+    m_count = 0;
+    m_payload.clear();
+    m_last = {};
+    m_tail_chunks = 0;
+    m_tail_count = 0;
+    m_tail_size = 0;
+}
+
+bool
+TripLogStore::RecoverTail()
+{
+    auto first = ReadTailChunk(0);
+
+    // The chunks are of the open block, or of the last one if writing it was torn
+    if (!first || first->sequence + 1 < m_sequence || ReadBlock(first->sequence))
+    {
+        return false;
+    }
+
+    for (auto index = 0u;; index++)
+    {
+        auto chunk = index == 0 ? first : ReadTailChunk(index);
+        if (!chunk || chunk->sequence != first->sequence || chunk->trip != first->trip ||
+            m_payload.size() + chunk->payload.size() > kMaxPayloadSize)
+        {
+            // A later chunk was torn, or is left from an earlier block
+            break;
+        }
+
+        m_payload.insert(m_payload.end(), chunk->payload.begin(), chunk->payload.end());
+        m_count += chunk->count;
+    }
+
+    m_sequence = first->sequence;
+    m_trip = first->trip;
+    DecodeRecords(m_payload, m_count, [this](const Record& record) { m_last = record; });
+
+    return true;
+}
+
+bool
+TripLogStore::ForEachRecord(uint32_t trip,
+                            const std::function<void(const Record&)>& on_record) const
+{
+    // Blocks are written in trip order, so find the first block of the trip from the end
+    auto first = m_sequence;
+    for (; first > OldestSequence(); first--)
+    {
+        auto block = ReadBlock(first - 1);
+        if (block && block->trip < trip)
+        {
+            break;
+        }
+    }
+
+    auto found = false;
+    for (auto sequence = first; sequence < m_sequence; sequence++)
+    {
+        auto block = ReadBlock(sequence);
+        if (block && block->trip == trip)
+        {
+            found |= DecodeRecords(block->payload, block->count, on_record) != 0;
+        }
+    }
+
+    // And the block which is still in RAM
+    if (trip == m_trip)
+    {
+        found |= DecodeRecords(m_payload, m_count, on_record) != 0;
+    }
+
+    return found;
+}
+
+std::optional<TripLogStore::Block>
+TripLogStore::ReadBlock(uint32_t sequence) const
+{
+    auto out = ReadBlockAt(sequence % m_max_blocks);
+
+    if (out && out->sequence != sequence)
+    {
+        // Overwritten by a later one, or not written yet
+        return std::nullopt;
+    }
+
+    return out;
+}
+
+std::optional<TripLogStore::Block>
+TripLogStore::ReadBlockAt(uint32_t position) const
+{
+    auto data = m_read(BlockPath(position));
+    if (!data)
+    {
+        return std::nullopt;
+    }
+
+    auto header = ExtractHeader<BlockHeader>(*data, kBlockMagic);
+    if (!header)
+    {
+        return std::nullopt;
+    }
+
+    auto payload = std::span {*data}.subspan(sizeof(BlockHeader));
+    if (BlockCrc(header->sequence, header->trip, header->count, payload) != header->crc)
+    {
+        // Torn write
+        return std::nullopt;
+    }
+
+    return Block {header->sequence, header->trip, header->count, {payload.begin(), payload.end()}};
+}
+
+std::optional<TripLogStore::Block>
+TripLogStore::ReadTailChunk(uint32_t index) const
+{
+    auto data = m_read(TailChunkPath(index));
+    if (!data)
+    {
+        return std::nullopt;
+    }
+
+    auto header = ExtractHeader<TailChunkHeader>(*data, kTailChunkMagic);
+    if (!header || header->index != index)
+    {
+        return std::nullopt;
+    }
+
+    auto payload = std::span {*data}.subspan(sizeof(TailChunkHeader));
+    if (Crc32Of(index, BlockCrc(header->sequence, header->trip, header->count, payload)) !=
+        header->crc)
+    {
+        return std::nullopt;
+    }
+
+    return Block {header->sequence, header->trip, header->count, {payload.begin(), payload.end()}};
+}
+
+bool
+TripLogStore::BlockExists(uint32_t position) const
+{
+    return position < m_max_blocks && m_read(BlockPath(position)).has_value();
+}
+
+std::string
+TripLogStore::BlockPath(uint32_t position) const
+{
+    return std::format("{}/{:06}.bin", m_directory, position);
+}
+
+std::string
+TripLogStore::TailChunkPath(uint32_t index) const
+{
+    return std::format("{}/tail_{:04}.bin", m_directory, index);
+}
+
+uint32_t
+TripLogStore::OldestSequence() const
+{
+    return m_sequence >= m_max_blocks ? m_sequence - m_max_blocks : 0;
+}
@@ -0,0 +1,81 @@
+#include "frame_pacer.hh"
+
+#include <algorithm>
+
+uint32_t
+FramePacer::TimeUntilNextFrame(uint32_t now, bool active) const
+{
+    if (!m_has_rendered)
+    {
+        return 0;
+    }
+
+    auto interval = IsActive(now, active) ? kActiveFrameInterval : kIdleFrameInterval;
+    auto elapsed = now - m_render_start;
+
+    return elapsed >= interval ? 0 : interval - elapsed;
+}
+
+void
+FramePacer::OnRenderStart(uint32_t now)
+{
+    m_render_start = now;
+    m_has_rendered = true;
+}
+
+void
+FramePacer::OnFlushStart(uint32_t now)
+{
+    auto render_ms = now - m_render_start;
+
+    m_flush_start = now;
+    m_window_render_ms += render_ms;
+    m_window_max_render_ms = std::max(m_window_max_render_ms, render_ms);
+}
+
+bool
+FramePacer::ShouldTimeFlush() const
+{
+    return m_window_frames % kFlushTimingInterval == 0;
+}
+
+void
+FramePacer::OnFlushDone(uint32_t now, bool timed)
+{
+    m_last_flush = now;
+    m_has_flushed = true;
+
+    if (timed)
+    {
+        auto flush_ms = now - m_flush_start;
+
+        m_window_flush_ms += flush_ms;
+        m_window_max_flush_ms = std::max(m_window_max_flush_ms, flush_ms);
+        m_window_timed_flushes++;
+    }
+    m_window_frames++;
+
+    if (m_window_frames == kStatsWindow)
+    {
+        m_stats = {
+            .frames = m_stats.frames + m_window_frames,
+            .average_render_ms = m_window_render_ms / m_window_frames,
+            .max_render_ms = m_window_max_render_ms,
+            .average_flush_ms = m_window_flush_ms / std::max(m_window_timed_flushes, 1u),
+            .max_flush_ms = m_window_max_flush_ms,
+        };
+
+        m_window_frames = 0;
+        m_window_timed_flushes = 0;
+        m_window_render_ms = 0;
+        m_window_max_render_ms = 0;
+        m_window_flush_ms = 0;
+        m_window_max_flush_ms = 0;
+    }
+}
+
+bool
+FramePacer::IsActive(uint32_t now, bool active) const
+{
+    return active || (m_has_flushed && now - m_last_flush < kActiveHoldTime);
+}
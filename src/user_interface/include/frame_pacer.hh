@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Decides when the user interface renders the next frame, and keeps frame timings
+ *
+ * Frames are paced at kActiveFrameInterval while something is happening on the display
+ * (input, screen transitions or anything which caused a flush recently), and fall back to
+ * kIdleFrameInterval otherwise. Times are in milliseconds from os::GetTimeStampRaw().
+ */
+class FramePacer
+{
+public:
+    static constexpr uint32_t kActiveFrameInterval = 16;
+    static constexpr uint32_t kIdleFrameInterval = 500;
+
+    // How long a flush keeps the frame rate up, so that panning doesn't stutter
+    static constexpr uint32_t kActiveHoldTime = 250;
+
+    // Number of frames each published Stats covers
+    static constexpr uint32_t kStatsWindow = 64;
+
+    // Every this many frames, a flush which would complete in the background is waited for
+    // instead, to time it
+    static constexpr uint32_t kFlushTimingInterval = 16;
+
+    struct Stats
+    {
+        uint32_t frames {0};
+        uint32_t average_render_ms {0};
+        uint32_t max_render_ms {0};
+        // Of the timed flushes only
+        uint32_t average_flush_ms {0};
+        uint32_t max_flush_ms {0};
+    };
+
+    // 0 if a frame should be rendered now. active is true for activity outside of the pacer
+    uint32_t TimeUntilNextFrame(uint32_t now, bool active) const;
+
+    // If frames should be paced at kActiveFrameInterval
+    bool IsActive(uint32_t now, bool active) const;
+
+    void OnRenderStart(uint32_t now);
+    // Context: The LVGL flush callback, when the frame has been rendered
+    void OnFlushStart(uint32_t now);
+
+    // If the flush which is started should be waited for, so that it's timed
+    bool ShouldTimeFlush() const;
+
+    /**
+     * @brief The frame is on the display
+     *
+     * @param timed false if the flush completed in the background, and was only collected
+     *        now. Its time is then left out of the stats.
+     */
+    void OnFlushDone(uint32_t now, bool timed = true);
+
+    // The last complete window of frames
+    const Stats& GetStats() const
+    {
+        return m_stats;
+    }
+
+private:
+    uint32_t m_render_start {0};
+    uint32_t m_flush_start {0};
+    // The first frame is rendered at once
+    bool m_has_rendered {false};
+    bool m_has_flushed {false};
+    uint32_t m_last_flush {0};
+
+    uint32_t m_window_frames {0};
+    uint32_t m_window_timed_flushes {0};
+    uint32_t m_window_render_ms {0};
+    uint32_t m_window_max_render_ms {0};
+    uint32_t m_window_flush_ms {0};
+    uint32_t m_window_max_flush_ms {0};
+    Stats m_stats;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "trip_computer.hh"
+
+#include <cstdint>
+#include <etl/vector.h>
+#include <span>
+
+/**
+ * @brief Anti-aliased wide lines and rings for RGB565 buffers
+ *
+ * Everything is drawn in a single scanline pass: each row collects the spans covered by
+ * the shape, and every pixel in them is blended once with the coverage from its distance
+ * to the closest segment. Joins between segments are therefore round, and overlapping
+ * segments don't darken each other.
+ *
+ * All of the math is integer, since doubles are emulated in software on the targets.
+ * Coordinates are in half pixels, and distances in 1/256 half pixels. Each segment gets a
+ * unit normal in fixed point, so the distance of a pixel from it is a dot product without
+ * a divide. Only pixels near the round ends need an integer square root, and the edges of
+ * rings use a series in their squared distance instead.
+ */
+namespace polyline_rasterizer
+{
+
+struct Target
+{
+    uint16_t* data;
+    int32_t width;
+    int32_t height;
+};
+
+struct Vertex
+{
+    int32_t x;
+    int32_t y;
+    // The color of the segment ending at this vertex, unused for the first one
+    uint16_t color;
+};
+
+// Drawn in one go, which is the whole display trip log. Longer lines are drawn in parts.
+constexpr size_t kMaxVertices = TripComputer::kMaxDisplayLogEntries;
+
+namespace detail
+{
+
+struct Segment
+{
+    // In half pixels, where the center of pixel (x, y) is at (2x + 1, 2y + 1)
+    int64_t ax;
+    int64_t ay;
+    int64_t bx;
+    int64_t by;
+    // (-(by - ay), bx - ax) / length in 2.30 fixed point
+    int32_t normal_x;
+    int32_t normal_y;
+    int64_t length_squared;
+    uint16_t color;
+
+    int32_t first_row;
+    int32_t last_row;
+};
+
+struct Span
+{
+    int32_t left;
+    int32_t right;
+    uint32_t segment;
+};
+
+} // namespace detail
+
+// Working memory for DrawPolyline, kept by the caller so that drawing doesn't allocate
+struct Scratch
+{
+    etl::vector<detail::Segment, kMaxVertices - 1> segments;
+    etl::vector<detail::Span, kMaxVertices - 1> spans;
+    etl::vector<uint32_t, kMaxVertices - 1> members;
+};
+
+// Wider lines and rings are drawn this wide
+constexpr int32_t kMaxWidth = 127;
+
+// Pixels within width / 2 of the line are covered
+void DrawPolyline(const Target& dst,
+                  std::span<const Vertex> vertices,
+                  int32_t width,
+                  Scratch& scratch);
+
+// The middle of the ring stroke is at radius
+void DrawRing(const Target& dst,
+              int32_t center_x,
+              int32_t center_y,
+              int32_t radius,
+              int32_t width,
+              uint16_t color);
+
+} // namespace polyline_rasterizer
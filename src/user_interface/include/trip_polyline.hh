@@ -0,0 +1,69 @@
+#pragma once
+
+#include "trip_computer.hh"
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+/**
+ * @brief The display trip log, converted to pixels at one zoom level
+ *
+ * Converting and clipping every log point on every frame is wasteful, since the log only
+ * changes when the trip computer publishes a new revision. Each segment keeps its bounding
+ * box, so that segments outside of the view can be skipped before clipping.
+ */
+class TripPolyline
+{
+public:
+    struct Segment
+    {
+        Point from;
+        Point to;
+        TripComputer::PowerType power;
+
+        int32_t left;
+        int32_t top;
+        int32_t right;
+        int32_t bottom;
+    };
+
+    TripPolyline();
+
+    bool IsCurrent(uint8_t zoom, uint32_t revision) const
+    {
+        return m_zoom == zoom && m_revision == revision;
+    }
+
+    void Update(std::span<const TripComputer::DisplayTripLogEntry> log,
+                uint8_t zoom,
+                uint32_t revision);
+
+    // Call on_segment for all segments touching [left, right] x [top, bottom]
+    template <typename Callback>
+    void ForEachVisible(
+        int32_t left, int32_t top, int32_t right, int32_t bottom, Callback on_segment) const
+    {
+        for (const auto& segment : m_segments)
+        {
+            if (segment.right < left || segment.left > right || segment.bottom < top ||
+                segment.top > bottom)
+            {
+                continue;
+            }
+
+            on_segment(segment);
+        }
+    }
+
+    size_t Size() const
+    {
+        return m_segments.size();
+    }
+
+private:
+    std::vector<Segment> m_segments;
+    std::optional<uint8_t> m_zoom;
+    std::optional<uint32_t> m_revision;
+};
@@ -3,6 +3,8 @@
 #include "application_state.hh"
 #include "base_thread.hh"
 #include "digital_speedometer_widget.hh"
+#include "frame_pacer.hh"
+#include "hal/i_affine_blitter.hh"
 #include "hal/i_blitter.hh"
 #include "hal/i_display.hh"
 #include "hal/i_gpio.hh"
@@ -110,6 +112,7 @@ public:
 
     UserInterface(hal::IDisplay& display,
                   hal::IBlitter& blitter,
+                  hal::IAffineBlitter& affine_blitter,
                   std::unique_ptr<hal::IPm::ILock> pm_lock,
                   hal::IInput& input,
                   ApplicationState& state,
@@ -142,6 +145,12 @@ public:
         SetHelp(false);
     }
 
+    // Render and flush times, updated every FramePacer::kStatsWindow frames
+    const FramePacer::Stats& GetFrameStats() const
+    {
+        return m_frame_pacer.GetStats();
+    }
+
 private:
     void SetHelp(bool on);
 
@@ -158,6 +167,9 @@ private:
     void ResetTrip();
     void DrawPowerBar(uint16_t* dst);
 
+    // Wait for the display rotation blits of the last frame, and show it
+    void CompleteFlush();
+
     void ActivateScreen(ScreenBase& screen)
     {
         if (m_show_all_indicators_timer && !m_show_all_indicators_timer->IsExpired())
@@ -177,6 +189,7 @@ private:
 
     hal::IDisplay& m_display;
     hal::IBlitter& m_blitter;
+    hal::IAffineBlitter& m_affine_blitter;
 
     std::unique_ptr<hal::IPm::ILock> m_pm_lock;
     hal::IInput& m_input;
@@ -193,9 +206,14 @@ private:
     CurrentTrip m_current_trip_start;
 
     lv_display_t* m_lvgl_display {nullptr};
-    uint32_t m_next_redraw_time {0};
+    FramePacer m_frame_pacer;
 
     std::array<hal::BlitOperation, 2> m_rotation_blit_operations {};
+    bool m_flush_pending {false};
+    uint32_t m_flushed_frames {0};
+    // When the pacer wants the next activation, and if something changed before that
+    uint32_t m_next_frame_time {0};
+    bool m_woken_early {false};
 
 
     etl::queue_spsc_atomic<Input::Event, 8> m_input_queue;
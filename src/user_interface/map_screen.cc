@@ -1,11 +1,12 @@
 #include "map_screen.hh"
 
 #include "bresenham.hh"
-#include "cohen_sutherland.hh"
 #include "digital_speedometer_widget.hh"
 #include "lv_event_listener.hh"
+#include "polyline_rasterizer.hh"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
@@ -36,77 +37,125 @@ MapScreen::DrawRangeCircle(lv_layer_t* layer, uint32_t estimated_range_km, uint8
     const int center_x = kDisplayCenterX + (vehicle_point.x - m_current_view_center.x);
     const int center_y = kDisplayCenterY + (vehicle_point.y - m_current_view_center.y);
 
-    lv_draw_arc_dsc_t arc_dsc;
-    lv_draw_arc_dsc_init(&arc_dsc);
-    arc_dsc.color = lv_color_black();
-    arc_dsc.width = width;
-    arc_dsc.opa = LV_OPA_COVER;
-    arc_dsc.start_angle = 0;
-    arc_dsc.end_angle = 360;
-    arc_dsc.center = lv_point_t {
-        .x = static_cast<int16_t>(center_x),
-        .y = static_cast<int16_t>(center_y),
-    };
-    arc_dsc.radius = static_cast<uint16_t>(radius);
-    arc_dsc.rounded = 1;
-    lv_draw_arc(layer, &arc_dsc);
+    polyline_rasterizer::DrawRing(
+        {
+            static_cast<uint16_t*>(static_cast<void*>(layer->draw_buf->data)),
+            hal::kDisplayWidth,
+            hal::kDisplayHeight,
+        },
+        center_x,
+        center_y,
+        radius,
+        width,
+        lv_color_to_u16(lv_color_black()));
 }
 
 void
-MapScreen::DrawTripLines(lv_layer_t* layer)
+MapScreen::PrepareTripLines()
 {
-    auto p = m_parent.m_trip_computer.GetDisplayLog();
-    auto& log = p.second;
-
-    if (log.size() < 2)
+    auto& trip_computer = m_parent.m_trip_computer;
+    if (!m_trip_polyline.IsCurrent(m_zoom, trip_computer.GetDisplayLogRevision(m_zoom)))
     {
-        return;
+        // The trip computer keeps one log per zoom, simplified to what's visible at it
+        auto [log, revision] = trip_computer.GetDisplayLog(m_zoom);
+        m_trip_polyline.Update(log, m_zoom, revision);
     }
 
-    auto it = log.begin();
-    auto last = it;
-    constexpr int kDisplayCenterX = hal::kDisplayWidth / 2;
-    constexpr int kDisplayCenterY = hal::kDisplayHeight / 2;
-
     const auto kLowPowerColor = lv_color_to_u16(lv_palette_main(LV_PALETTE_GREEN));
     const auto kMidPowerColor = lv_color_to_u16(lv_palette_main(LV_PALETTE_AMBER));
     const auto kHighPowerColor = lv_color_to_u16(lv_palette_main(LV_PALETTE_RED));
 
     const auto kMaxPower = m_parent.m_state.CheckoutReadonly().Get<AS::configuration>()->max_watts;
 
-    auto* dst = static_cast<uint16_t*>(static_cast<void*>(layer->draw_buf->data));
-    for (++it; it != log.end(); ++it, ++last)
+    // The display in map-world coordinates, with room for the line width. Rotated, it shows
+    // at most the background, which is centered on the view.
+    auto reach_x = hal::kDisplayWidth / 2 + kTripLineWidth;
+    auto reach_y = hal::kDisplayHeight / 2 + kTripLineWidth;
+    if (m_rotation != 0)
     {
-        auto last_position = OsmPointToPoint(last->position, m_zoom);
-        auto current_position = OsmPointToPoint(it->position, m_zoom);
+        reach_x = kBgSize / 2;
+        reach_y = kBgSize / 2;
+    }
+    const auto left = m_current_view_center.x - reach_x;
+    const auto top = m_current_view_center.y - reach_y;
+    const auto right = m_current_view_center.x + reach_x;
+    const auto bottom = m_current_view_center.y + reach_y;
 
-        // Transform from map-world coordinates to display coordinates.
-        last_position.x = (last_position.x - m_current_view_center.x) + kDisplayCenterX;
-        last_position.y = (last_position.y - m_current_view_center.y) + kDisplayCenterY;
-        current_position.x = (current_position.x - m_current_view_center.x) + kDisplayCenterX;
-        current_position.y = (current_position.y - m_current_view_center.y) + kDisplayCenterY;
+    const float angle_rad = static_cast<float>(m_rotation) * std::numbers::pi_v<float> / 180.0f;
+    const float cos_a = ::cosf(angle_rad);
+    const float sin_a = ::sinf(angle_rad);
 
-        if (!cs::ClipLineToDisplay(
-                last_position.x, last_position.y, current_position.x, current_position.y))
+    // Transform from map-world coordinates to display coordinates, the same way as the map
+    auto to_display = [&](const Point& point, uint16_t color) {
+        const int32_t offset_x = point.x - m_current_view_center.x;
+        const int32_t offset_y = point.y - m_current_view_center.y;
+
+        if (m_rotation == 0)
         {
-            continue;
+            return polyline_rasterizer::Vertex {
+                m_rotation_pivot_x + offset_x, m_rotation_pivot_y + offset_y, color};
         }
 
+        return polyline_rasterizer::Vertex {
+            m_rotation_pivot_x +
+                static_cast<int32_t>(std::lround(cos_a * static_cast<float>(offset_x) -
+                                                 sin_a * static_cast<float>(offset_y))),
+            m_rotation_pivot_y +
+                static_cast<int32_t>(std::lround(sin_a * static_cast<float>(offset_x) +
+                                                 cos_a * static_cast<float>(offset_y))),
+            color,
+        };
+    };
+
+    // Connected segments are drawn together, so that the joins are blended only once
+    m_trip_vertices.clear();
+    m_trip_runs.clear();
+    m_trip_polyline.ForEachVisible(left, top, right, bottom, [&](const auto& segment) {
         auto color = kHighPowerColor;
-        if (it->power < kMaxPower / 3)
+        if (segment.power < kMaxPower / 3)
         {
             color = kLowPowerColor;
         }
-        else if (it->power < 2 * kMaxPower / 3)
+        else if (segment.power < 2 * kMaxPower / 3)
         {
             color = kMidPowerColor;
         }
 
-        painter::DrawClippedLine<Point>(dst,
-                                        {last_position.x, last_position.y},
-                                        {current_position.x, current_position.y},
-                                        5,
-                                        color);
+        auto from = to_display(segment.from, color);
+        auto run_start = m_trip_runs.empty() ? 0 : m_trip_runs.back();
+        if (m_trip_vertices.size() > run_start &&
+            (m_trip_vertices.back().x != from.x || m_trip_vertices.back().y != from.y))
+        {
+            m_trip_runs.push_back(m_trip_vertices.size());
+            run_start = m_trip_vertices.size();
+        }
+        if (m_trip_vertices.size() == run_start)
+        {
+            m_trip_vertices.push_back(from);
+        }
+        m_trip_vertices.push_back(to_display(segment.to, color));
+    });
+    m_trip_runs.push_back(m_trip_vertices.size());
+}
+
+void
+MapScreen::DrawTripLines(lv_layer_t* layer)
+{
+    const polyline_rasterizer::Target dst {
+        static_cast<uint16_t*>(static_cast<void*>(layer->draw_buf->data)),
+        hal::kDisplayWidth,
+        hal::kDisplayHeight,
+    };
+
+    auto vertices = std::span<const polyline_rasterizer::Vertex> {m_trip_vertices};
+    size_t run_start = 0;
+    for (auto run_end : m_trip_runs)
+    {
+        polyline_rasterizer::DrawPolyline(dst,
+                                          vertices.subspan(run_start, run_end - run_start),
+                                          kTripLineWidth,
+                                          m_polyline_scratch);
+        run_start = run_end;
     }
 }
 
@@ -119,6 +168,7 @@ MapScreen::MapScreen(UserInterface& parent,
     , m_tile_cache(tile_cache)
     , m_zoom(zoom)
     , m_touch_timer(m_parent.StartTimer(0ms))
+    , m_tile_state_cache(m_parent.m_state)
 {
     lv_obj_set_style_bg_opa(m_screen, LV_OPA_TRANSP, 0);
     lv_obj_set_scrollbar_mode(m_screen, LV_SCROLLBAR_MODE_OFF);
@@ -143,6 +193,8 @@ MapScreen::MapScreen(UserInterface& parent,
                 }
                 self->m_parent.m_blitter.BlitOperations(std::span<const hal::BlitOperation> {
                     self->m_blit_ops.data(), self->m_blit_ops.size()});
+                // Doesn't touch the frame, so it runs while the tiles are blitted
+                self->PrepareTripLines();
                 self->m_parent.m_blitter.WaitForBlitsDone();
 
                 // Only for the most zoomed out map, because of our insane range
@@ -158,7 +210,14 @@ MapScreen::MapScreen(UserInterface& parent,
             else
             {
                 self->m_parent.m_blitter.WaitForBlitsDone();
+                self->m_background_blits_pending = false;
                 self->RotateBackground(self->m_rotation, dst_data);
+                self->PrepareTripLines();
+
+                // The trip line and the widgets which LVGL draws after this event go on top
+                // of the background, so it has to be done before them
+                self->m_parent.m_affine_blitter.WaitForDone();
+                self->DrawTripLines(layer);
             }
         },
         LV_EVENT_DRAW_MAIN,
@@ -293,34 +352,50 @@ MapScreen::SetZoom(uint8_t zoom)
         OsmPointToPoint(m_parent.m_state_cache.Get<AS::pixel_position>(), m_zoom);
     // And store the center of the range circle
     m_current_range_circle_center = m_current_view_center;
+    m_prepared_view.reset();
+}
+
+void
+MapScreen::OnActivation()
+{
+    // Tiles might have been evicted while on another screen
+    m_prepared_view.reset();
+}
+
+void
+MapScreen::OnDeactivation()
+{
+    // The tiles of the last frame stay pinned until the next, so release them for the
+    // other screens. Nothing is blitted from them after the background blits.
+    WaitForBackgroundBlits();
+    m_blit_ops.clear();
+    m_tile_cache.BeginFrame();
+
+    ScreenBase::OnDeactivation();
 }
 
 void
 MapScreen::RotateBackground(int32_t angle_deg, uint16_t* dst)
 {
-    const float angle_rad = static_cast<float>(angle_deg) * std::numbers::pi_v<float> / 180.0f;
-    const float cos_a = ::cosf(angle_rad);
-    const float sin_a = ::sinf(angle_rad);
-    // Rotate around a configurable display pivot (follow anchor in follow mode).
-    const int cx = m_rotation_pivot_x;
-    const int cy = m_rotation_pivot_y;
-    // Always rotate around the loaded view center in source space.
-    const int scx = kBgSize / 2;
-    const int scy = kBgSize / 2;
-    const uint16_t* src = m_background.WritableData16();
-    for (int dy = 0; dy < hal::kDisplayHeight; ++dy)
-    {
-        const float fy = static_cast<float>(dy - cy);
-        for (int dx = 0; dx < hal::kDisplayWidth; ++dx)
-        {
-            const float fx = static_cast<float>(dx - cx);
-            const int sx = static_cast<int>(cos_a * fx + sin_a * fy) + scx;
-            const int sy = static_cast<int>(-sin_a * fx + cos_a * fy) + scy;
-            dst[dy * hal::kDisplayWidth + dx] = (sx >= 0 && sx < kBgSize && sy >= 0 && sy < kBgSize)
-                                                    ? src[sy * kBgSize + sx]
-                                                    : 0x0000;
-        }
-    }
+    // Rotate around a configurable display pivot (follow anchor in follow mode), and always
+    // around the loaded view center in source space.
+    m_parent.m_affine_blitter.Blit(hal::AffineBlitOperation {
+        .src_data = m_background.WritableData16(),
+        .src_width = kBgSize,
+        .src_height = kBgSize,
+        .src_origin_x = m_background_origin.x % kBgSize,
+        .src_origin_y = m_background_origin.y % kBgSize,
+        .dst_data = dst,
+        .dst_width = hal::kDisplayWidth,
+        .dst_height = hal::kDisplayHeight,
+        .angle_deg = angle_deg,
+        .scale = 1.0f,
+        .pivot_x = m_rotation_pivot_x,
+        .pivot_y = m_rotation_pivot_y,
+        .src_center_x = kBgSize / 2,
+        .src_center_y = kBgSize / 2,
+        .bilinear = kBilinearRotation,
+    });
 }
 
 void
@@ -358,13 +433,41 @@ MapScreen::Update()
     }
 
 
-    if (m_rotation_enabled)
+    auto view = MapView {
+        .center_x = m_current_view_center.x,
+        .center_y = m_current_view_center.y,
+        .zoom = m_zoom,
+        .rotation = m_rotation,
+        .pivot_x = m_rotation_pivot_x,
+        .pivot_y = m_rotation_pivot_y,
+        .rotation_enabled = m_rotation_enabled,
+        .range_km = m_zoom == kLandscapeZoom ? ro.Get<AS::estimated_range_km>() : 0,
+        .trip_log_revision = m_parent.m_trip_computer.GetDisplayLogRevision(m_zoom),
+    };
+
+    // New tiles replace the placeholders, so the map has to be redrawn
+    if (m_tile_state_cache.Pull().IsChanged<AS::tile_loaded>())
     {
-        BlitToRotationBuffer();
+        m_prepared_view.reset();
     }
-    else
+
+    // Only redo the blits and redraw the map when something it shows has changed. The dot,
+    // home icon and navigation box invalidate their own areas when they change.
+    auto map_changed = m_prepared_view != view;
+    if (map_changed)
     {
-        PrepareNonRotatedBlits();
+        if (m_rotation_enabled)
+        {
+            // Tiles arriving, a new zoom or coming from the non-rotated view invalidates
+            // the whole background
+            BlitToRotationBuffer(!m_prepared_view || !m_prepared_view->rotation_enabled ||
+                                 m_prepared_view->zoom != m_zoom);
+        }
+        else
+        {
+            PrepareNonRotatedBlits();
+        }
+        m_prepared_view = view;
     }
 
     // Calculate the center of the display
@@ -410,8 +513,11 @@ MapScreen::Update()
     auto state_hash = ro.Get<AS::current_icon_hash>();
     auto navigation_active = ro.Get<AS::navigation_active>();
 
-    lv_obj_set_flag(m_navigation_box, LV_OBJ_FLAG_HIDDEN, !navigation_active);
-    lv_obj_set_flag(m_navigation_description_box, LV_OBJ_FLAG_HIDDEN, !navigation_active);
+    if (lv_obj_has_flag(m_navigation_box, LV_OBJ_FLAG_HIDDEN) == navigation_active)
+    {
+        lv_obj_set_flag(m_navigation_box, LV_OBJ_FLAG_HIDDEN, !navigation_active);
+        lv_obj_set_flag(m_navigation_description_box, LV_OBJ_FLAG_HIDDEN, !navigation_active);
+    }
 
     if (m_current_icon_hash != state_hash)
     {
@@ -422,11 +528,23 @@ MapScreen::Update()
         }
     }
 
-    lv_label_set_text(m_description_label, std::format("{}", *ro.Get<AS::next_street>()).c_str());
-    lv_label_set_text(m_distance_left_label,
-                      std::format("{} m", ro.Get<AS::distance_to_next>()).c_str());
+    // Setting the text invalidates the label, even if it's the same
+    if (auto next_street = std::format("{}", *ro.Get<AS::next_street>());
+        next_street != m_current_next_street)
+    {
+        m_current_next_street = std::move(next_street);
+        lv_label_set_text(m_description_label, m_current_next_street->c_str());
+    }
+    if (auto distance = ro.Get<AS::distance_to_next>(); distance != m_current_distance_to_next)
+    {
+        m_current_distance_to_next = distance;
+        lv_label_set_text(m_distance_left_label, std::format("{} m", distance).c_str());
+    }
 
-    lv_obj_invalidate(m_screen);
+    if (map_changed)
+    {
+        lv_obj_invalidate(m_screen);
+    }
 }
 
 
@@ -445,7 +563,9 @@ MapScreen::PrepareNonRotatedBlits()
     int start_y = m_current_view_center.y - display_cy;
 
     // Build blit ops; dst_data is filled in by the LV_EVENT_DRAW_MAIN callback at render time.
+    WaitForBackgroundBlits();
     m_blit_ops.clear();
+    m_tile_cache.BeginFrame();
 
     for (int y = 0; y < kNumTilesY; ++y)
     {
@@ -519,84 +639,132 @@ MapScreen::PrepareNonRotatedBlits()
 }
 
 void
-MapScreen::BlitToRotationBuffer()
+MapScreen::BlitToRotationBuffer(bool full_redraw)
 {
-    constexpr auto kNumTilesX = kMaxNumTilesX;
-    constexpr auto kNumTilesY = kMaxNumTilesY;
-
-    // Blit tiles directly into the oversized background buffer.
-    uint16_t* bg = m_background.WritableData16();
-
-    // Top-left of the oversized background buffer in OSM pixel coordinates
+    // Top-left of the oversized background view in OSM pixel coordinates
     const int start_x = m_current_view_center.x - kBgSize / 2;
     const int start_y = m_current_view_center.y - kBgSize / 2;
+    const int dx = start_x - m_background_origin.x;
+    const int dy = start_y - m_background_origin.y;
 
+    WaitForBackgroundBlits();
     m_blit_ops.clear();
+    m_tile_cache.BeginFrame();
 
-    for (int y = 0; y < kNumTilesY; ++y)
+    m_background_origin = Point {start_x, start_y, m_zoom};
+
+    // The ring already holds everything but the newly entered columns and rows. Limited to
+    // less than a tile to keep the number of blits within m_blit_ops.
+    if (full_redraw || std::abs(dx) >= kTileSize || std::abs(dy) >= kTileSize)
     {
-        const int tile_y = (start_y / kTileSize) + y;
-        const int tile_pixel_y = tile_y * kTileSize;
-        int32_t dst_offset_y = tile_pixel_y - start_y;
-        int32_t src_offset_y = 0;
+        QueueBackgroundBlits(0, 0, kBgSize, kBgSize);
+    }
+    else
+    {
+        // The entered columns over the full height, then the entered rows beside them
+        const int columns_x = dx > 0 ? kBgSize - dx : 0;
+        const int rows_x = dx > 0 ? 0 : -dx;
+        const int rows_y = dy > 0 ? kBgSize - dy : 0;
 
-        int32_t clipped_height = kTileSize;
-        clipped_height = std::min(clipped_height, kBgSize - dst_offset_y);
+        QueueBackgroundBlits(columns_x, 0, std::abs(dx), kBgSize);
+        QueueBackgroundBlits(rows_x, rows_y, kBgSize - std::abs(dx), std::abs(dy));
+    }
 
-        if (dst_offset_y < 0)
-        {
-            src_offset_y = -dst_offset_y;
-            clipped_height += dst_offset_y;
-            dst_offset_y = 0;
-        }
-        if (clipped_height <= 0)
-        {
-            continue;
-        }
+    m_parent.m_blitter.BlitOperations(
+        std::span<const hal::BlitOperation> {m_blit_ops.data(), m_blit_ops.size()});
+    m_background_blits_pending = true;
+}
 
-        for (int x = 0; x < kNumTilesX; ++x)
-        {
-            const int tile_x = (start_x / kTileSize) + x;
-            const int tile_pixel_x = tile_x * kTileSize;
-            int32_t dst_offset_x = tile_pixel_x - start_x;
-            int32_t src_offset_x = 0;
-            int32_t clipped_width = kTileSize;
+void
+MapScreen::WaitForBackgroundBlits()
+{
+    // The previous frame might not have been drawn yet, so its tiles can still be in use.
+    // Otherwise the draw has waited for them, and only the display flush is left in the
+    // blitter, which can keep running while this frame is prepared.
+    if (m_background_blits_pending)
+    {
+        m_parent.m_blitter.WaitForBlitsDone();
+        m_background_blits_pending = false;
+    }
+}
 
-            if (dst_offset_x < 0)
-            {
-                src_offset_x = -dst_offset_x;
-                clipped_width += dst_offset_x;
-                dst_offset_x = 0;
-            }
-            clipped_width = std::min(clipped_width, kBgSize - dst_offset_x);
+void
+MapScreen::QueueBackgroundBlits(int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    uint16_t* bg = m_background.WritableData16();
 
-            if (clipped_width <= 0)
+    const auto start_x = m_background_origin.x;
+    const auto start_y = m_background_origin.y;
+
+    // Where the view wraps around in the ring
+    const auto seam_x = kBgSize - start_x % kBgSize;
+    const auto seam_y = kBgSize - start_y % kBgSize;
+
+    // [from, to) of the view, and the offset from there to the ring position
+    struct Span
+    {
+        int32_t from;
+        int32_t to;
+        int32_t ring_offset;
+    };
+    const auto x_spans = std::array {
+        Span {x, std::min(x + width, seam_x), kBgSize - seam_x},
+        Span {std::max(x, seam_x), x + width, -seam_x},
+    };
+    const auto y_spans = std::array {
+        Span {y, std::min(y + height, seam_y), kBgSize - seam_y},
+        Span {std::max(y, seam_y), y + height, -seam_y},
+    };
+
+    for (const auto& y_span : y_spans)
+    {
+        for (const auto& x_span : x_spans)
+        {
+            if (x_span.from >= x_span.to || y_span.from >= y_span.to)
             {
                 continue;
             }
 
-            auto tile = m_tile_cache.GetTile(ToTile(Point {tile_pixel_x, tile_pixel_y, m_zoom}));
-
-            m_blit_ops.push_back(hal::BlitOperation {
-                .src_data = tile.Data16().data(),
-                .dst_data = bg,
-                .src_width = static_cast<int16_t>(tile.Width()),
-                .src_height = static_cast<int16_t>(tile.Height()),
-                .src_stride = static_cast<int16_t>(tile.Width()),
-                .src_offset_x = static_cast<int16_t>(src_offset_x),
-                .src_offset_y = static_cast<int16_t>(src_offset_y),
-                .dst_stride = static_cast<int16_t>(kBgSize),
-                .dst_height = static_cast<int16_t>(kBgSize),
-                .dst_offset_x = static_cast<int16_t>(dst_offset_x),
-                .dst_offset_y = static_cast<int16_t>(dst_offset_y),
-                .width = static_cast<int16_t>(clipped_width),
-                .height = static_cast<int16_t>(clipped_height),
-                .rotation = hal::Rotation::k0,
-            });
+            for (auto tile_y = (start_y + y_span.from) / kTileSize;
+                 tile_y * kTileSize < start_y + y_span.to;
+                 ++tile_y)
+            {
+                const auto tile_pixel_y = tile_y * kTileSize;
+                // The part of the tile inside the span, in view coordinates
+                const auto top = std::max(tile_pixel_y - start_y, y_span.from);
+                const auto bottom = std::min(tile_pixel_y + kTileSize - start_y, y_span.to);
+
+                for (auto tile_x = (start_x + x_span.from) / kTileSize;
+                     tile_x * kTileSize < start_x + x_span.to;
+                     ++tile_x)
+                {
+                    const auto tile_pixel_x = tile_x * kTileSize;
+                    const auto left = std::max(tile_pixel_x - start_x, x_span.from);
+                    const auto right = std::min(tile_pixel_x + kTileSize - start_x, x_span.to);
+
+                    auto tile =
+                        m_tile_cache.GetTile(ToTile(Point {tile_pixel_x, tile_pixel_y, m_zoom}));
+
+                    m_blit_ops.push_back(hal::BlitOperation {
+                        .src_data = tile.Data16().data(),
+                        .dst_data = bg,
+                        .src_width = static_cast<int16_t>(tile.Width()),
+                        .src_height = static_cast<int16_t>(tile.Height()),
+                        .src_stride = static_cast<int16_t>(tile.Width()),
+                        .src_offset_x = static_cast<int16_t>(left - (tile_pixel_x - start_x)),
+                        .src_offset_y = static_cast<int16_t>(top - (tile_pixel_y - start_y)),
+                        .dst_stride = static_cast<int16_t>(kBgSize),
+                        .dst_height = static_cast<int16_t>(kBgSize),
+                        .dst_offset_x = static_cast<int16_t>(left + x_span.ring_offset),
+                        .dst_offset_y = static_cast<int16_t>(top + y_span.ring_offset),
+                        .width = static_cast<int16_t>(right - left),
+                        .height = static_cast<int16_t>(bottom - top),
+                        .rotation = hal::Rotation::k0,
+                    });
+                }
+            }
         }
     }
-    m_parent.m_blitter.BlitOperations(
-        std::span<const hal::BlitOperation> {m_blit_ops.data(), m_blit_ops.size()});
 }
 
 os::TimerHandle
@@ -3,9 +3,14 @@
 #include "base_thread.hh"
 #include "os/memory.hh"
 #include "painter.hh"
+#include "polyline_rasterizer.hh"
+#include "trip_polyline.hh"
 #include "user_interface.hh"
 
 #include <etl/vector.h>
+#include <optional>
+#include <string>
+#include <vector>
 
 class MapScreen : public UserInterface::ScreenBase
 {
@@ -17,14 +22,37 @@ public:
     void SetZoom(uint8_t zoom);
 
 private:
+    // Everything the map itself (tiles, trip lines and range circle) is drawn from
+    struct MapView
+    {
+        int32_t center_x;
+        int32_t center_y;
+        uint8_t zoom;
+        uint16_t rotation;
+        int32_t pivot_x;
+        int32_t pivot_y;
+        bool rotation_enabled;
+        uint32_t range_km;
+        uint32_t trip_log_revision;
+
+        bool operator==(const MapView& other) const = default;
+    };
+
     void DrawRangeCircle(lv_layer_t* layer, uint32_t estimated_range_km, uint8_t width);
+    // Transform the visible part of the trip to the display, without touching the frame
+    void PrepareTripLines();
     void DrawTripLines(lv_layer_t* layer);
 
     os::TimerHandle StartHomeHoldTimer();
-    void BlitToRotationBuffer();
+    void BlitToRotationBuffer(bool full_redraw);
+    void QueueBackgroundBlits(int32_t x, int32_t y, int32_t width, int32_t height);
     void PrepareNonRotatedBlits();
+    void WaitForBackgroundBlits();
     void RotateBackground(int32_t angle_deg10, uint16_t* dst);
 
+    void OnActivation() final;
+    void OnDeactivation() final;
+
     void Update() final;
     void HandleInput(const Input::Event& event) final;
     void SetHelp(bool on) final;
@@ -33,15 +61,25 @@ private:
     // Source buffer is the display diagonal squared so any rotation angle fills the screen
     static constexpr int kBgSize =
         960; // >= diagonal and divisible by 8 for cache-line-safe RGB565 buffer size
+    static constexpr int kTripLineWidth = 5;
+    // Smoother, but roughly three times as expensive per pixel
+    static constexpr bool kBilinearRotation = false;
     static constexpr int kMaxNumTilesX = (kBgSize + kTileSize - 1) / kTileSize + 1;
     static constexpr int kMaxNumTilesY = (kBgSize + kTileSize - 1) / kTileSize + 1;
 
-    etl::vector<hal::BlitOperation, kMaxNumTilesX * kMaxNumTilesY> m_blit_ops;
+    // One more per direction, for tiles split at the seam of the background ring
+    etl::vector<hal::BlitOperation, (kMaxNumTilesX + 1) * (kMaxNumTilesY + 1)> m_blit_ops;
+    // Blits into the background which haven't been waited for by a draw yet
+    bool m_background_blits_pending {false};
 
     ImageCache& m_image_cache;
     TileCache& m_tile_cache;
 
-    SingleColorImage m_background {kBgSize, kBgSize, 2, 0x0000}; // Oversized for rotation
+    // Oversized for rotation, and a ring buffer which wraps around in both directions. The
+    // OSM pixel (x, y) is stored at (x % kBgSize, y % kBgSize).
+    SingleColorImage m_background {kBgSize, kBgSize, 2, 0x0000};
+    // OSM pixel at the top-left of the background view
+    Point m_background_origin {0, 0, kDefaultZoom};
     SingleColorImage m_background_rotated {
         hal::kDisplayWidth, hal::kDisplayHeight, 2, 0x0000}; // Rotated view target
 
@@ -50,6 +88,8 @@ private:
 
     // Related to the navigation
     uint32_t m_current_icon_hash {kInvalidIconHash};
+    std::optional<std::string> m_current_next_street;
+    std::optional<uint32_t> m_current_distance_to_next;
     lv_obj_t* m_navigation_box {nullptr};
     lv_obj_t* m_navigation_description_box {nullptr};
     lv_obj_t* m_current_icon {nullptr};
@@ -57,6 +97,13 @@ private:
     lv_obj_t* m_distance_left_label {nullptr};
     lv_obj_t* m_home_label {nullptr};
 
+    TripPolyline m_trip_polyline;
+    // Reused between frames, to avoid allocating while drawing
+    std::vector<polyline_rasterizer::Vertex> m_trip_vertices;
+    // Where each run of connected vertices ends
+    std::vector<size_t> m_trip_runs;
+    polyline_rasterizer::Scratch m_polyline_scratch;
+
     Point m_current_view_center {0, 0, kDefaultZoom};
     Point m_current_range_circle_center {0, 0, kDefaultZoom};
     int32_t m_rotation_pivot_x {hal::kDisplayWidth / 2};
@@ -71,6 +118,10 @@ private:
 
     bool m_touch_was_pressed {false};
 
+    ApplicationState::PartialReadOnlyCache<AS::tile_loaded> m_tile_state_cache;
+    // The view the current blits were prepared for, or nothing when they must be redone
+    std::optional<MapView> m_prepared_view;
+
     uint8_t m_zoom;
     bool m_rotation_enabled {false};
 };
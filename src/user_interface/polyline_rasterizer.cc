@@ -0,0 +1,532 @@
+#include "polyline_rasterizer.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <limits>
+#include <optional>
+
+using namespace polyline_rasterizer;
+using polyline_rasterizer::detail::Segment;
+using polyline_rasterizer::detail::Span;
+
+namespace
+{
+
+// RGB565 spread out as 0b00000gggggg00000rrrrr000000bbbbb, with room for a 5-bit alpha
+constexpr uint32_t kSpreadMask = 0x07e0f81f;
+constexpr uint32_t kAlphaShift = 5;
+constexpr uint32_t kOpaque = 1u << kAlphaShift;
+
+// Segments are clipped this far outside of the target, which keeps the coordinates small
+// without moving the visible part of typical segments
+constexpr int32_t kClipMargin = 1024;
+
+// Vertices are clamped to this, which is further than any position at kDefaultZoom can be
+// from the view, so that the exact clipping math stays within int64
+constexpr int32_t kMaxCoordinate = 1 << 24;
+
+// Rings are drawn at most this large, which keeps the squared distances of their edges
+// within 64 bits in 1/256 half pixels
+constexpr int32_t kMaxRingRadius = 1 << 20;
+
+// Distances from the stroke are in 1/256 half pixels
+constexpr int32_t kDistanceShift = 8;
+constexpr int64_t kFar = std::numeric_limits<int64_t>::max();
+
+// Unit normals of the segments are in 2.30 fixed point
+constexpr int32_t kNormalShift = 30;
+
+uint32_t
+Spread(uint16_t pixel)
+{
+    return (pixel | (static_cast<uint32_t>(pixel) << 16)) & kSpreadMask;
+}
+
+void
+Blend(uint16_t& dst, uint16_t color, uint32_t alpha)
+{
+    if (alpha >= kOpaque)
+    {
+        dst = color;
+        return;
+    }
+
+    auto blended =
+        ((Spread(dst) * (kOpaque - alpha) + Spread(color) * alpha) >> kAlphaShift) & kSpreadMask;
+    dst = static_cast<uint16_t>(blended | (blended >> 16));
+}
+
+// Coverage of a pixel at a distance (in 1/256 half pixels) from the middle of a stroke
+uint32_t
+EdgeAlpha(int64_t half_width, int64_t distance)
+{
+    // (half_width + 1 - distance) / 2 of the pixel is covered, rounded to kOpaque steps
+    constexpr auto kShift = kDistanceShift + 1 - kAlphaShift;
+    auto coverage = ((half_width + 1) << kDistanceShift) - distance;
+
+    return static_cast<uint32_t>(
+        std::clamp<int64_t>((coverage + (1 << (kShift - 1))) >> kShift, 0, kOpaque));
+}
+
+// Rounded down
+template <typename T>
+T
+SquareRoot(T value)
+{
+    T root = 0;
+    // The highest power of four at most value
+    T bit = value == 0 ? 0 : T {1} << ((std::bit_width(value) - 1) & ~1);
+
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+uint64_t
+CeilSquareRoot(uint64_t value)
+{
+    auto root = SquareRoot(value);
+
+    return root * root < value ? root + 1 : root;
+}
+
+int64_t
+ToHalfPixels(int32_t pixel)
+{
+    return 2 * static_cast<int64_t>(std::clamp(pixel, -kMaxCoordinate, kMaxCoordinate)) + 1;
+}
+
+int64_t
+FloorHalf(int64_t value)
+{
+    return value >= 0 ? value / 2 : -((1 - value) / 2);
+}
+
+// For a positive denominator
+int64_t
+DivideRounded(int64_t numerator, int64_t denominator)
+{
+    auto half = denominator / 2;
+
+    return numerator >= 0 ? (numerator + half) / denominator
+                          : -((half - numerator) / denominator);
+}
+
+// The pixels (clamped to [0, size)) whose centers are within [from, to], in half pixels
+std::pair<int32_t, int32_t>
+PixelRange(int64_t from, int64_t to, int32_t size)
+{
+    auto first = -FloorHalf(1 - from);
+    auto last = FloorHalf(to - 1);
+
+    return {static_cast<int32_t>(std::max<int64_t>(first, 0)),
+            static_cast<int32_t>(std::min<int64_t>(last, size - 1))};
+}
+
+// A position along a segment, as numerator / denominator with a positive denominator
+struct Fraction
+{
+    int64_t numerator;
+    int64_t denominator;
+};
+
+bool
+IsBefore(const Fraction& a, const Fraction& b)
+{
+    return a.numerator * b.denominator < b.numerator * a.denominator;
+}
+
+// Liang-Barsky, against the target extended by kClipMargin. The clipped ends are rounded to
+// half pixels.
+std::optional<Segment>
+ClipSegment(const Target& dst, const Vertex& from, const Vertex& to)
+{
+    const auto min_x = ToHalfPixels(-kClipMargin);
+    const auto min_y = min_x;
+    const auto max_x = ToHalfPixels(dst.width - 1 + kClipMargin);
+    const auto max_y = ToHalfPixels(dst.height - 1 + kClipMargin);
+
+    const auto x0 = ToHalfPixels(from.x);
+    const auto y0 = ToHalfPixels(from.y);
+    const auto dx = ToHalfPixels(to.x) - x0;
+    const auto dy = ToHalfPixels(to.y) - y0;
+    auto t0 = Fraction {0, 1};
+    auto t1 = Fraction {1, 1};
+
+    // Keeps the part where p * t <= q
+    auto clip = [&](int64_t p, int64_t q) {
+        if (p == 0)
+        {
+            return q >= 0;
+        }
+
+        if (p < 0)
+        {
+            auto r = Fraction {-q, -p};
+            t0 = IsBefore(t0, r) ? r : t0;
+        }
+        else
+        {
+            auto r = Fraction {q, p};
+            t1 = IsBefore(r, t1) ? r : t1;
+        }
+        return !IsBefore(t1, t0);
+    };
+
+    if (!clip(-dx, x0 - min_x) || !clip(dx, max_x - x0) || !clip(-dy, y0 - min_y) ||
+        !clip(dy, max_y - y0))
+    {
+        return std::nullopt;
+    }
+
+    auto at = [](int64_t origin, int64_t delta, const Fraction& t) {
+        return origin + DivideRounded(delta * t.numerator, t.denominator);
+    };
+    auto out = Segment {
+        .ax = at(x0, dx, t0),
+        .ay = at(y0, dy, t0),
+        .bx = at(x0, dx, t1),
+        .by = at(y0, dy, t1),
+        .normal_x = 0,
+        .normal_y = 0,
+        .length_squared = 0,
+        .color = to.color,
+        .first_row = 0,
+        .last_row = 0,
+    };
+
+    auto abx = out.bx - out.ax;
+    auto aby = out.by - out.ay;
+    out.length_squared = abx * abx + aby * aby;
+    if (out.length_squared > 0)
+    {
+        // With 15 fractional bits, which leaves 30 for the normal
+        constexpr auto kLengthShift = kNormalShift / 2;
+        constexpr auto kScale = int64_t {1} << (kNormalShift + kLengthShift);
+        auto length = static_cast<int64_t>(
+            SquareRoot(static_cast<uint64_t>(out.length_squared) << (2 * kLengthShift)));
+
+        out.normal_x = static_cast<int32_t>(-aby * kScale / length);
+        out.normal_y = static_cast<int32_t>(abx * kScale / length);
+    }
+
+    return out;
+}
+
+// From a pixel center, in 1/256 half pixels. kFar if it's at least limit half pixels away.
+int64_t
+Distance(const Segment& s, int64_t px, int64_t py, int64_t limit)
+{
+    auto apx = px - s.ax;
+    auto apy = py - s.ay;
+    auto t = apx * (s.bx - s.ax) + apy * (s.by - s.ay);
+
+    if (t > 0 && t < s.length_squared)
+    {
+        // The cross product with the unit normal, so no divide by the length
+        return std::abs(apx * s.normal_x + apy * s.normal_y) >> (kNormalShift - kDistanceShift);
+    }
+
+    // Past an end, where the stroke is round. With kMaxWidth, this fits in 32 bits.
+    auto ex = t <= 0 ? apx : px - s.bx;
+    auto ey = t <= 0 ? apy : py - s.by;
+    auto squared = ex * ex + ey * ey;
+    if (squared >= limit * limit)
+    {
+        return kFar;
+    }
+
+    return SquareRoot(static_cast<uint32_t>(squared) << (2 * kDistanceShift));
+}
+
+/*
+ * The distance of ring pixels from the middle of the stroke, from their squared distance
+ * to the center. With e that distance and q = d^2 - r^2 = e * (2r + e), the series
+ * e = q / 2r - (q / 2r)^2 / 2r is off by about e^3 / 2r^2, so the edges need no square root
+ * unless the ring is small for its width.
+ */
+class RingDistance
+{
+public:
+    RingDistance(int64_t radius, int64_t half_width)
+        : m_radius(radius)
+        , m_radius_squared(radius * radius)
+        , m_inverse(radius > 0 ? kInverseOne / (2 * radius) : 0)
+        // Within 1/16 half pixel (an alpha step) at the edges, which are up to half_width + 1
+        // from the middle
+        , m_exact(radius * radius < 8 * (half_width + 1) * (half_width + 1) * (half_width + 1))
+    {
+    }
+
+    // In 1/256 half pixels, from the squared distance in half pixels
+    int64_t operator()(int64_t distance_squared) const
+    {
+        if (m_exact)
+        {
+            auto distance = SquareRoot(static_cast<uint64_t>(distance_squared)
+                                       << (2 * kDistanceShift));
+            return std::abs(static_cast<int64_t>(distance) - (m_radius << kDistanceShift));
+        }
+
+        constexpr auto kShift = kInverseShift - kDistanceShift;
+        auto q = distance_squared - m_radius_squared;
+        auto first = (q * m_inverse) >> kShift;
+        auto second = ((first * first) >> kDistanceShift) * m_inverse >> kInverseShift;
+
+        return std::abs(first - second);
+    }
+
+private:
+    static constexpr int32_t kInverseShift = 32;
+    static constexpr int64_t kInverseOne = int64_t {1} << kInverseShift;
+
+    const int64_t m_radius;
+    const int64_t m_radius_squared;
+    // 1 / 2r in 32.32 fixed point
+    const int64_t m_inverse;
+    const bool m_exact;
+};
+
+// The x range (in half pixels) of the segment between the rows y_from and y_to
+std::pair<int64_t, int64_t>
+SegmentXRange(const Segment& s, int64_t y_from, int64_t y_to)
+{
+    auto y_min = std::min(s.ay, s.by);
+    auto y_max = std::max(s.ay, s.by);
+
+    if (s.ay == s.by)
+    {
+        return {std::min(s.ax, s.bx), std::max(s.ax, s.bx)};
+    }
+
+    auto x_at = [&s](int64_t y) {
+        return s.ax + (y - s.ay) * (s.bx - s.ax) / (s.by - s.ay);
+    };
+    auto x0 = x_at(std::clamp(y_from, y_min, y_max));
+    auto x1 = x_at(std::clamp(y_to, y_min, y_max));
+
+    return {std::min(x0, x1), std::max(x0, x1)};
+}
+
+} // namespace
+
+namespace polyline_rasterizer
+{
+
+void
+DrawPolyline(const Target& dst,
+             std::span<const Vertex> vertices,
+             int32_t width,
+             Scratch& scratch)
+{
+    if (vertices.size() < 2 || width <= 0)
+    {
+        return;
+    }
+
+    if (vertices.size() > kMaxVertices)
+    {
+        // The joins between the parts are blended twice
+        DrawPolyline(dst, vertices.first(kMaxVertices), width, scratch);
+        DrawPolyline(dst, vertices.subspan(kMaxVertices - 1), width, scratch);
+        return;
+    }
+
+    // The half width in half pixels, and how far from the line pixels are touched
+    const int64_t half_width = std::min(width, kMaxWidth);
+    const int64_t reach = half_width + 1;
+    const auto full = (half_width - 1) << kDistanceShift;
+    const auto none = reach << kDistanceShift;
+
+    auto& segments = scratch.segments;
+    segments.clear();
+    for (auto i = 1u; i < vertices.size(); i++)
+    {
+        auto segment = ClipSegment(dst, vertices[i - 1], vertices[i]);
+        if (!segment)
+        {
+            continue;
+        }
+
+        auto [first_row, last_row] = PixelRange(std::min(segment->ay, segment->by) - reach,
+                                                 std::max(segment->ay, segment->by) + reach,
+                                                 dst.height);
+        segment->first_row = first_row;
+        segment->last_row = last_row;
+        if (first_row <= last_row)
+        {
+            segments.push_back(*segment);
+        }
+    }
+
+    if (segments.empty())
+    {
+        return;
+    }
+
+    auto first_row = std::ranges::min(segments, {}, &Segment::first_row).first_row;
+    auto last_row = std::ranges::max(segments, {}, &Segment::last_row).last_row;
+
+    auto& spans = scratch.spans;
+    auto& members = scratch.members;
+
+    for (auto y = first_row; y <= last_row; y++)
+    {
+        const int64_t center_y = 2 * y + 1;
+
+        spans.clear();
+        for (auto i = 0u; i < segments.size(); i++)
+        {
+            const auto& segment = segments[i];
+            if (y < segment.first_row || y > segment.last_row)
+            {
+                continue;
+            }
+
+            auto [x_from, x_to] = SegmentXRange(segment, center_y - reach, center_y + reach);
+            auto [left, right] = PixelRange(x_from - reach, x_to + reach, dst.width);
+            if (left <= right)
+            {
+                spans.push_back(Span {left, right, i});
+            }
+        }
+        std::ranges::sort(spans, {}, &Span::left);
+
+        auto* row = dst.data + y * dst.width;
+        auto draw_merged = [&](int32_t left, int32_t right) {
+            for (auto x = left; x <= right; x++)
+            {
+                const int64_t center_x = 2 * x + 1;
+                auto closest = kFar;
+                auto color = uint16_t {0};
+
+                for (auto member : members)
+                {
+                    auto distance = Distance(segments[member], center_x, center_y, reach);
+                    if (distance <= closest)
+                    {
+                        closest = distance;
+                        color = segments[member].color;
+                    }
+                }
+
+                if (closest <= full)
+                {
+                    row[x] = color;
+                }
+                else if (closest < none)
+                {
+                    Blend(row[x], color, EdgeAlpha(half_width, closest));
+                }
+            }
+        };
+
+        // Merge overlapping spans, so that every pixel is visited once
+        auto left = 0;
+        auto right = -1;
+        members.clear();
+        for (const auto& span : spans)
+        {
+            if (span.left > right)
+            {
+                draw_merged(left, right);
+                members.clear();
+                left = span.left;
+            }
+            right = std::max(right, span.right);
+            members.push_back(span.segment);
+        }
+        draw_merged(left, right);
+    }
+}
+
+void
+DrawRing(const Target& dst,
+         int32_t center_x,
+         int32_t center_y,
+         int32_t radius,
+         int32_t width,
+         uint16_t color)
+{
+    if (width <= 0)
+    {
+        return;
+    }
+
+    // In half pixels
+    const int64_t cx = 2 * static_cast<int64_t>(center_x) + 1;
+    const int64_t cy = 2 * static_cast<int64_t>(center_y) + 1;
+    const int64_t r = 2 * static_cast<int64_t>(std::min(radius, kMaxRingRadius));
+    const int64_t half_width = std::min(width, kMaxWidth);
+
+    auto squared = [](int64_t v) { return v < 0 ? -1 : v * v; };
+    const auto outer_none = squared(r + half_width + 1);
+    const auto outer_full = squared(r + half_width - 1);
+    const auto inner_full = squared(r - half_width + 1);
+    const auto inner_none = squared(r - half_width - 1);
+    const auto edge_distance = RingDistance {r, half_width};
+
+    auto [first_row, last_row] =
+        PixelRange(cy - r - half_width - 1, cy + r + half_width + 1, dst.height);
+
+    for (auto y = first_row; y <= last_row; y++)
+    {
+        const auto dy = 2 * static_cast<int64_t>(y) + 1 - cy;
+        const auto dy_squared = dy * dy;
+        if (dy_squared >= outer_none)
+        {
+            continue;
+        }
+
+        auto* row = dst.data + y * dst.width;
+        auto draw_span = [&](int64_t from, int64_t to) {
+            auto [left, right] = PixelRange(from, to, dst.width);
+            for (auto x = left; x <= right; x++)
+            {
+                const auto dx = 2 * static_cast<int64_t>(x) + 1 - cx;
+                const auto distance_squared = dx * dx + dy_squared;
+
+                if (distance_squared >= outer_none || distance_squared <= inner_none)
+                {
+                    continue;
+                }
+                if (distance_squared <= outer_full && distance_squared >= inner_full)
+                {
+                    row[x] = color;
+                    continue;
+                }
+
+                Blend(row[x], color, EdgeAlpha(half_width, edge_distance(distance_squared)));
+            }
+        };
+
+        const auto outer_x = static_cast<int64_t>(CeilSquareRoot(outer_none - dy_squared));
+        if (dy_squared < inner_none)
+        {
+            // Two spans, beside the hole
+            const auto inner_x = static_cast<int64_t>(
+                SquareRoot(static_cast<uint64_t>(inner_none - dy_squared)));
+            draw_span(cx - outer_x, cx - inner_x);
+            draw_span(cx + inner_x, cx + outer_x);
+        }
+        else
+        {
+            draw_span(cx - outer_x, cx + outer_x);
+        }
+    }
+}
+
+} // namespace polyline_rasterizer
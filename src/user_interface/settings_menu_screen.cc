@@ -152,6 +152,14 @@ SettingsMenuScreen::OnActivation()
                                           .GetWritableReference<AS::configuration>()
                                           .recent_power_distance = static_cast<uint16_t>(value);
                                   });
+    settings_page.AddNumericEntry("Map tile max age (days)",
+                                  {0, 360, 15},
+                                  ro.Get<AS::configuration>()->tile_max_age_days,
+                                  [this](auto value) {
+                                      m_parent.m_state.CheckoutPartialSnapshot<AS::configuration>()
+                                          .GetWritableReference<AS::configuration>()
+                                          .tile_max_age_days = static_cast<uint16_t>(value);
+                                  });
     settings_page.AddBooleanEntry(
         "Show GPS speed", ro.Get<AS::configuration>()->show_gps_speed, [this](auto value) {
             m_parent.m_state.CheckoutPartialSnapshot<AS::configuration>()
@@ -182,6 +190,10 @@ SettingsMenuScreen::OnActivation()
         m_parent.ResetTrip();
         m_menu_screen->ExitMenu();
     });
+    main.AddEntry("Download map around home", [this]() {
+        m_parent.m_state.CheckoutReadWrite().Post<AS::download_home_region>();
+        m_menu_screen->ExitMenu();
+    });
     main.AddSeparator();
     main.AddBooleanEntry("Show help text", m_parent.m_help_enabled, [this](auto value) {
         m_parent.m_help_enabled = value;
@@ -203,6 +215,11 @@ SettingsMenuScreen::OnActivation()
 
     lv_obj_align_to(m_consumed_regen_label, m_odometer_label, LV_ALIGN_OUT_BOTTOM_LEFT, 0, 0);
 
+    m_map_download_label = lv_label_create(m_screen);
+    lv_obj_set_style_text_font(m_map_download_label, &radbuzz_font_22, LV_PART_MAIN);
+    lv_obj_set_style_text_align(m_map_download_label, LV_TEXT_ALIGN_LEFT, LV_PART_MAIN);
+    lv_obj_align_to(m_map_download_label, m_consumed_regen_label, LV_ALIGN_OUT_BOTTOM_LEFT, 0, 0);
+
 
     // No help while in the menu
     m_parent.HideHelp();
@@ -213,6 +230,7 @@ SettingsMenuScreen::OnDeactivation()
 {
     lv_obj_del(m_odometer_label);
     lv_obj_del(m_consumed_regen_label);
+    lv_obj_del(m_map_download_label);
 
     m_menu_screen = nullptr;
     if (m_parent.m_help_enabled)
@@ -233,6 +251,26 @@ SettingsMenuScreen::Update()
     lv_label_set_text(m_consumed_regen_label,
                       std::format("Consumed: -{:.1f}+{:.1f} kWh", consumed_kwh, regen_kwh).c_str());
     lv_obj_align_to(m_consumed_regen_label, m_odometer_label, LV_ALIGN_OUT_BOTTOM_LEFT, 0, 0);
+
+    auto download_done = ro.Get<AS::region_download_done>();
+    auto download_failed = ro.Get<AS::region_download_failed>();
+    auto download_total = ro.Get<AS::region_download_total>();
+    if (download_total > 0 && download_done + download_failed < download_total)
+    {
+        lv_label_set_text(
+            m_map_download_label,
+            std::format("Map download: {}/{} tiles", download_done, download_total).c_str());
+    }
+    else if (download_failed > 0)
+    {
+        lv_label_set_text(m_map_download_label,
+                          std::format("Map download: {} tiles failed", download_failed).c_str());
+    }
+    else
+    {
+        lv_label_set_text(m_map_download_label, "");
+    }
+    lv_obj_align_to(m_map_download_label, m_consumed_regen_label, LV_ALIGN_OUT_BOTTOM_LEFT, 0, 0);
 }
 
 void
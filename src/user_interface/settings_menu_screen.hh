@@ -17,6 +17,7 @@ private:
 
     lv_obj_t* m_odometer_label {nullptr};
     lv_obj_t* m_consumed_regen_label {nullptr};
+    lv_obj_t* m_map_download_label {nullptr};
 
     std::unique_ptr<MenuScreen> m_menu_screen;
 };
@@ -0,0 +1,40 @@
+#include "trip_polyline.hh"
+
+#include <algorithm>
+
+TripPolyline::TripPolyline()
+{
+    m_segments.reserve(TripComputer::kNumberOfDisplayLogEntries);
+}
+
+void
+TripPolyline::Update(std::span<const TripComputer::DisplayTripLogEntry> log,
+                     uint8_t zoom,
+                     uint32_t revision)
+{
+    m_segments.clear();
+    m_zoom = zoom;
+    m_revision = revision;
+
+    if (log.empty())
+    {
+        return;
+    }
+
+    auto last = OsmPointToPoint(log.front().position, zoom);
+    for (const auto& entry : log.subspan(1))
+    {
+        auto current = OsmPointToPoint(entry.position, zoom);
+
+        m_segments.push_back(Segment {
+            .from = last,
+            .to = current,
+            .power = entry.power,
+            .left = std::min(last.x, current.x),
+            .top = std::min(last.y, current.y),
+            .right = std::max(last.x, current.x),
+            .bottom = std::max(last.y, current.y),
+        });
+        last = current;
+    }
+}
@@ -7,6 +7,7 @@
 #include "speedometer_only_screen.hh"
 #include "trip_meter_screen.hh"
 
+#include <algorithm>
 #include <radbuzz_font_22.h>
 #include <radbuzz_symbols_40.h>
 
@@ -39,6 +40,7 @@ UserInterface::IndicatorBase::IndicatorBase(UserInterface& parent, const Point&
 
 UserInterface::UserInterface(hal::IDisplay& display,
                              hal::IBlitter& blitter,
+                             hal::IAffineBlitter& affine_blitter,
                              std::unique_ptr<hal::IPm::ILock> pm_lock,
                              hal::IInput& input,
                              ApplicationState& state,
@@ -47,6 +49,7 @@ UserInterface::UserInterface(hal::IDisplay& display,
                              TripComputer& trip_computer)
     : m_display(display)
     , m_blitter(blitter)
+    , m_affine_blitter(affine_blitter)
     , m_pm_lock(std::move(pm_lock))
     , m_input(input)
     , m_state(state)
@@ -134,6 +137,8 @@ UserInterface::OnStartup()
                 auto p = static_cast<UserInterface*>(lv_display_get_user_data(display));
                 auto frame_buffer = reinterpret_cast<uint16_t*>(px_map);
 
+                p->m_frame_pacer.OnFlushStart(os::GetTimeStampRaw());
+                p->m_flushed_frames++;
                 p->DrawPowerBar(frame_buffer);
                 if constexpr (hal::kDisplayRotation != hal::Rotation::k0)
                 {
@@ -143,13 +148,30 @@ UserInterface::OnStartup()
                     p->m_blitter.BlitOperations(
                         std::span<const hal::BlitOperation> {p->m_rotation_blit_operations.data(),
                                                              p->m_rotation_blit_operations.size()});
+
+                    if (!p->m_frame_pacer.ShouldTimeFlush())
+                    {
+                        // Finished by CompleteFlush() when LVGL flushes the next frame, which
+                        // is rendered in the meantime
+                        p->m_flush_pending = true;
+                        return;
+                    }
+                    // The blitter doesn't say when it's done, so wait for it now and then to
+                    // know how long the flush really takes
                     p->m_blitter.WaitForBlitsDone();
                 }
 
                 p->m_display.Flip();
+                p->m_frame_pacer.OnFlushDone(os::GetTimeStampRaw());
             }
             lv_display_flush_ready(display);
         });
+    lv_display_set_flush_wait_cb(m_lvgl_display, [](lv_display_t* display) {
+        static_cast<UserInterface*>(lv_display_get_user_data(display))->CompleteFlush();
+    });
+    // The frame pacer decides when to render, so LVGL shouldn't skip any of its frames
+    lv_timer_set_period(lv_display_get_refr_timer(m_lvgl_display),
+                        FramePacer::kActiveFrameInterval);
 
     m_lvgl_input_dev = lv_indev_create();
     lv_indev_set_mode(m_lvgl_input_dev, LV_INDEV_MODE_EVENT);
@@ -357,9 +379,11 @@ UserInterface::OnActivation()
     }
 
     Input::Event input_event;
+    auto had_input = false;
 
     while (m_input_queue.pop(input_event))
     {
+        had_input = true;
         auto event = input_event.type;
 
         m_enc_diff = 0;
@@ -429,20 +453,73 @@ UserInterface::OnActivation()
         bubble->Update();
     }
 
-    if (auto time_before = os::GetTimeStampRaw(); m_next_redraw_time > time_before)
+    // Woken up before the next frame was due, by new state, tiles or input. Render that
+    // without waiting for the idle frame interval.
+    auto now = os::GetTimeStampRaw();
+    if (static_cast<int32_t>(m_next_frame_time - now) > 0)
     {
-        // Wait for the next redraw
-        return milliseconds(m_next_redraw_time - time_before);
+        m_woken_early = true;
     }
-    auto delay = lv_timer_handler();
-    m_next_redraw_time = os::GetTimeStampRaw() + delay;
 
-    if (lv_display_get_screen_loading(m_lvgl_display) ||
-        // Half a second of activity on input (for animations)
-        lv_display_get_inactive_time(m_lvgl_display) < 500)
+    // Being woken doesn't keep the frame rate up by itself, only input and changes on the
+    // display (through the flushes) do
+    const auto active = had_input || lv_display_get_screen_loading(m_lvgl_display) ||
+                        // Half a second of activity on input (for animations)
+                        lv_display_get_inactive_time(m_lvgl_display) < 500;
+
+    if (auto delay = m_frame_pacer.TimeUntilNextFrame(now, active || m_woken_early); delay > 0)
     {
+        // Show the last frame while waiting for the next
+        CompleteFlush();
+
+        m_next_frame_time = now + delay;
         return milliseconds(delay);
     }
 
-    return std::nullopt;
+    auto flushed_frames = m_flushed_frames;
+
+    m_woken_early = false;
+    m_frame_pacer.OnRenderStart(now);
+    lv_timer_handler();
+
+    if (m_flushed_frames == flushed_frames)
+    {
+        // Nothing was rendered, so nothing will complete the flush of the last frame
+        CompleteFlush();
+    }
+
+    now = os::GetTimeStampRaw();
+    if (!m_flush_pending && !m_frame_pacer.IsActive(now, active))
+    {
+        // Nothing is changing, so sleep until new state or input wakes the thread
+        m_next_frame_time = now + FramePacer::kIdleFrameInterval;
+        return std::nullopt;
+    }
+
+    auto delay = m_frame_pacer.TimeUntilNextFrame(now, active);
+    if (m_flush_pending)
+    {
+        // Come back to show the frame, even if the next one isn't due yet
+        delay = std::min(delay, FramePacer::kActiveFrameInterval);
+    }
+
+    m_next_frame_time = now + delay;
+    return milliseconds(delay);
+}
+
+void
+UserInterface::CompleteFlush()
+{
+    if (!m_flush_pending)
+    {
+        return;
+    }
+
+    m_blitter.WaitForBlitsDone();
+    m_display.Flip();
+    m_flush_pending = false;
+
+    // Most likely done long before, so the time isn't that of the flush
+    m_frame_pacer.OnFlushDone(os::GetTimeStampRaw(), false);
+    lv_display_flush_ready(m_lvgl_display);
 }
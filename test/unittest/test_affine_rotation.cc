@@ -0,0 +1,348 @@
+#include "affine_blitter_host.hh"
+#include "affine_rotation.hh"
+#include "test.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+constexpr auto kSrcSize = 64;
+constexpr auto kDstWidth = 40;
+constexpr auto kDstHeight = 30;
+
+// The source position of (x, y) relative to the source center, as in the per-pixel float
+// loop which the user interface used before, with the scale added
+std::pair<float, float>
+BaselinePosition(const hal::AffineBlitOperation& params, int x, int y)
+{
+    const float angle_rad =
+        static_cast<float>(params.angle_deg) * std::numbers::pi_v<float> / 180.0f;
+    const float cos_a = ::cosf(angle_rad) / params.scale;
+    const float sin_a = ::sinf(angle_rad) / params.scale;
+    const float fx = static_cast<float>(x - params.pivot_x);
+    const float fy = static_cast<float>(y - params.pivot_y);
+
+    return {cos_a * fx + sin_a * fy, -sin_a * fx + cos_a * fy};
+}
+
+// The float loop truncates the position, and the kernel floors it. Every source pixel is
+// unique, so the one shown can be found from its value.
+void
+RequireCloseToBaseline(const std::vector<uint16_t>& dst,
+                       const std::vector<uint16_t>& src,
+                       const hal::AffineBlitOperation& params)
+{
+    // Of the 16.16 steps, for positions which are right at a pixel edge
+    constexpr auto kRounding = 1.0f / 256;
+
+    for (auto y = 0; y < kDstHeight; y++)
+    {
+        for (auto x = 0; x < kDstWidth; x++)
+        {
+            auto [fx, fy] = BaselinePosition(params, x, y);
+            auto sx = static_cast<int>(fx) + params.src_center_x;
+            auto sy = static_cast<int>(fy) + params.src_center_y;
+            auto inside = sx >= 0 && sx < kSrcSize && sy >= 0 && sy < kSrcSize;
+            auto pixel = dst[y * kDstWidth + x];
+
+            if (pixel == (inside ? src[sy * kSrcSize + sx] : 0x0000))
+            {
+                continue;
+            }
+
+            // Otherwise one pixel off, left of or above the source center
+            auto x_low = static_cast<int>(std::floor(fx - kRounding)) + params.src_center_x;
+            auto x_high = static_cast<int>(std::floor(fx + kRounding)) + params.src_center_x;
+            auto y_low = static_cast<int>(std::floor(fy - kRounding)) + params.src_center_y;
+            auto y_high = static_cast<int>(std::floor(fy + kRounding)) + params.src_center_y;
+            if (pixel == 0x0000)
+            {
+                REQUIRE((x_low < 0 || y_low < 0 || x_high >= kSrcSize || y_high >= kSrcSize));
+            }
+            else
+            {
+                auto index = static_cast<int>(pixel) - 1;
+
+                REQUIRE(index % kSrcSize >= x_low);
+                REQUIRE(index % kSrcSize <= x_high);
+                REQUIRE(index / kSrcSize >= y_low);
+                REQUIRE(index / kSrcSize <= y_high);
+            }
+        }
+    }
+}
+
+} // namespace
+
+// Friend of the host blitter, which runs its band threads on the test thread
+class AffineBlitterHostFixture
+{
+public:
+    void Blit(const hal::AffineBlitOperation& params)
+    {
+        hal::IAffineBlitter& blitter = host;
+
+        blitter.Blit(params);
+        for (auto& band_thread : host.m_band_threads)
+        {
+            band_thread->RotateBands();
+        }
+        blitter.WaitForDone();
+    }
+
+    AffineBlitterHost host;
+};
+
+TEST_SUITE_BEGIN("affine_rotation");
+
+TEST_CASE("the background is rotated with a fixed-point walker")
+{
+    std::vector<uint16_t> src(kSrcSize * kSrcSize);
+    std::vector<uint16_t> dst(kDstWidth * kDstHeight, 0x1234);
+    std::vector<uint16_t> banded(kDstWidth * kDstHeight, 0x1234);
+    for (auto i = 0u; i < src.size(); i++)
+    {
+        // Never black, so that uncovered pixels can be told apart
+        src[i] = static_cast<uint16_t>(i + 1);
+    }
+
+    hal::AffineBlitOperation params {
+        .src_data = src.data(),
+        .src_width = kSrcSize,
+        .src_height = kSrcSize,
+        .dst_data = dst.data(),
+        .dst_width = kDstWidth,
+        .dst_height = kDstHeight,
+        .angle_deg = 0,
+        .scale = 1.0f,
+        .pivot_x = kDstWidth / 2,
+        .pivot_y = kDstHeight / 2,
+        .src_center_x = kSrcSize / 2,
+        .src_center_y = kSrcSize / 2,
+        .bilinear = false,
+    };
+
+    WHEN("the angle is zero")
+    {
+        affine_rotation::Rotate(params);
+
+        THEN("the source is copied around the pivot")
+        {
+            for (auto y = 0; y < kDstHeight; y++)
+            {
+                for (auto x = 0; x < kDstWidth; x++)
+                {
+                    auto sx = x - kDstWidth / 2 + kSrcSize / 2;
+                    auto sy = y - kDstHeight / 2 + kSrcSize / 2;
+                    REQUIRE(dst[y * kDstWidth + x] == src[sy * kSrcSize + sx]);
+                }
+            }
+        }
+    }
+
+    WHEN("the source only partially covers the destination")
+    {
+        params.src_center_x = 2;
+        params.src_center_y = 60;
+        params.angle_deg = 37;
+        affine_rotation::Rotate(params);
+
+        THEN("uncovered pixels are black, and all others are close to the per-pixel version")
+        {
+            RequireCloseToBaseline(dst, src, params);
+            REQUIRE(std::ranges::count(dst, 0x0000) > 0);
+        }
+    }
+
+    WHEN("rotating with arbitrary angles and centers")
+    {
+        std::mt19937 rng(1);
+        std::uniform_int_distribution<int32_t> angle(0, 359);
+        std::uniform_int_distribution<int32_t> center(-20, kSrcSize + 20);
+
+        THEN("the result is within a pixel of the per-pixel version")
+        {
+            for (auto i = 0; i < 200; i++)
+            {
+                params.angle_deg = angle(rng);
+                params.src_center_x = center(rng);
+                params.src_center_y = center(rng);
+
+                affine_rotation::Rotate(params);
+                RequireCloseToBaseline(dst, src, params);
+            }
+        }
+    }
+
+    WHEN("the destination is split into bands")
+    {
+        params.angle_deg = 291;
+        params.bilinear = true;
+        affine_rotation::Rotate(params);
+
+        params.dst_data = banded.data();
+        for (auto row = 0; row < kDstHeight; row += 7)
+        {
+            affine_rotation::RotateRows(params, row, std::min(row + 7, kDstHeight));
+        }
+
+        THEN("the result is the same as when rotating everything at once")
+        {
+            REQUIRE(banded == dst);
+        }
+    }
+
+    WHEN("the source is scaled up")
+    {
+        params.scale = 2.0f;
+        affine_rotation::Rotate(params);
+
+        THEN("each source pixel covers two destination pixels in each direction")
+        {
+            auto center = (kDstHeight / 2) * kDstWidth + kDstWidth / 2;
+            auto src_center = (kSrcSize / 2) * kSrcSize + kSrcSize / 2;
+
+            REQUIRE(dst[center] == src[src_center]);
+            REQUIRE(dst[center + 1] == src[src_center]);
+            REQUIRE(dst[center + 2] == src[src_center + 1]);
+            REQUIRE(dst[center + kDstWidth] == src[src_center]);
+            REQUIRE(dst[center + 2 * kDstWidth] == src[src_center + kSrcSize]);
+        }
+    }
+
+    WHEN("the scale is too small for the fixed-point steps")
+    {
+        params.angle_deg = 45;
+        params.scale = affine_rotation::kMinScale;
+        affine_rotation::Rotate(params);
+
+        THEN("it's clamped to the smallest supported scale")
+        {
+            for (auto scale : {affine_rotation::kMinScale / 2, 1e-9f, 0.0f, -1.0f, NAN})
+            {
+                params.dst_data = banded.data();
+                params.scale = scale;
+                affine_rotation::Rotate(params);
+
+                REQUIRE(banded == dst);
+            }
+        }
+    }
+
+    WHEN("the source is a ring buffer")
+    {
+        // The same image, rotated around so that it wraps at (origin_x, origin_y)
+        constexpr auto kOriginX = 23;
+        constexpr auto kOriginY = 41;
+        std::vector<uint16_t> ring(src.size());
+        for (auto y = 0; y < kSrcSize; y++)
+        {
+            for (auto x = 0; x < kSrcSize; x++)
+            {
+                ring[((y + kOriginY) % kSrcSize) * kSrcSize + (x + kOriginX) % kSrcSize] =
+                    src[y * kSrcSize + x];
+            }
+        }
+
+        THEN("the result is the same as for the unwrapped image")
+        {
+            for (auto angle = 0; angle < 360; angle += 15)
+            {
+                for (auto bilinear : {false, true})
+                {
+                    params.angle_deg = angle;
+                    params.bilinear = bilinear;
+                    params.src_center_x = kSrcSize / 2 + angle / 30;
+                    affine_rotation::Rotate(params);
+
+                    auto ring_params = params;
+                    ring_params.src_data = ring.data();
+                    ring_params.src_origin_x = kOriginX;
+                    ring_params.src_origin_y = kOriginY;
+                    ring_params.dst_data = banded.data();
+                    affine_rotation::Rotate(ring_params);
+
+                    REQUIRE(banded == dst);
+                }
+            }
+        }
+    }
+
+    WHEN("bilinear mode is used on a single-colour source")
+    {
+        std::ranges::fill(src, 0xf81f);
+        params.angle_deg = 23;
+        params.bilinear = true;
+        affine_rotation::Rotate(params);
+
+        THEN("the colour is preserved exactly")
+        {
+            REQUIRE(dst[(kDstHeight / 2) * kDstWidth + kDstWidth / 2] == 0xf81f);
+            REQUIRE(std::ranges::all_of(dst, [](auto p) { return p == 0xf81f || p == 0; }));
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(AffineBlitterHostFixture, "the host blitter rotates in bands")
+{
+    std::vector<uint16_t> src(kSrcSize * kSrcSize);
+    std::vector<uint16_t> dst(kDstWidth * kDstHeight, 0x1234);
+    std::vector<uint16_t> reference(kDstWidth * kDstHeight, 0x1234);
+    for (auto i = 0u; i < src.size(); i++)
+    {
+        src[i] = static_cast<uint16_t>(i + 1);
+    }
+
+    // The rows don't split evenly over the bands
+    REQUIRE(kDstHeight % AffineBlitterHost::kDefaultBands != 0);
+
+    hal::AffineBlitOperation params {
+        .src_data = src.data(),
+        .src_width = kSrcSize,
+        .src_height = kSrcSize,
+        .dst_data = dst.data(),
+        .dst_width = kDstWidth,
+        .dst_height = kDstHeight,
+        .angle_deg = 0,
+        .scale = 1.0f,
+        .pivot_x = kDstWidth / 2,
+        .pivot_y = (kDstHeight * 2) / 3,
+        .src_center_x = kSrcSize / 2,
+        .src_center_y = kSrcSize / 2,
+        .bilinear = false,
+    };
+
+    WHEN("rotating with arbitrary angles, centers and scales")
+    {
+        std::mt19937 rng(2);
+        std::uniform_int_distribution<int32_t> angle(0, 359);
+        std::uniform_int_distribution<int32_t> center(-20, kSrcSize + 20);
+        std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+        THEN("the result is within a pixel of the per-pixel version, and the same as the "
+             "reference kernel")
+        {
+            for (auto i = 0; i < 100; i++)
+            {
+                params.angle_deg = angle(rng);
+                params.src_center_x = center(rng);
+                params.src_center_y = center(rng);
+                params.scale = scale(rng);
+
+                params.dst_data = dst.data();
+                Blit(params);
+                RequireCloseToBaseline(dst, src, params);
+
+                params.dst_data = reference.data();
+                affine_rotation::Rotate(params);
+                REQUIRE(dst == reference);
+            }
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#include "frame_pacer.hh"
+#include "test.hh"
+
+TEST_SUITE_BEGIN("frame_pacer");
+
+TEST_CASE("frames are paced after what happens on the display")
+{
+    FramePacer pacer;
+
+    THEN("the first frame is rendered at once")
+    {
+        REQUIRE(pacer.TimeUntilNextFrame(1000, false) == 0);
+    }
+
+    WHEN("a frame without changes has been rendered")
+    {
+        pacer.OnRenderStart(1000);
+
+        THEN("the next frame is at the idle rate")
+        {
+            REQUIRE(pacer.TimeUntilNextFrame(1010, false) == FramePacer::kIdleFrameInterval - 10);
+            REQUIRE(pacer.TimeUntilNextFrame(1000 + FramePacer::kIdleFrameInterval, false) == 0);
+        }
+        AND_THEN("activity brings the frame rate up")
+        {
+            REQUIRE(pacer.TimeUntilNextFrame(1010, true) == FramePacer::kActiveFrameInterval - 10);
+            REQUIRE(pacer.TimeUntilNextFrame(1020, true) == 0);
+        }
+    }
+
+    WHEN("a frame has been flushed")
+    {
+        pacer.OnRenderStart(1000);
+        pacer.OnFlushStart(1005);
+        pacer.OnFlushDone(1008);
+
+        THEN("the active rate is kept for a while")
+        {
+            REQUIRE(pacer.TimeUntilNextFrame(1010, false) == FramePacer::kActiveFrameInterval - 10);
+            REQUIRE(pacer.TimeUntilNextFrame(1000 + FramePacer::kActiveFrameInterval, false) == 0);
+        }
+        AND_THEN("it falls back to the idle rate after that")
+        {
+            pacer.OnRenderStart(1300);
+            REQUIRE(pacer.TimeUntilNextFrame(1310, false) == FramePacer::kIdleFrameInterval - 10);
+        }
+    }
+
+    WHEN("a window of frames has been rendered")
+    {
+        for (auto i = 0u; i < FramePacer::kStatsWindow; i++)
+        {
+            auto start = i * 20;
+
+            REQUIRE(pacer.GetStats().frames == 0);
+            pacer.OnRenderStart(start);
+            pacer.OnFlushStart(start + (i == 7 ? 12 : 4));
+            pacer.OnFlushDone(start + (i == 7 ? 12 : 4) + 2);
+        }
+
+        THEN("the timings are published")
+        {
+            auto& stats = pacer.GetStats();
+
+            REQUIRE(stats.frames == FramePacer::kStatsWindow);
+            REQUIRE(stats.average_render_ms == 4);
+            REQUIRE(stats.max_render_ms == 12);
+            REQUIRE(stats.average_flush_ms == 2);
+            REQUIRE(stats.max_flush_ms == 2);
+        }
+    }
+
+    WHEN("most flushes complete in the background")
+    {
+        auto timed = 0u;
+
+        for (auto i = 0u; i < FramePacer::kStatsWindow; i++)
+        {
+            auto start = i * 20;
+
+            pacer.OnRenderStart(start);
+            pacer.OnFlushStart(start + 4);
+            if (pacer.ShouldTimeFlush())
+            {
+                timed++;
+                pacer.OnFlushDone(start + 4 + 3);
+            }
+            else
+            {
+                // Collected when the next frame is flushed
+                pacer.OnFlushDone(start + 20 + 4, false);
+            }
+        }
+
+        THEN("every kFlushTimingInterval flush is timed")
+        {
+            REQUIRE(timed == FramePacer::kStatsWindow / FramePacer::kFlushTimingInterval);
+        }
+
+        AND_THEN("only the timed flushes are in the flush timings")
+        {
+            auto& stats = pacer.GetStats();
+
+            REQUIRE(stats.frames == FramePacer::kStatsWindow);
+            REQUIRE(stats.average_flush_ms == 3);
+            REQUIRE(stats.max_flush_ms == 3);
+        }
+    }
+}
@@ -0,0 +1,141 @@
+#include "indexed_min_heap.hh"
+#include "test.hh"
+
+#include <map>
+#include <random>
+#include <set>
+
+TEST_SUITE_BEGIN("indexed_min_heap");
+
+TEST_CASE("the indexed min-heap orders handles by key")
+{
+    IndexedMinHeap<uint16_t, uint32_t, 8, 16> heap;
+
+    REQUIRE(heap.Empty());
+
+    heap.Push(3, 30);
+    heap.Push(7, 10);
+    heap.Push(1, 20);
+
+    THEN("the smallest key is on top")
+    {
+        REQUIRE(heap.Size() == 3);
+        REQUIRE(heap.Top() == 7);
+        REQUIRE(heap.TopKey() == 10);
+        REQUIRE(heap.Contains(3));
+        REQUIRE_FALSE(heap.Contains(4));
+    }
+
+    WHEN("keys are changed")
+    {
+        heap.Update(3, 5);
+        REQUIRE(heap.Top() == 3);
+
+        heap.Update(3, 50);
+        REQUIRE(heap.Top() == 7);
+
+        THEN("handles are popped in the new order")
+        {
+            heap.Pop();
+            REQUIRE(heap.Top() == 1);
+            heap.Pop();
+            REQUIRE(heap.Top() == 3);
+            heap.Pop();
+            REQUIRE(heap.Empty());
+            REQUIRE_FALSE(heap.Contains(3));
+        }
+    }
+
+    WHEN("a handle in the middle is erased")
+    {
+        heap.Erase(1);
+
+        THEN("the others are left")
+        {
+            REQUIRE_FALSE(heap.Contains(1));
+            REQUIRE(heap.Size() == 2);
+            REQUIRE(heap.Top() == 7);
+            heap.Pop();
+            REQUIRE(heap.Top() == 3);
+        }
+    }
+
+    WHEN("keys are equal")
+    {
+        heap.Update(3, 10);
+        heap.Update(1, 10);
+
+        THEN("the smallest handle comes first")
+        {
+            REQUIRE(heap.Top() == 1);
+            heap.Pop();
+            REQUIRE(heap.Top() == 3);
+        }
+    }
+
+    WHEN("the heap is cleared")
+    {
+        heap.Clear();
+
+        THEN("it's empty, and the handles can be pushed again")
+        {
+            REQUIRE(heap.Empty());
+            REQUIRE_FALSE(heap.Contains(7));
+            heap.Push(7, 1);
+            REQUIRE(heap.Top() == 7);
+        }
+    }
+}
+
+TEST_CASE("the indexed min-heap agrees with an ordered set")
+{
+    constexpr auto kHandles = 64;
+    IndexedMinHeap<uint16_t, uint32_t, 32, kHandles> heap;
+    std::set<std::pair<uint32_t, uint16_t>> reference;
+    std::map<uint16_t, uint32_t> keys;
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<uint32_t> key_distribution(0, 100);
+    std::uniform_int_distribution<uint16_t> handle_distribution(0, kHandles - 1);
+
+    for (auto i = 0; i < 5000; i++)
+    {
+        auto handle = handle_distribution(rng);
+        auto key = key_distribution(rng);
+
+        if (keys.contains(handle))
+        {
+            reference.erase({keys[handle], handle});
+            if (rng() % 3 == 0)
+            {
+                heap.Erase(handle);
+                keys.erase(handle);
+            }
+            else
+            {
+                heap.Update(handle, key);
+                keys[handle] = key;
+                reference.insert({key, handle});
+            }
+        }
+        else if (!heap.Full())
+        {
+            heap.Push(handle, key);
+            keys[handle] = key;
+            reference.insert({key, handle});
+        }
+        else
+        {
+            reference.erase({heap.TopKey(), heap.Top()});
+            keys.erase(heap.Top());
+            heap.Pop();
+        }
+
+        REQUIRE(heap.Size() == reference.size());
+        if (!reference.empty())
+        {
+            REQUIRE(heap.Top() == reference.begin()->second);
+            REQUIRE(heap.TopKey() == reference.begin()->first);
+        }
+    }
+}
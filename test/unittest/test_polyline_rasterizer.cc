@@ -0,0 +1,163 @@
+#include "polyline_rasterizer.hh"
+#include "test.hh"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+constexpr auto kWidth = 40;
+constexpr auto kHeight = 30;
+constexpr uint16_t kBackground = 0xffff;
+constexpr uint16_t kRed = 0xf800;
+
+} // namespace
+
+TEST_SUITE_BEGIN("polyline_rasterizer");
+
+TEST_CASE("wide lines are drawn with anti-aliased edges")
+{
+    std::vector<uint16_t> pixels(kWidth * kHeight, kBackground);
+    polyline_rasterizer::Target dst {pixels.data(), kWidth, kHeight};
+    polyline_rasterizer::Scratch scratch;
+    auto at = [&pixels](int x, int y) { return pixels[y * kWidth + x]; };
+
+    WHEN("a horizontal line is drawn")
+    {
+        const std::vector<polyline_rasterizer::Vertex> line {{5, 15, 0}, {30, 15, kRed}};
+        polyline_rasterizer::DrawPolyline(dst, line, 4, scratch);
+
+        THEN("the middle is fully colored")
+        {
+            REQUIRE(at(10, 14) == kRed);
+            REQUIRE(at(10, 15) == kRed);
+            REQUIRE(at(10, 16) == kRed);
+        }
+        AND_THEN("the edge pixels, half covered, are blended with the background")
+        {
+            REQUIRE(at(10, 13) != kRed);
+            REQUIRE(at(10, 13) != kBackground);
+            REQUIRE(at(10, 17) == at(10, 13));
+            REQUIRE(at(10, 12) == kBackground);
+        }
+        AND_THEN("pixels far from the line are left alone")
+        {
+            REQUIRE(at(10, 5) == kBackground);
+            REQUIRE(at(38, 15) == kBackground);
+        }
+    }
+
+    WHEN("a line doubles back over itself")
+    {
+        std::vector<uint16_t> single(pixels);
+        const std::vector<polyline_rasterizer::Vertex> there_and_back {
+            {5, 5, 0}, {30, 20, kRed}, {5, 5, kRed}};
+        const std::vector<polyline_rasterizer::Vertex> there {{5, 5, 0}, {30, 20, kRed}};
+
+        polyline_rasterizer::DrawPolyline(dst, there_and_back, 5, scratch);
+        polyline_rasterizer::DrawPolyline({single.data(), kWidth, kHeight}, there, 5, scratch);
+
+        THEN("every pixel is only blended once")
+        {
+            REQUIRE(pixels == single);
+        }
+    }
+
+    WHEN("the line is far outside of the target")
+    {
+        const std::vector<polyline_rasterizer::Vertex> line {
+            {-100000, -5000, 0},
+            {100000, -4000, kRed},
+            {100000, 4000, kRed},
+            {-20, 50, kRed},
+            {-20, 10, kRed}};
+        polyline_rasterizer::DrawPolyline(dst, line, 5, scratch);
+
+        THEN("nothing is drawn")
+        {
+            REQUIRE(std::ranges::all_of(pixels, [](auto p) { return p == kBackground; }));
+        }
+    }
+
+    WHEN("a line crosses the target from vertices millions of pixels away")
+    {
+        std::vector<uint16_t> short_line(pixels);
+        const std::vector<polyline_rasterizer::Vertex> line {{-5000000, 15, 0},
+                                                             {5000000, 15, kRed}};
+        polyline_rasterizer::DrawPolyline(dst, line, 4, scratch);
+        polyline_rasterizer::DrawPolyline({short_line.data(), kWidth, kHeight},
+                                          std::vector<polyline_rasterizer::Vertex> {
+                                              {-50, 15, 0}, {kWidth + 50, 15, kRed}},
+                                          4,
+                                          scratch);
+
+        THEN("it's clipped without moving it")
+        {
+            REQUIRE(at(10, 15) == kRed);
+            REQUIRE(pixels == short_line);
+        }
+    }
+
+    WHEN("the line has more vertices than are drawn in one go")
+    {
+        // Back and forth along a row, and then down the last column
+        std::vector<polyline_rasterizer::Vertex> line;
+        for (auto i = 0u; i < polyline_rasterizer::kMaxVertices; i++)
+        {
+            line.push_back({i % 2 == 0 ? 5 : 30, 5, kRed});
+        }
+        line.push_back({35, 5, kRed});
+        line.push_back({35, 25, kRed});
+
+        polyline_rasterizer::DrawPolyline(dst, line, 4, scratch);
+
+        THEN("all of it is drawn")
+        {
+            REQUIRE(at(10, 5) == kRed);
+            REQUIRE(at(35, 15) == kRed);
+            REQUIRE(at(35, 24) == kRed);
+        }
+    }
+
+    WHEN("a ring is drawn")
+    {
+        polyline_rasterizer::DrawRing(dst, 20, 15, 10, 3, kRed);
+
+        THEN("pixels at the radius are colored")
+        {
+            REQUIRE(at(30, 15) == kRed);
+            REQUIRE(at(10, 15) == kRed);
+            REQUIRE(at(20, 5) == kRed);
+            REQUIRE(at(20, 25) == kRed);
+        }
+        AND_THEN("the inside and the outside are left alone")
+        {
+            REQUIRE(at(20, 15) == kBackground);
+            REQUIRE(at(25, 15) == kBackground);
+            REQUIRE(at(2, 2) == kBackground);
+        }
+    }
+
+    WHEN("a ring much larger than the target is drawn")
+    {
+        std::vector<uint16_t> line(pixels);
+        // The top of it is at row 15
+        polyline_rasterizer::DrawRing(dst, 20, 1015, 1000, 4, kRed);
+        polyline_rasterizer::DrawPolyline(
+            {line.data(), kWidth, kHeight},
+            std::vector<polyline_rasterizer::Vertex> {{0, 15, 0}, {kWidth - 1, 15, kRed}},
+            4,
+            scratch);
+
+        THEN("its edges are blended like those of a straight line")
+        {
+            REQUIRE(at(20, 13) != kBackground);
+            REQUIRE(at(20, 13) != kRed);
+            for (auto y = 10; y < 20; y++)
+            {
+                REQUIRE(at(20, y) == line[y * kWidth + 20]);
+            }
+        }
+    }
+}
@@ -1,2 +1,1528 @@
 #include "mock_filesystem.hh"
-#include "tile_cache.hh"
\ No newline at end of file
+#include "mock_https_client.hh"
+#include "pending_tile_journal.hh"
+#include "pm_host.hh"
+#include "rgb565_rle.hh"
+#include "test.hh"
+#include "tile_cache.hh"
+#include "tile_eviction_policy.hh"
+#include "tile_index.hh"
+#include "tile_pack.hh"
+#include "tile_prefetch.hh"
+#include "tile_region.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
+#include <unordered_map>
+
+using trompeloeil::_;
+
+// Friend of the tile cache, which runs it, its decoders and its single web thread step by
+// step on the test thread
+class TileCacheFixture
+{
+public:
+    static constexpr size_t kDecodeThreads = TileCache::kDefaultDecodeThreads;
+    static constexpr size_t kMaxJobsInFlight = TileCache::DecodeThread::kMaxJobsInFlight;
+    static constexpr size_t kWebQueueSize = TileCache::kWebQueueSize;
+    static constexpr size_t kMaxRegionTileAttempts = TileCache::kMaxRegionTileAttempts;
+    static constexpr size_t kFallbackTiles = TileCache::kFallbackTiles;
+
+    TileCacheFixture()
+    {
+        std::filesystem::remove(pack_path);
+
+        // Not real PNGs, so all decodes fail. That doesn't matter for the job accounting.
+        auto writer = TilePackWriter::Open(pack_path);
+        REQUIRE(writer);
+        for (auto i = 0; i < 48; i++)
+        {
+            auto tile = Tile {17600 + i, 9500, kDefaultZoom};
+
+            REQUIRE(writer->Add(TileId(tile), std::vector<std::byte>(100, std::byte {0x5a})));
+            tiles.push_back(tile);
+        }
+        REQUIRE(writer->Commit());
+        writer = nullptr;
+
+        cache.m_tile_packs[kDefaultZoom] = TilePack::Open(pack_path);
+        REQUIRE(cache.m_tile_packs[kDefaultZoom]);
+    }
+
+    ~TileCacheFixture()
+    {
+        std::filesystem::remove(pack_path);
+        std::filesystem::remove_all(data_directory);
+    }
+
+    // A tile on the filesystem, which the tile cache reads without the Filesystem
+    void WriteLooseTile(const Tile& t, const std::vector<std::byte>& png)
+    {
+        auto path = std::filesystem::path(data_directory) / cache.GetTilePath(t);
+
+        std::filesystem::create_directories(path.parent_path());
+        auto file = std::ofstream(path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(png.data()), png.size());
+    }
+
+    // The buffers which PNGs are read into, when no read is in flight
+    std::set<const std::byte*> FreePngBuffers() const
+    {
+        std::set<const std::byte*> out;
+
+        for (const auto& buffer : cache.m_free_png_buffers)
+        {
+            out.insert(buffer.data());
+        }
+
+        return out;
+    }
+
+    void RequestAll()
+    {
+        cache.m_prefetch_tiles.assign(tiles.begin(), tiles.end());
+    }
+
+    // As done on each tile cache activation, but without collecting the results
+    void FillFromColdStore()
+    {
+        cache.FillFromColdStore();
+        cache.FillFromColdStore();
+    }
+
+    void RunDecoders()
+    {
+        for (auto& decoder : cache.m_decode_threads)
+        {
+            decoder->DecodeJobs();
+        }
+    }
+
+    void CompleteDecodes()
+    {
+        cache.CompleteDecodes();
+    }
+
+    void SetWifiConnected()
+    {
+        state.CheckoutReadWrite().Set<AS::wifi_connected>(true);
+    }
+
+    void QueueFetches(const std::vector<Tile>& ui,
+                      const std::vector<Tile>& background,
+                      const std::vector<Tile>& region,
+                      const std::vector<Tile>& reload,
+                      const std::vector<Tile>& revalidate)
+    {
+        cache.m_get_from_server = ui;
+        cache.m_get_from_server_background = background;
+        cache.m_region_download.clear();
+        for (const auto& tile : region)
+        {
+            cache.m_region_download.push_back(TileCache::RegionTile {tile, 0});
+        }
+        cache.m_region_download_total = region.size();
+        cache.m_region_download_failed = 0;
+        cache.m_reload_tiles_from_server = reload;
+        cache.m_revalidate_from_server.clear();
+        cache.m_revalidate_from_server.insert(revalidate.begin(), revalidate.end());
+    }
+
+    void SetMaxTileAgeDays(uint16_t days)
+    {
+        auto ps = state.CheckoutPartialSnapshot<AS::configuration>();
+        ps.GetWritableReference<AS::configuration>().tile_max_age_days = days;
+    }
+
+    // As if the tiles were loaded from the filesystem before this
+    void CheckTileAges(const std::vector<Tile>& loaded)
+    {
+        for (const auto& t : loaded)
+        {
+            cache.m_check_tile_age.push(t);
+        }
+        cache.CheckTileAges();
+    }
+
+    bool IsAgeCheckQueued(const Tile& t) const
+    {
+        return std::ranges::find(cache.m_check_tile_age, t) != cache.m_check_tile_age.end();
+    }
+
+    bool IsRevalidationQueued(const Tile& t) const
+    {
+        return cache.m_revalidate_from_server.contains(t);
+    }
+
+    static std::vector<std::byte> TileMetaData(uint32_t content_hash, int64_t fetched_at)
+    {
+        auto meta = TileCache::TileMeta {TileCache::kTileMetaMagic, content_hash, fetched_at};
+        auto bytes = std::as_bytes(std::span {&meta, 1});
+
+        return {bytes.begin(), bytes.end()};
+    }
+
+    static auto ParseTileMeta(std::span<const std::byte> data)
+    {
+        TileCache::TileMeta out;
+
+        REQUIRE(data.size() == sizeof(out));
+        memcpy(&out, data.data(), sizeof(out));
+
+        return out;
+    }
+
+    static int64_t SecondsSinceEpoch()
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    }
+
+    size_t RegionTilesQueued() const
+    {
+        return cache.m_region_download.size();
+    }
+
+    size_t RegionTilesInFlight() const
+    {
+        return cache.m_region_download_in_flight.size();
+    }
+
+    uint32_t RegionTilesFailed() const
+    {
+        return cache.m_region_download_failed;
+    }
+
+    // As the tile cache thread does on the next activation
+    void ApplyRegionDownloadRequest()
+    {
+        cache.ApplyRegionDownloadRequest();
+    }
+
+    uint32_t RegionTilesTotal() const
+    {
+        return cache.m_region_download_total;
+    }
+
+    void FillFromServer()
+    {
+        cache.FillFromServer();
+    }
+
+    // Returns the tiles fetched, in order
+    std::vector<Tile> RunWebThread()
+    {
+        fetched_urls.clear();
+        for (auto& web_thread : cache.m_web_threads)
+        {
+            web_thread->FetchJobs();
+        }
+        cache.CompleteFetches();
+
+        std::vector<Tile> out;
+        for (const auto& url : fetched_urls)
+        {
+            auto tile = std::ranges::find_if(all_tiles, [&url](const auto& t) {
+                return url.find(std::format("/{}/{}/{}.png", t.zoom, t.x, t.y)) != url.npos;
+            });
+
+            REQUIRE(tile != all_tiles.end());
+            out.push_back(*tile);
+        }
+
+        return out;
+    }
+
+    // For the tiles which are fetched
+    std::vector<Tile> MakeTiles(int32_t y, int count)
+    {
+        std::vector<Tile> out;
+
+        for (auto i = 0; i < count; i++)
+        {
+            out.push_back(Tile {17600 + i, y, kDefaultZoom});
+        }
+        all_tiles.insert(all_tiles.end(), out.begin(), out.end());
+
+        return out;
+    }
+
+    // The decoder side of the pre-decoded tile store
+    std::optional<uint32_t> DecodedTileStoreGeneration(const Tile& t)
+    {
+        return cache.DecodedTileStoreGeneration(TileId(t));
+    }
+
+    bool StoreDecodedTile(const Tile& t, uint32_t generation)
+    {
+        return cache.StoreDecodedTile(t, generation, cache.m_image_cache[0]);
+    }
+
+    // As done by the web thread when a tile has changed
+    void InvalidateDecodedTile(const Tile& t)
+    {
+        auto lock = std::lock_guard(cache.m_filesystem_mutex);
+        cache.InvalidateDecodedTile(t);
+    }
+
+    std::string DecodedTilePath(const Tile& t) const
+    {
+        return cache.GetDecodedTilePath(TileId(t));
+    }
+
+    void SetInMemory(const Tile& t)
+    {
+        cache.m_tile_index.Insert(TileId(t), 0);
+    }
+
+    // As if the tile had been decoded into the slot
+    void LoadIntoSlot(const Tile& t, uint16_t slot)
+    {
+        cache.m_tiles[slot] = TileId(t);
+        cache.m_tile_index.Insert(TileId(t), slot);
+        cache.m_eviction_policy.Inserted(slot);
+    }
+
+    // Each pixel is its offset in the tile, so that scaled parts can be located
+    void LoadNumberedTile(const Tile& t, uint16_t slot)
+    {
+        auto* pixels = cache.m_image_cache[slot].WritableData16();
+
+        for (auto i = 0; i < kTileSize * kTileSize; i++)
+        {
+            pixels[i] = i;
+        }
+        LoadIntoSlot(t, slot);
+    }
+
+    std::optional<uint16_t> EvictTile()
+    {
+        return cache.EvictTile();
+    }
+
+    bool IsPinned(uint16_t slot) const
+    {
+        return cache.m_pinned[slot];
+    }
+
+    void SetDecoding(uint16_t slot)
+    {
+        cache.m_decoding[slot] = true;
+    }
+
+    size_t SlotsBeingDecoded() const
+    {
+        return std::ranges::count(cache.m_decoding, true);
+    }
+
+    bool IsQueued() const
+    {
+        return !cache.m_prefetch_tiles.empty();
+    }
+
+    bool IsIndexed(const Tile& t) const
+    {
+        return cache.m_tile_index.Find(TileId(t)).has_value();
+    }
+
+    std::string pack_path =
+        (std::filesystem::temp_directory_path() / "radbuzz_tile_cache_test.pack").string();
+    std::string data_directory =
+        (std::filesystem::temp_directory_path() / "radbuzz_tile_cache_test").string();
+    std::vector<Tile> tiles;
+    std::vector<Tile> all_tiles;
+    std::vector<std::string> fetched_urls;
+
+    ApplicationState state;
+    PmHost pm;
+    MockFilesystem filesystem;
+    // The tiles in the pack are the only ones on the filesystem
+    std::unique_ptr<trompeloeil::expectation> read_file =
+        NAMED_ALLOW_CALL(filesystem, ReadFile(_)).RETURN(std::nullopt);
+    std::map<std::string, std::vector<std::byte>> written_files;
+    std::unique_ptr<trompeloeil::expectation> write_file =
+        NAMED_ALLOW_CALL(filesystem, WriteFile(_, _))
+            .LR_SIDE_EFFECT(written_files[std::string(_1)].assign(_2.begin(), _2.end()));
+    std::unique_ptr<trompeloeil::expectation> file_exists =
+        NAMED_ALLOW_CALL(filesystem, FileExists(_)).RETURN(false);
+    // Owned by the tile cache
+    MockHttpsClient* https_client {nullptr};
+
+    TileCache cache {state,
+                     pm.CreateFullPowerLock(),
+                     filesystem,
+                     CreateHttpsClient(),
+                     data_directory,
+                     kDecodeThreads};
+
+    // The server is unreachable
+    std::unique_ptr<trompeloeil::expectation> get =
+        NAMED_ALLOW_CALL(*https_client, Get(_))
+            .LR_SIDE_EFFECT(fetched_urls.emplace_back(_1))
+            .RETURN(std::nullopt);
+
+private:
+    std::vector<std::unique_ptr<HttpsClient>> CreateHttpsClient()
+    {
+        auto client = std::make_unique<MockHttpsClient>();
+        std::vector<std::unique_ptr<HttpsClient>> out;
+
+        https_client = client.get();
+        out.push_back(std::move(client));
+
+        return out;
+    }
+};
+
+TEST_SUITE_BEGIN("tile_cache");
+
+TEST_CASE("the tile index maps tile ids to cache slots")
+{
+    TileIndex<kTileCacheSize> index;
+
+    auto a = TileId(Tile {17602, 9530, kDefaultZoom});
+    auto b = TileId(Tile {4400, 2382, kCityZoom});
+
+    REQUIRE_FALSE(index.Find(a));
+
+    WHEN("tiles are inserted")
+    {
+        index.Insert(a, 3);
+        index.Insert(b, 7);
+
+        THEN("they can be looked up")
+        {
+            REQUIRE(index.Find(a) == 3);
+            REQUIRE(index.Find(b) == 7);
+        }
+
+        AND_WHEN("a tile is evicted")
+        {
+            index.Erase(a);
+
+            THEN("only that tile is gone")
+            {
+                REQUIRE_FALSE(index.Find(a));
+                REQUIRE(index.Find(b) == 7);
+            }
+        }
+
+        AND_WHEN("a tile is moved to another slot")
+        {
+            index.Insert(b, 12);
+
+            THEN("the new slot is returned")
+            {
+                REQUIRE(index.Find(b) == 12);
+            }
+        }
+    }
+}
+
+TEST_CASE("the tile index stays consistent over many evictions")
+{
+    TileIndex<kTileCacheSize> index;
+    std::unordered_map<uint32_t, uint16_t> reference;
+    std::mt19937 rng(1234);
+
+    // A small area, to get plenty of collisions and reinsertions
+    std::uniform_int_distribution<int32_t> coordinate(0, 15);
+
+    for (auto i = 0; i < 2000; i++)
+    {
+        auto id = TileId(Tile {17600 + coordinate(rng), 9520 + coordinate(rng), kDefaultZoom});
+
+        if (reference.contains(id))
+        {
+            index.Erase(id);
+            reference.erase(id);
+        }
+        else if (reference.size() < kTileCacheSize)
+        {
+            auto slot = static_cast<uint16_t>(i % kTileCacheSize);
+
+            index.Insert(id, slot);
+            reference[id] = slot;
+        }
+
+        for (const auto& [key, slot] : reference)
+        {
+            REQUIRE(index.Find(key) == slot);
+        }
+    }
+}
+
+TEST_CASE("the CLOCK eviction policy gives referenced tiles a second chance")
+{
+    ClockEvictionPolicy<4> policy;
+    auto nothing_pinned = [](uint16_t) { return false; };
+
+    for (auto slot = 0; slot < 4; slot++)
+    {
+        policy.Inserted(slot);
+    }
+
+    WHEN("all but one tile is referenced again after the first sweep")
+    {
+        REQUIRE(policy.SelectVictim(nothing_pinned) == 0);
+        policy.Touch(1);
+        policy.Touch(3);
+
+        THEN("the unreferenced tile is selected")
+        {
+            REQUIRE(policy.SelectVictim(nothing_pinned) == 2);
+        }
+    }
+
+    WHEN("a tile is pinned")
+    {
+        auto pin_first = [](uint16_t slot) { return slot == 0; };
+
+        THEN("it's never selected")
+        {
+            for (auto i = 0; i < 8; i++)
+            {
+                REQUIRE(policy.SelectVictim(pin_first) != 0);
+            }
+        }
+    }
+
+    WHEN("everything is pinned")
+    {
+        auto pin_all = [](uint16_t) { return true; };
+
+        THEN("no tile is selected")
+        {
+            REQUIRE_FALSE(policy.SelectVictim(pin_all));
+            REQUIRE(policy.UnreferencedSlots(pin_all) == 0);
+        }
+    }
+
+    WHEN("a tile is prefetched into a slot")
+    {
+        REQUIRE(policy.UnreferencedSlots(nothing_pinned) == 0);
+        policy.Prefetched(2);
+
+        THEN("it's selected before the tiles which were asked for")
+        {
+            REQUIRE(policy.UnreferencedSlots(nothing_pinned) == 1);
+            REQUIRE(policy.SelectVictim(nothing_pinned) == 2);
+        }
+
+        AND_WHEN("it's used before the hand comes around")
+        {
+            policy.Touch(2);
+
+            THEN("it gets a second chance like the others")
+            {
+                REQUIRE(policy.UnreferencedSlots(nothing_pinned) == 0);
+                REQUIRE(policy.SelectVictim(nothing_pinned) == 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("pre-decoded tiles are run-length encoded")
+{
+    std::vector<uint16_t> pixels(kTileSize * kTileSize, 0xf7be);
+
+    // Some detail, in between the large single-colour areas
+    for (auto i = 1000u; i < 1010; i++)
+    {
+        pixels[i] = static_cast<uint16_t>(i);
+    }
+    pixels[5000] = 0x001f;
+    pixels[5001] = 0x001f;
+
+    auto encoded = rgb565_rle::Encode(pixels);
+    REQUIRE(encoded.size() < pixels.size() / 100);
+
+    WHEN("decoding into a tile sized buffer")
+    {
+        std::vector<uint16_t> out(pixels.size());
+
+        THEN("the original pixels are restored")
+        {
+            REQUIRE(rgb565_rle::Decode(encoded, out));
+            REQUIRE(out == pixels);
+        }
+    }
+
+    WHEN("the stream is truncated")
+    {
+        std::vector<uint16_t> out(pixels.size());
+        encoded.pop_back();
+
+        THEN("decoding fails")
+        {
+            REQUIRE_FALSE(rgb565_rle::Decode(encoded, out));
+        }
+    }
+
+    WHEN("the destination is too small")
+    {
+        std::vector<uint16_t> out(pixels.size() - 1);
+
+        THEN("decoding fails")
+        {
+            REQUIRE_FALSE(rgb565_rle::Decode(encoded, out));
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(TileCacheFixture, "decoded tiles are stored when they come back")
+{
+    auto tile = MakeTiles(9600, 1).front();
+    auto path = DecodedTilePath(tile);
+
+    WHEN("a tile is decoded the first time")
+    {
+        THEN("it's not stored")
+        {
+            REQUIRE_FALSE(DecodedTileStoreGeneration(tile));
+        }
+    }
+
+    WHEN("a tile is decoded again")
+    {
+        REQUIRE_FALSE(DecodedTileStoreGeneration(tile));
+        auto generation = DecodedTileStoreGeneration(tile);
+
+        THEN("it's stored")
+        {
+            REQUIRE(generation);
+            REQUIRE(StoreDecodedTile(tile, *generation));
+            REQUIRE(written_files[path].size() > 0);
+        }
+
+        AND_WHEN("it's fetched again while it's decoded")
+        {
+            InvalidateDecodedTile(tile);
+
+            THEN("the stale pixels are not stored")
+            {
+                REQUIRE_FALSE(StoreDecodedTile(tile, *generation));
+                REQUIRE_FALSE(written_files.contains(path));
+            }
+        }
+
+        AND_WHEN("it's fetched again after it's stored")
+        {
+            REQUIRE(StoreDecodedTile(tile, *generation));
+            InvalidateDecodedTile(tile);
+
+            THEN("the slot is cleared")
+            {
+                REQUIRE(written_files[path].empty());
+            }
+        }
+    }
+
+    WHEN("another tile in the same slot is fetched")
+    {
+        auto other = tile;
+        while (other == tile || DecodedTilePath(other) != path)
+        {
+            other.x++;
+        }
+
+        DecodedTileStoreGeneration(tile);
+        REQUIRE(StoreDecodedTile(tile, *DecodedTileStoreGeneration(tile)));
+        written_files.clear();
+
+        InvalidateDecodedTile(other);
+
+        THEN("the stored tile is kept")
+        {
+            REQUIRE(written_files.empty());
+        }
+
+        AND_WHEN("the other tile is decoded twice while the stored tile is in use")
+        {
+            SetInMemory(tile);
+            DecodedTileStoreGeneration(other);
+
+            THEN("it doesn't replace the stored tile")
+            {
+                REQUIRE_FALSE(DecodedTileStoreGeneration(other));
+            }
+        }
+    }
+}
+
+TEST_CASE("tiles can be appended to and read from a tile pack")
+{
+    auto path = (std::filesystem::temp_directory_path() / "radbuzz_test.pack").string();
+    std::filesystem::remove(path);
+
+    auto a = TileId(Tile {17602, 9530, kDefaultZoom});
+    auto b = TileId(Tile {17603, 9530, kDefaultZoom});
+    auto c = TileId(Tile {17604, 9531, kDefaultZoom});
+    auto png = [](size_t size, uint8_t value) {
+        return std::vector<std::byte>(size, static_cast<std::byte>(value));
+    };
+
+    REQUIRE_FALSE(TilePack::Open(path));
+
+    auto writer = TilePackWriter::Open(path);
+    REQUIRE(writer);
+    REQUIRE(writer->Add(b, png(100, 1)));
+    REQUIRE(writer->Add(a, png(50, 2)));
+    REQUIRE(writer->Commit());
+    writer = nullptr;
+
+    THEN("the tiles can be read back")
+    {
+        auto pack = TilePack::Open(path);
+
+        REQUIRE(pack);
+        REQUIRE(pack->Size() == 2);
+        REQUIRE(pack->Read(a) == png(50, 2));
+        REQUIRE(pack->Read(b) == png(100, 1));
+        REQUIRE_FALSE(pack->Contains(c));
+        REQUIRE_FALSE(pack->Read(c));
+    }
+
+    THEN("a large enough buffer is reused when reading tiles")
+    {
+        auto pack = TilePack::Open(path);
+        std::vector<std::byte> buffer;
+        buffer.reserve(1024);
+        auto storage = buffer.data();
+
+        REQUIRE(pack->ReadInto(b, buffer));
+        REQUIRE(buffer == png(100, 1));
+        REQUIRE(pack->ReadInto(a, buffer));
+        REQUIRE(buffer == png(50, 2));
+        REQUIRE(buffer.data() == storage);
+    }
+
+    WHEN("more tiles are appended")
+    {
+        auto old_size = std::filesystem::file_size(path);
+
+        writer = TilePackWriter::Open(path);
+        REQUIRE(writer);
+        REQUIRE(writer->Add(c, png(10, 3)));
+        REQUIRE(writer->Add(a, png(70, 4)));
+        REQUIRE(writer->Commit());
+        writer = nullptr;
+
+        THEN("new tiles are added and existing ones replaced")
+        {
+            auto pack = TilePack::Open(path);
+
+            REQUIRE(pack);
+            REQUIRE(pack->Size() == 3);
+            REQUIRE(pack->Read(a) == png(70, 4));
+            REQUIRE(pack->Read(b) == png(100, 1));
+            REQUIRE(pack->Read(c) == png(10, 3));
+        }
+
+        AND_THEN("they are written after the old index, which is left as it was")
+        {
+            REQUIRE(std::filesystem::file_size(path) ==
+                    old_size + 10 + 70 + 3 * sizeof(TilePack::Entry) + sizeof(TilePack::Footer));
+        }
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("tiles are prefetched along the path ahead")
+{
+    auto center = Tile {17602, 9530, kDefaultZoom};
+    auto position = ToPoint(center) + Point {kTileSize / 2, kTileSize / 2, kDefaultZoom};
+
+    WHEN("standing still")
+    {
+        THEN("nothing is prefetched")
+        {
+            REQUIRE(PredictTiles(position, 90, 0, 2.4f).empty());
+        }
+    }
+
+    WHEN("heading east")
+    {
+        auto tiles = PredictTiles(position, 90, 20, 2.4f);
+
+        THEN("the current tile comes first")
+        {
+            REQUIRE(tiles.size() > 3);
+            REQUIRE(tiles.front() == center);
+        }
+
+        THEN("the tiles are ahead, and sorted by distance")
+        {
+            for (auto i = 1u; i < tiles.size(); i++)
+            {
+                REQUIRE(tiles[i].x >= tiles[i - 1].x);
+                REQUIRE(std::abs(tiles[i].y - center.y) <= 1);
+            }
+        }
+
+        AND_WHEN("going faster")
+        {
+            auto faster = PredictTiles(position, 90, 90, 2.4f);
+
+            THEN("the prediction reaches further")
+            {
+                REQUIRE(faster.back().x > tiles.back().x);
+            }
+        }
+    }
+
+    WHEN("heading north")
+    {
+        auto tiles = PredictTiles(position, 0, 45, 2.4f);
+
+        THEN("the tiles are above the current one")
+        {
+            REQUIRE(tiles.back().y < center.y);
+            for (const auto& tile : tiles)
+            {
+                REQUIRE(tile.y <= center.y);
+            }
+        }
+    }
+}
+
+TEST_CASE("pending city tiles are journaled")
+{
+    std::map<std::string, std::vector<std::byte>> files;
+
+    auto make_journal = [&files]() {
+        return PendingTileJournal(
+            "pending/15",
+            kDefaultZoom,
+            [&files](const auto& path) -> std::optional<std::vector<std::byte>> {
+                if (auto it = files.find(path); it != files.end())
+                {
+                    return it->second;
+                }
+                return std::nullopt;
+            },
+            [&files](const auto& path, auto data) {
+                files[path].assign(data.begin(), data.end());
+            });
+    };
+
+    auto journal = make_journal();
+    journal.Load();
+    REQUIRE(journal.Tiles().empty());
+
+    WHEN("tiles are added")
+    {
+        // Compacted twice, and then some in the journal
+        constexpr auto kTiles = (PendingTileJournal::kMaxJournalEntries + 1) * 2 + 2;
+
+        for (auto i = 0; i < kTiles; i++)
+        {
+            REQUIRE(journal.Add(Tile {17600 + i, 9500, kDefaultZoom}));
+        }
+        REQUIRE_FALSE(journal.Add(Tile {17600, 9500, kDefaultZoom}));
+
+        THEN("the journal is compacted into snapshots")
+        {
+            REQUIRE(files.contains("pending/15/snapshot_0.bin"));
+            REQUIRE(files.contains("pending/15/snapshot_1.bin"));
+            REQUIRE(files["pending/15/journal_0.bin"].size() < 100);
+        }
+
+        AND_WHEN("they are loaded again")
+        {
+            auto restored = make_journal();
+            restored.Load();
+
+            THEN("all tiles are restored")
+            {
+                REQUIRE(restored.Tiles() == journal.Tiles());
+            }
+        }
+
+        AND_WHEN("the last journal write is torn")
+        {
+            // With two tiles in the journal, the last write went to the first file
+            auto& latest = files["pending/15/journal_0.bin"];
+            REQUIRE(latest.size() > 0);
+
+            WHEN("in the last record")
+            {
+                latest.pop_back();
+            }
+            WHEN("half-way")
+            {
+                latest.resize(latest.size() / 2);
+            }
+            WHEN("before anything was written")
+            {
+                latest.clear();
+            }
+
+            auto restored = make_journal();
+            restored.Load();
+
+            THEN("only the last tile is lost")
+            {
+                REQUIRE(restored.Tiles().size() == kTiles - 1);
+                REQUIRE_FALSE(
+                    restored.Tiles().contains(Tile {17600 + kTiles - 1, 9500, kDefaultZoom}));
+            }
+
+            AND_THEN("new tiles are journaled after the restored ones")
+            {
+                REQUIRE(restored.Add(Tile {17600 + kTiles - 1, 9500, kDefaultZoom}));
+
+                auto again = make_journal();
+                again.Load();
+                REQUIRE(again.Tiles().size() == kTiles);
+            }
+        }
+    }
+
+    WHEN("there is an old style pending file")
+    {
+        auto legacy = std::vector<int32_t> {0x43697480, 17600, 9500, 15, 4400, 2375, 13};
+        auto bytes = std::as_bytes(std::span {legacy});
+        files["pending/15/pending.bin"].assign(bytes.begin(), bytes.end());
+
+        auto migrated = make_journal();
+        migrated.Load();
+
+        THEN("the tiles for the zoom level are migrated")
+        {
+            REQUIRE(migrated.Tiles().size() == 1);
+            REQUIRE(migrated.Tiles().contains(Tile {17600, 9500, kDefaultZoom}));
+            REQUIRE(files.contains("pending/15/snapshot_1.bin"));
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(TileCacheFixture, "decode results are kept until they are collected")
+{
+    RequestAll();
+
+    // Many more tiles than there is room for results in all decoders
+    REQUIRE(tiles.size() > 3 * kDecodeThreads * kMaxJobsInFlight);
+
+    WHEN("the decoders finish several rounds of jobs before the results are collected")
+    {
+        for (auto i = 0; i < 4; i++)
+        {
+            FillFromColdStore();
+            RunDecoders();
+        }
+
+        THEN("no more jobs are handed over than there is room for results")
+        {
+            REQUIRE(SlotsBeingDecoded() == kDecodeThreads * kMaxJobsInFlight);
+            REQUIRE(IsQueued());
+        }
+
+        AND_WHEN("the results are collected")
+        {
+            for (auto i = 0u; i < tiles.size() && (IsQueued() || SlotsBeingDecoded() > 0); i++)
+            {
+                CompleteDecodes();
+                FillFromColdStore();
+                RunDecoders();
+            }
+            CompleteDecodes();
+
+            THEN("every job has completed, and no slot is left reserved")
+            {
+                REQUIRE_FALSE(IsQueued());
+                REQUIRE(SlotsBeingDecoded() == 0);
+            }
+
+            AND_THEN("the failed tiles are dropped, so they can be requested again")
+            {
+                for (const auto& tile : tiles)
+                {
+                    REQUIRE_FALSE(IsIndexed(tile));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(TileCacheFixture, "tiles used by the last frame are never evicted")
+{
+    auto loaded = MakeTiles(9700, kTileCacheSize);
+
+    for (auto slot = 0u; slot < kTileCacheSize; slot++)
+    {
+        LoadIntoSlot(loaded[slot], slot);
+    }
+
+    WHEN("a tile is used by the user interface")
+    {
+        auto& image = cache.GetTile(loaded[5]);
+
+        THEN("it's a hit, and the tile is pinned")
+        {
+            REQUIRE(&image == &cache.GetTile(loaded[5]));
+            REQUIRE(IsPinned(5));
+            REQUIRE(cache.GetStatistics().hits == 2);
+            REQUIRE(cache.GetStatistics().misses == 0);
+        }
+
+        AND_THEN("its slot is skipped by the evictions")
+        {
+            for (auto i = 0u; i < 2 * kTileCacheSize; i++)
+            {
+                REQUIRE(EvictTile() != 5);
+            }
+            REQUIRE(IsIndexed(loaded[5]));
+            REQUIRE(cache.GetStatistics().evictions == kTileCacheSize - 1);
+        }
+
+        AND_WHEN("the next frame begins")
+        {
+            cache.BeginFrame();
+
+            THEN("the tile is no longer pinned, and can be evicted")
+            {
+                REQUIRE_FALSE(IsPinned(5));
+
+                auto evicted = false;
+                for (auto i = 0u; i < 2 * kTileCacheSize; i++)
+                {
+                    if (EvictTile() == 5)
+                    {
+                        evicted = true;
+                    }
+                }
+                REQUIRE(evicted);
+                REQUIRE_FALSE(IsIndexed(loaded[5]));
+                REQUIRE(cache.GetStatistics().evictions == kTileCacheSize);
+            }
+        }
+    }
+
+    WHEN("a slot is reserved for a decode")
+    {
+        SetDecoding(7);
+
+        THEN("it's never evicted")
+        {
+            for (auto i = 0u; i < 2 * kTileCacheSize; i++)
+            {
+                REQUIRE(EvictTile() != 7);
+            }
+        }
+    }
+
+    WHEN("a tile which isn't cached is asked for")
+    {
+        auto missing = MakeTiles(9701, 1);
+
+        cache.GetTile(missing[0]);
+
+        THEN("it's a miss, and nothing is pinned")
+        {
+            REQUIRE(cache.GetStatistics().hits == 0);
+            REQUIRE(cache.GetStatistics().misses == 1);
+            for (auto slot = 0u; slot < kTileCacheSize; slot++)
+            {
+                REQUIRE_FALSE(IsPinned(slot));
+            }
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(TileCacheFixture, "missing tiles are scaled up from a zoomed out tile")
+{
+    // Two zoom levels out, so each parent pixel covers 4x4 pixels of the child
+    auto parent = Tile {4400, 2375, kCityZoom};
+    auto child = [&parent](int32_t x, int32_t y) {
+        return Tile {parent.x * 4 + x, parent.y * 4 + y, kDefaultZoom};
+    };
+    auto is_black = [](std::span<const uint16_t> pixels) {
+        return std::ranges::all_of(pixels, [](auto pixel) { return pixel == 0; });
+    };
+
+    LoadNumberedTile(parent, 3);
+
+    WHEN("a tile within the parent is asked for")
+    {
+        auto pixels = cache.GetTile(child(1, 2)).Data16();
+
+        THEN("it's the part of the parent covered by the tile, scaled up")
+        {
+            auto src_x = 1 * kTileSize / 4;
+            auto src_y = 2 * kTileSize / 4;
+            auto mismatches = 0;
+
+            for (auto y = 0; y < kTileSize; y++)
+            {
+                for (auto x = 0; x < kTileSize; x++)
+                {
+                    auto expected = (src_y + y / 4) * kTileSize + src_x + x / 4;
+
+                    if (pixels[y * kTileSize + x] != expected)
+                    {
+                        mismatches++;
+                    }
+                }
+            }
+            REQUIRE(mismatches == 0);
+        }
+
+        AND_THEN("the parent is pinned, since the placeholder is a miss")
+        {
+            REQUIRE(IsPinned(3));
+            REQUIRE(cache.GetStatistics().misses == 1);
+        }
+    }
+
+    WHEN("a tile outside of the parent is asked for")
+    {
+        THEN("it's black")
+        {
+            REQUIRE(is_black(cache.GetTile(child(4, 0)).Data16()));
+        }
+    }
+
+    WHEN("more placeholders than kFallbackTiles are needed in a frame")
+    {
+        for (auto i = 0u; i < kFallbackTiles; i++)
+        {
+            cache.GetTile(child(3, i));
+        }
+
+        THEN("the rest are black")
+        {
+            REQUIRE(is_black(cache.GetTile(child(2, 3)).Data16()));
+        }
+
+        AND_WHEN("the next frame begins")
+        {
+            cache.BeginFrame();
+
+            THEN("the placeholders are made again")
+            {
+                auto pixels = cache.GetTile(child(2, 3)).Data16();
+
+                REQUIRE(pixels[0] == 3 * kTileSize / 4 * kTileSize + 2 * kTileSize / 4);
+            }
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(TileCacheFixture, "tiles are fetched from the server in priority order")
+{
+    SetWifiConnected();
+
+    WHEN("there are tiles of every kind to fetch")
+    {
+        auto ui = MakeTiles(9600, 2);
+        auto background = MakeTiles(9601, 2);
+        auto region = MakeTiles(9602, 2);
+        auto reload = MakeTiles(9603, 1);
+        auto revalidate = MakeTiles(9604, 1);
+
+        QueueFetches(ui, background, region, reload, revalidate);
+        FillFromServer();
+        auto fetched = RunWebThread();
+
+        THEN("the UI tiles come first, the revalidated last")
+        {
+            // The UI and background tiles are stacks, the region a queue
+            REQUIRE(fetched == std::vector<Tile> {ui[1],
+                                                  ui[0],
+                                                  background[1],
+                                                  background[0],
+                                                  region[0],
+                                                  region[1],
+                                                  reload[0],
+                                                  revalidate[0]});
+        }
+
+        AND_THEN("the failed region tiles are queued again")
+        {
+            REQUIRE(RegionTilesInFlight() == 0);
+            REQUIRE(RegionTilesQueued() == region.size());
+
+            FillFromServer();
+            REQUIRE(RunWebThread() == region);
+        }
+
+        AND_WHEN("the region tiles keep failing")
+        {
+            for (auto i = 1u; i < kMaxRegionTileAttempts; i++)
+            {
+                FillFromServer();
+                REQUIRE(RunWebThread() == region);
+            }
+
+            THEN("they are given up, and counted as failed")
+            {
+                REQUIRE(RegionTilesQueued() == 0);
+                REQUIRE(RegionTilesInFlight() == 0);
+                REQUIRE(RegionTilesFailed() == region.size());
+                REQUIRE(state.CheckoutReadonly().Get<AS::region_download_failed>() ==
+                        region.size());
+                REQUIRE(state.CheckoutReadonly().Get<AS::region_download_done>() == 0);
+
+                FillFromServer();
+                REQUIRE(RunWebThread().empty());
+            }
+        }
+    }
+
+    WHEN("there are more UI tiles than fit in the web thread queue")
+    {
+        auto ui = MakeTiles(9600, kWebQueueSize + 4);
+        auto background = MakeTiles(9601, 2);
+        auto revalidate = MakeTiles(9604, 1);
+
+        QueueFetches(ui, background, {}, {}, revalidate);
+        FillFromServer();
+        auto fetched = RunWebThread();
+
+        THEN("only UI tiles are fetched")
+        {
+            REQUIRE(fetched.size() == kWebQueueSize);
+            for (const auto& tile : fetched)
+            {
+                REQUIRE(std::ranges::find(ui, tile) != ui.end());
+            }
+        }
+
+        AND_WHEN("the rest of the UI tiles have been handed out")
+        {
+            FillFromServer();
+            fetched = RunWebThread();
+
+            THEN("the lower priority tiles follow")
+            {
+                REQUIRE(fetched.size() == 4 + background.size() + revalidate.size());
+                REQUIRE(fetched[4] == background[1]);
+                REQUIRE(fetched.back() == revalidate[0]);
+            }
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(TileCacheFixture, "loose tiles are read into the pooled buffers")
+{
+    auto tile = MakeTiles(9600, 1).front();
+    auto png_path = std::format("tiles/{}/{}/{}.png", tile.zoom, tile.x, tile.y);
+    auto buffers = FreePngBuffers();
+
+    FORBID_CALL(filesystem, ReadFile(_)).WITH(_1 == png_path);
+
+    WHEN("a tile is loaded from the filesystem and decoded")
+    {
+        WriteLooseTile(tile, std::vector<std::byte>(100, std::byte {0x5a}));
+
+        cache.GetTile(tile);
+        FillFromColdStore();
+
+        THEN("it's read into one of the buffers")
+        {
+            REQUIRE(IsIndexed(tile));
+            REQUIRE(FreePngBuffers().size() == buffers.size() - 1);
+        }
+
+        AND_WHEN("the decode is done")
+        {
+            RunDecoders();
+            CompleteDecodes();
+
+            THEN("the same buffers are back, and none has been allocated")
+            {
+                REQUIRE(FreePngBuffers() == buffers);
+            }
+        }
+    }
+
+    WHEN("the tile isn't on the filesystem")
+    {
+        cache.GetTile(tile);
+        FillFromColdStore();
+
+        THEN("the buffer is kept")
+        {
+            REQUIRE_FALSE(IsIndexed(tile));
+            REQUIRE(FreePngBuffers() == buffers);
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(TileCacheFixture, "tile ages are only checked in the background")
+{
+    auto tile = MakeTiles(9600, 1).front();
+    auto meta_path = std::format("tiles/{}/{}/{}.meta", tile.zoom, tile.x, tile.y);
+    auto day = int64_t {24 * 60 * 60};
+
+    SetWifiConnected();
+    SetMaxTileAgeDays(30);
+
+    WHEN("a tile is loaded from the filesystem")
+    {
+        WriteLooseTile(tile, std::vector<std::byte>(100, std::byte {0x5a}));
+        FORBID_CALL(filesystem, ReadFile(_)).WITH(_1 == meta_path);
+
+        cache.GetTile(tile);
+        FillFromColdStore();
+
+        THEN("its metadata is not touched, but it's queued for an age check")
+        {
+            REQUIRE(IsIndexed(tile));
+            REQUIRE_FALSE(written_files.contains(meta_path));
+            REQUIRE(IsAgeCheckQueued(tile));
+        }
+    }
+
+    WHEN("a tile fetched within the max age is checked")
+    {
+        auto meta = TileMetaData(1234, SecondsSinceEpoch() - 29 * day);
+        REQUIRE_CALL(filesystem, ReadFile(_)).WITH(_1 == meta_path).RETURN(meta);
+
+        CheckTileAges({tile});
+
+        THEN("it's kept as it is")
+        {
+            REQUIRE_FALSE(IsRevalidationQueued(tile));
+        }
+    }
+
+    WHEN("a tile older than the max age is checked")
+    {
+        auto meta = TileMetaData(1234, SecondsSinceEpoch() - 31 * day);
+        REQUIRE_CALL(filesystem, ReadFile(_)).WITH(_1 == meta_path).RETURN(meta);
+
+        CheckTileAges({tile});
+
+        THEN("it's fetched again")
+        {
+            REQUIRE(IsRevalidationQueued(tile));
+
+            FillFromServer();
+            REQUIRE(RunWebThread() == std::vector<Tile> {tile});
+            REQUIRE_FALSE(IsRevalidationQueued(tile));
+        }
+    }
+
+    WHEN("a tile without metadata is checked")
+    {
+        CheckTileAges({tile});
+
+        THEN("it starts aging now, with an unknown content")
+        {
+            REQUIRE(written_files.contains(meta_path));
+            auto meta = ParseTileMeta(written_files[meta_path]);
+
+            REQUIRE(meta.content_hash == 0);
+            REQUIRE(std::abs(meta.fetched_at - SecondsSinceEpoch()) < 60);
+            REQUIRE_FALSE(IsRevalidationQueued(tile));
+        }
+    }
+
+    WHEN("tiles never expire")
+    {
+        FORBID_CALL(filesystem, ReadFile(_)).WITH(_1 == meta_path);
+
+        SetMaxTileAgeDays(0);
+        CheckTileAges({tile});
+
+        THEN("nothing is checked")
+        {
+            REQUIRE_FALSE(IsAgeCheckQueued(tile));
+            REQUIRE_FALSE(IsRevalidationQueued(tile));
+        }
+    }
+
+    WHEN("the UI waits for tiles from the server")
+    {
+        FORBID_CALL(filesystem, ReadFile(_)).WITH(_1 == meta_path);
+
+        QueueFetches(MakeTiles(9601, 1), {}, {}, {}, {});
+        CheckTileAges({tile});
+
+        THEN("the age check waits")
+        {
+            REQUIRE(IsAgeCheckQueued(tile));
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(TileCacheFixture, "unchanged tiles are not written again")
+{
+    auto tile = MakeTiles(9600, 1).front();
+    auto png_path = std::format("tiles/{}/{}/{}.png", tile.zoom, tile.x, tile.y);
+    auto meta_path = std::format("tiles/{}/{}/{}.meta", tile.zoom, tile.x, tile.y);
+    auto png = std::vector<std::byte>(300, std::byte {0x5a});
+
+    auto server = NAMED_ALLOW_CALL(*https_client, Get(_)).LR_RETURN(png);
+    SetWifiConnected();
+
+    // The first time, without metadata
+    QueueFetches({}, {}, {}, {}, {tile});
+    FillFromServer();
+    RunWebThread();
+
+    REQUIRE(written_files.contains(png_path));
+    REQUIRE(written_files.contains(meta_path));
+    auto meta = written_files[meta_path];
+    auto first = ParseTileMeta(meta);
+    REQUIRE(first.content_hash != 0);
+
+    auto read_meta =
+        NAMED_ALLOW_CALL(filesystem, ReadFile(_)).WITH(_1 == meta_path).LR_RETURN(meta);
+    written_files.clear();
+
+    WHEN("it's fetched again unchanged the same day")
+    {
+        QueueFetches({}, {}, {}, {}, {tile});
+        FillFromServer();
+        RunWebThread();
+
+        THEN("nothing is written")
+        {
+            REQUIRE(written_files.empty());
+        }
+    }
+
+    WHEN("it's fetched again unchanged a few days later")
+    {
+        meta = TileMetaData(first.content_hash, first.fetched_at - 3 * 24 * 60 * 60);
+
+        QueueFetches({}, {}, {}, {}, {tile});
+        FillFromServer();
+        RunWebThread();
+
+        THEN("only the new age is written")
+        {
+            REQUIRE_FALSE(written_files.contains(png_path));
+            REQUIRE(written_files.contains(meta_path));
+            REQUIRE(ParseTileMeta(written_files[meta_path]).fetched_at >= first.fetched_at);
+        }
+    }
+
+    WHEN("it has changed on the server")
+    {
+        png.back() = std::byte {0xa5};
+
+        QueueFetches({}, {}, {}, {}, {tile});
+        FillFromServer();
+        RunWebThread();
+
+        THEN("both the tile and the metadata are written")
+        {
+            REQUIRE(written_files[png_path] == png);
+            REQUIRE(ParseTileMeta(written_files[meta_path]).content_hash != first.content_hash);
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(TileCacheFixture, "region downloads can be started from another thread")
+{
+    auto origin = ToPoint(Tile {17600, 9500, kDefaultZoom});
+    auto zooms = std::array<uint8_t, 2> {kCityZoom, kDefaultZoom};
+
+    WHEN("a route is requested")
+    {
+        auto route = std::array {origin, origin + Point {5 * kTileSize, 0, kDefaultZoom}};
+
+        cache.StartRegionDownload(route, 0, zooms);
+
+        THEN("nothing is queued until the tile cache thread runs")
+        {
+            REQUIRE(RegionTilesQueued() == 0);
+        }
+
+        AND_WHEN("the tile cache thread runs")
+        {
+            ApplyRegionDownloadRequest();
+
+            THEN("the tiles along the route are queued for all zoom levels")
+            {
+                auto expected = TilesAlongRoute(route, kCityZoom, 0).size() +
+                                TilesAlongRoute(route, kDefaultZoom, 0).size();
+
+                REQUIRE(RegionTilesQueued() == expected);
+                REQUIRE(RegionTilesTotal() == expected);
+                REQUIRE(written_files.contains("pending/region.bin"));
+            }
+        }
+    }
+
+    WHEN("a box is requested after an earlier download")
+    {
+        auto corner = origin + Point {kTileSize, kTileSize, kDefaultZoom};
+
+        QueueFetches({}, {}, MakeTiles(9602, 8), {}, {});
+        cache.StartRegionDownload(origin, corner, zooms);
+        ApplyRegionDownloadRequest();
+
+        THEN("the earlier download is replaced by the tiles in the box")
+        {
+            auto expected = TilesInBox(origin, corner, kCityZoom).size() +
+                            TilesInBox(origin, corner, kDefaultZoom).size();
+
+            REQUIRE(RegionTilesQueued() == expected);
+            REQUIRE(RegionTilesTotal() == expected);
+        }
+    }
+}
+
+TEST_CASE("regions are enumerated as tiles")
+{
+    auto origin = ToPoint(Tile {17600, 9500, kDefaultZoom});
+
+    WHEN("enumerating a bounding box")
+    {
+        auto tiles = TilesInBox(origin + Point {3 * kTileSize + 10, 2 * kTileSize, kDefaultZoom},
+                                origin,
+                                kDefaultZoom);
+
+        THEN("all tiles in the box are included once")
+        {
+            REQUIRE(tiles.size() == 4 * 3);
+            REQUIRE(std::ranges::find(tiles, Tile {17603, 9502, kDefaultZoom}) != tiles.end());
+            REQUIRE(std::ranges::find(tiles, Tile {17604, 9502, kDefaultZoom}) == tiles.end());
+        }
+    }
+
+    WHEN("enumerating a route")
+    {
+        auto route = std::array {
+            origin,
+            origin + Point {5 * kTileSize, 0, kDefaultZoom},
+            origin + Point {5 * kTileSize, 5 * kTileSize, kDefaultZoom},
+        };
+        auto tiles = TilesAlongRoute(route, kDefaultZoom, 0);
+
+        THEN("the tiles along the route are included once, in route order")
+        {
+            REQUIRE(tiles.size() == 11);
+            REQUIRE(tiles.front() == Tile {17600, 9500, kDefaultZoom});
+            REQUIRE(tiles[5] == Tile {17605, 9500, kDefaultZoom});
+            REQUIRE(tiles.back() == Tile {17605, 9505, kDefaultZoom});
+        }
+
+        AND_WHEN("adding a margin")
+        {
+            auto wide = TilesAlongRoute(route, kDefaultZoom, 1);
+
+            THEN("the neighbouring tiles are included too")
+            {
+                REQUIRE(wide.size() == 7 * 3 + 3 * 6);
+                REQUIRE(std::ranges::find(wide, Tile {17606, 9506, kDefaultZoom}) != wide.end());
+            }
+        }
+    }
+}
+
+TEST_SUITE_END();
@@ -2,6 +2,9 @@
 #include "thread_fixture.hh"
 #include "trip_computer.hh"
 
+#include <algorithm>
+#include <vector>
+
 
 namespace
 {
@@ -239,4 +242,153 @@ TEST_CASE_FIXTURE(Fixture, "power histograms are zeroed by default")
     }
 }
 
+TEST_CASE_FIXTURE(Fixture, "the display log keeps the shape of the trip")
+{
+    constexpr auto kStartX = 100000;
+    constexpr auto kStartY = 200000;
+
+    auto rw = state.CheckoutReadWrite();
+    rw.Set<AS::gps_position_valid>(true);
+
+    // An L-shaped trip, with many more points than fit in the display log
+    std::vector<Point> trip;
+    for (auto i = 0; i <= 200; i++)
+    {
+        trip.push_back(Point {kStartX + i * 10, kStartY, kDefaultZoom});
+    }
+    for (auto i = 1; i <= 200; i++)
+    {
+        trip.push_back(Point {kStartX + 2000, kStartY + i * 10, kDefaultZoom});
+    }
+
+    for (const auto& point : trip)
+    {
+        rw.Set<AS::pixel_position>(point);
+        DoRunLoop();
+    }
+
+    THEN("the start, the corner and the end are kept")
+    {
+        auto [log, revision] = trip_computer.GetDisplayLog(kDefaultZoom);
+        auto is_in_log = [&log](int32_t x, int32_t y) {
+            return std::ranges::any_of(log, [x, y](const auto& entry) {
+                return entry.position.x == x && entry.position.y == y;
+            });
+        };
+
+        REQUIRE(revision != 0);
+        REQUIRE(revision == trip_computer.GetDisplayLogRevision(kDefaultZoom));
+        REQUIRE(log.size() <= TripComputer::kNumberOfDisplayLogEntries + 1);
+        REQUIRE(log.front().position.x == kStartX);
+        REQUIRE(log.front().position.y == kStartY);
+        REQUIRE(log.back().position.x == trip.back().x);
+        REQUIRE(log.back().position.y == trip.back().y);
+        REQUIRE(is_in_log(kStartX, kStartY));
+        REQUIRE(is_in_log(kStartX + 2000, kStartY));
+    }
+}
+
+TEST_CASE_FIXTURE(Fixture, "the display log is published as it changes")
+{
+    constexpr auto kStartX = 100000;
+    constexpr auto kStartY = 200000;
+
+    auto rw = state.CheckoutReadWrite();
+    rw.Set<AS::gps_position_valid>(true);
+
+    // A zig-zag, so that the simplification has to drop entries all along
+    auto position_at = [](int i) {
+        return Point {kStartX + i * 10, kStartY + (i % 4 < 2 ? 0 : 30), kDefaultZoom};
+    };
+
+    auto check_log = [this, &position_at](int last) {
+        auto [log, revision] = trip_computer.GetDisplayLog(kDefaultZoom);
+
+        REQUIRE(revision == trip_computer.GetDisplayLogRevision(kDefaultZoom));
+        REQUIRE(log.size() <= TripComputer::kNumberOfDisplayLogEntries + 1);
+        REQUIRE(log.front().position == position_at(0));
+        REQUIRE(log.back().position == position_at(last));
+        REQUIRE(std::ranges::is_sorted(log, {}, [](const auto& entry) {
+            return entry.position.x;
+        }));
+    };
+
+    WHEN("the log is read after every point")
+    {
+        for (auto i = 0; i < 300; i++)
+        {
+            rw.Set<AS::pixel_position>(position_at(i));
+            DoRunLoop();
+
+            check_log(i);
+        }
+    }
+
+    WHEN("the log is only read now and then")
+    {
+        for (auto i = 0; i < 300; i++)
+        {
+            rw.Set<AS::pixel_position>(position_at(i));
+            DoRunLoop();
+
+            if (i % 37 == 0)
+            {
+                check_log(i);
+            }
+        }
+        check_log(299);
+    }
+}
+
+TEST_CASE_FIXTURE(Fixture, "there is a display log for each map zoom")
+{
+    constexpr auto kStartX = 100000;
+    constexpr auto kStartY = 200000;
+    constexpr auto kPoints = 600;
+
+    auto rw = state.CheckoutReadWrite();
+    rw.Set<AS::gps_position_valid>(true);
+
+    // A small wiggle, which is visible when zoomed in but not when zoomed out
+    auto position_at = [](int i) {
+        return Point {kStartX + i * 10, kStartY + ((i / 2) % 2) * 8, kDefaultZoom};
+    };
+
+    for (auto i = 0; i < kPoints; i++)
+    {
+        rw.Set<AS::pixel_position>(position_at(i));
+        DoRunLoop();
+    }
+
+    std::vector<size_t> sizes;
+    for (auto zoom : TripComputer::kDisplayLogZooms)
+    {
+        auto [log, revision] = trip_computer.GetDisplayLog(zoom);
+
+        // Positions are skipped until they are 5 pixels away at the zoom
+        const auto min_distance = 5 << (kDefaultZoom - zoom);
+
+        REQUIRE(revision == trip_computer.GetDisplayLogRevision(zoom));
+        REQUIRE(log.size() <= TripComputer::kNumberOfDisplayLogEntries + 1);
+        REQUIRE(log.front().position == position_at(0));
+        REQUIRE(position_at(kPoints - 1).x - log.back().position.x < min_distance);
+        sizes.push_back(log.size());
+    }
+
+    THEN("the wiggle is only kept when it can be seen")
+    {
+        REQUIRE(sizes[0] == TripComputer::kNumberOfDisplayLogEntries + 1);
+        REQUIRE(sizes[2] < sizes[1]);
+        REQUIRE(sizes[2] <= 3);
+    }
+
+    THEN("zooms in between use the more detailed log")
+    {
+        REQUIRE(trip_computer.GetDisplayLog(kDefaultZoom + 1).entries.size() == sizes[0]);
+        REQUIRE(trip_computer.GetDisplayLog(kCityZoom + 1).entries.size() == sizes[0]);
+        REQUIRE(trip_computer.GetDisplayLog(kLandscapeZoom + 1).entries.size() == sizes[1]);
+        REQUIRE(trip_computer.GetDisplayLog(kLandscapeZoom).entries.size() == sizes[2]);
+    }
+}
+
 TEST_SUITE_END();
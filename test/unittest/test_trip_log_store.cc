@@ -0,0 +1,372 @@
+#include "test.hh"
+#include "trip_log_store.hh"
+
+#include <map>
+#include <memory>
+
+TEST_SUITE_BEGIN("trip_log_store");
+
+namespace
+{
+
+class Fixture
+{
+public:
+    std::unique_ptr<TripLogStore>
+    CreateStore(uint32_t max_blocks = TripLogStore::kDefaultMaxBlocks)
+    {
+        return std::make_unique<TripLogStore>(
+            "trip_log",
+            [this](const auto& path) -> std::optional<std::vector<std::byte>> {
+                if (auto it = files.find(path); it != files.end())
+                {
+                    return it->second;
+                }
+                return std::nullopt;
+            },
+            [this](const auto& path, auto data) {
+                files[path] = std::vector<std::byte>(data.begin(), data.end());
+                writes[path]++;
+            },
+            max_blocks);
+    }
+
+    std::vector<TripLogStore::Record> ReadTrip(const TripLogStore& store, uint32_t trip)
+    {
+        std::vector<TripLogStore::Record> out;
+
+        store.ForEachRecord(trip, [&out](const auto& record) { out.push_back(record); });
+
+        return out;
+    }
+
+    std::map<std::string, std::vector<std::byte>> files;
+    std::map<std::string, int> writes;
+};
+
+TripLogStore::Record
+MakeRecord(int i)
+{
+    // A ride eastwards from Karlstad
+    return TripLogStore::Record {Point {17600 * 256 + i * 37, 9530 * 256 - i * 11, kDefaultZoom},
+                                 milliseconds(1000 + i * 250),
+                                 static_cast<int16_t>(200 + (i % 7) * 100 - 300)};
+}
+
+bool
+operator==(const TripLogStore::Record& a, const TripLogStore::Record& b)
+{
+    return a.position == b.position && a.timestamp == b.timestamp && a.power == b.power;
+}
+
+} // namespace
+
+TEST_CASE_FIXTURE(Fixture, "the trip log store reads back what was written")
+{
+    auto store = CreateStore();
+    store->Load();
+    store->StartTrip();
+
+    auto trip = store->CurrentTrip();
+
+    REQUIRE(ReadTrip(*store, trip).empty());
+
+    WHEN("records are added and flushed")
+    {
+        for (auto i = 0; i < 40; i++)
+        {
+            store->Add(MakeRecord(i));
+        }
+        store->Flush();
+
+        THEN("the same records are read back")
+        {
+            auto records = ReadTrip(*store, trip);
+
+            REQUIRE(records.size() == 40);
+            for (auto i = 0; i < 40; i++)
+            {
+                REQUIRE(records[i] == MakeRecord(i));
+            }
+        }
+
+        AND_WHEN("a new trip is started")
+        {
+            store->StartTrip();
+            store->Add(MakeRecord(100));
+            store->Add(MakeRecord(101));
+            store->Flush();
+
+            THEN("the trips are kept apart")
+            {
+                REQUIRE(store->CurrentTrip() == trip + 1);
+                REQUIRE(ReadTrip(*store, trip).size() == 40);
+
+                auto records = ReadTrip(*store, trip + 1);
+                REQUIRE(records.size() == 2);
+                REQUIRE(records[0] == MakeRecord(100));
+                REQUIRE(records[1] == MakeRecord(101));
+            }
+        }
+
+        AND_WHEN("the store is loaded again, as after a reboot")
+        {
+            auto reloaded = CreateStore();
+            reloaded->Load();
+
+            THEN("the previous trip is found")
+            {
+                REQUIRE(reloaded->CurrentTrip() == trip);
+                REQUIRE(ReadTrip(*reloaded, trip).size() == 40);
+            }
+
+            AND_THEN("new trips continue after it")
+            {
+                reloaded->StartTrip();
+                reloaded->Add(MakeRecord(0));
+                reloaded->Flush();
+
+                REQUIRE(reloaded->CurrentTrip() == trip + 1);
+                REQUIRE(ReadTrip(*reloaded, trip).size() == 40);
+                REQUIRE(ReadTrip(*reloaded, trip + 1).size() == 1);
+            }
+        }
+    }
+
+    WHEN("records are added without a flush")
+    {
+        for (auto i = 0; i < TripLogStore::kFlushInterval + 3; i++)
+        {
+            store->Add(MakeRecord(i));
+        }
+
+        THEN("they are all read back from RAM")
+        {
+            REQUIRE(ReadTrip(*store, trip).size() == TripLogStore::kFlushInterval + 3);
+        }
+
+        AND_THEN("they are written every kFlushInterval records")
+        {
+            auto reloaded = CreateStore();
+            reloaded->Load();
+
+            REQUIRE(ReadTrip(*reloaded, trip).size() == TripLogStore::kFlushInterval);
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(Fixture, "the trip log store survives a power loss")
+{
+    constexpr auto kRecords = 2 * TripLogStore::kFlushInterval + 3;
+
+    auto store = CreateStore();
+    store->Load();
+    store->StartTrip();
+
+    auto trip = store->CurrentTrip();
+
+    for (auto i = 0; i < kRecords; i++)
+    {
+        store->Add(MakeRecord(i));
+    }
+
+    // Only the two tail chunks, the block is still in RAM
+    REQUIRE(files.size() == 2);
+
+    WHEN("the power is lost")
+    {
+        auto reloaded = CreateStore();
+        reloaded->Load();
+
+        THEN("the records in the tail chunks are recovered")
+        {
+            auto records = ReadTrip(*reloaded, trip);
+
+            REQUIRE(reloaded->CurrentTrip() == trip);
+            REQUIRE(records.size() == 2 * TripLogStore::kFlushInterval);
+            REQUIRE(records.back() == MakeRecord(2 * TripLogStore::kFlushInterval - 1));
+        }
+
+        AND_THEN("they are written as a block")
+        {
+            REQUIRE(writes["trip_log/000000.bin"] == 1);
+
+            reloaded->StartTrip();
+            reloaded->Add(MakeRecord(0));
+
+            REQUIRE(ReadTrip(*reloaded, trip).size() == 2 * TripLogStore::kFlushInterval);
+            REQUIRE(ReadTrip(*reloaded, trip + 1).size() == 1);
+        }
+    }
+
+    WHEN("the latest tail chunk is torn")
+    {
+        auto& latest = files["trip_log/tail_0001.bin"];
+        REQUIRE(latest.size() > 30);
+        latest[30] ^= std::byte {0x5a};
+
+        auto reloaded = CreateStore();
+        reloaded->Load();
+
+        THEN("the records up to the chunk before are recovered")
+        {
+            auto records = ReadTrip(*reloaded, trip);
+
+            REQUIRE(records.size() == TripLogStore::kFlushInterval);
+            REQUIRE(records.back() == MakeRecord(TripLogStore::kFlushInterval - 1));
+        }
+    }
+
+    WHEN("the power is lost while the block is written")
+    {
+        store->StartTrip();
+
+        auto& block = files["trip_log/000000.bin"];
+        block.resize(block.size() / 2);
+
+        auto reloaded = CreateStore();
+        reloaded->Load();
+
+        THEN("the block is rewritten from the tail chunks")
+        {
+            REQUIRE(reloaded->CurrentTrip() == trip);
+            REQUIRE(ReadTrip(*reloaded, trip).size() == 2 * TripLogStore::kFlushInterval);
+            REQUIRE(writes["trip_log/000000.bin"] == 2);
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(Fixture, "long trips are split into blocks")
+{
+    auto store = CreateStore();
+    store->Load();
+    store->StartTrip();
+
+    auto trip = store->CurrentTrip();
+
+    // Some 4-6 bytes per record, so this fills a few blocks
+    constexpr auto kRecords = 4000;
+    for (auto i = 0; i < kRecords; i++)
+    {
+        store->Add(MakeRecord(i));
+    }
+    store->Flush();
+
+    auto records = ReadTrip(*store, trip);
+
+    REQUIRE(files.contains("trip_log/000002.bin"));
+    REQUIRE(records.size() == kRecords);
+    for (auto i = 0; i < kRecords; i++)
+    {
+        REQUIRE(records[i] == MakeRecord(i));
+    }
+
+    for (const auto& [path, data] : files)
+    {
+        REQUIRE(data.size() <= TripLogStore::kBlockSize);
+    }
+
+    // Each block is written once, and not rewritten as it fills up
+    for (const auto& [path, count] : writes)
+    {
+        REQUIRE((count == 1 || path.starts_with("trip_log/tail_")));
+    }
+
+    WHEN("the store is loaded again")
+    {
+        auto reloaded = CreateStore();
+        reloaded->Load();
+
+        THEN("all blocks are found")
+        {
+            REQUIRE(ReadTrip(*reloaded, trip).size() == kRecords);
+        }
+    }
+}
+
+TEST_CASE_FIXTURE(Fixture, "the trip log is kept in a ring of blocks")
+{
+    constexpr uint32_t kMaxBlocks = 4;
+
+    auto store = CreateStore(kMaxBlocks);
+    store->Load();
+
+    // Each short trip gets a block of its own
+    auto add_trips = [](TripLogStore& s, int trips) {
+        for (auto i = 0; i < trips; i++)
+        {
+            s.StartTrip();
+            s.Add(MakeRecord(i));
+            s.Add(MakeRecord(i + 1));
+            s.Flush();
+        }
+    };
+
+    WHEN("more trips than there are blocks are written")
+    {
+        add_trips(*store, kMaxBlocks + 2);
+
+        THEN("the oldest trip is overwritten")
+        {
+            // The blocks, and the tail chunk of the latest trip which is still in RAM
+            REQUIRE(store->CurrentTrip() == kMaxBlocks + 2);
+            REQUIRE(files.size() == kMaxBlocks + 1);
+            REQUIRE(ReadTrip(*store, 1).empty());
+            for (auto trip = 2u; trip <= kMaxBlocks + 2; trip++)
+            {
+                REQUIRE(ReadTrip(*store, trip).size() == 2);
+            }
+        }
+
+        AND_WHEN("the store is loaded again")
+        {
+            auto reloaded = CreateStore(kMaxBlocks);
+            reloaded->Load();
+
+            THEN("the latest trip is found")
+            {
+                REQUIRE(reloaded->CurrentTrip() == kMaxBlocks + 2);
+                REQUIRE(ReadTrip(*reloaded, kMaxBlocks + 2).size() == 2);
+            }
+
+            AND_THEN("new trips continue after it, over the oldest one")
+            {
+                add_trips(*reloaded, 1);
+
+                REQUIRE(reloaded->CurrentTrip() == kMaxBlocks + 3);
+                REQUIRE(ReadTrip(*reloaded, kMaxBlocks + 3).size() == 2);
+                REQUIRE(ReadTrip(*reloaded, 2).empty());
+                REQUIRE(ReadTrip(*reloaded, 3).size() == 2);
+                REQUIRE(files.size() == kMaxBlocks + 1);
+            }
+        }
+    }
+
+    WHEN("a block write in the next round of the ring is torn")
+    {
+        add_trips(*store, kMaxBlocks + 1);
+
+        // The last trip is written over the first trip in position 0
+        store->StartTrip();
+        auto& latest = files["trip_log/000000.bin"];
+        latest.resize(latest.size() / 2);
+
+        auto reloaded = CreateStore(kMaxBlocks);
+        reloaded->Load();
+
+        THEN("the torn block is written again from the tail chunk")
+        {
+            REQUIRE(reloaded->CurrentTrip() == kMaxBlocks + 1);
+            REQUIRE(ReadTrip(*reloaded, kMaxBlocks + 1).size() == 2);
+            REQUIRE(ReadTrip(*reloaded, 1).empty());
+        }
+
+        AND_THEN("new trips continue after it")
+        {
+            add_trips(*reloaded, 1);
+
+            REQUIRE(ReadTrip(*reloaded, kMaxBlocks + 2).size() == 2);
+            REQUIRE(ReadTrip(*reloaded, 2).size() == 2);
+        }
+    }
+}
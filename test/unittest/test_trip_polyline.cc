@@ -0,0 +1,72 @@
+#include "test.hh"
+#include "trip_polyline.hh"
+
+#include <array>
+#include <vector>
+
+TEST_SUITE_BEGIN("trip_polyline");
+
+TEST_CASE("the trip polyline caches the display log at one zoom")
+{
+    auto log = std::array {
+        TripComputer::DisplayTripLogEntry {Point {1000, 1000, kDefaultZoom}, 100},
+        TripComputer::DisplayTripLogEntry {Point {1200, 1000, kDefaultZoom}, 200},
+        TripComputer::DisplayTripLogEntry {Point {1200, 5000, kDefaultZoom}, 300},
+    };
+
+    TripPolyline polyline;
+    REQUIRE_FALSE(polyline.IsCurrent(kDefaultZoom, 0));
+
+    polyline.Update(log, kDefaultZoom, 7);
+
+    THEN("it's current for that zoom and revision only")
+    {
+        REQUIRE(polyline.IsCurrent(kDefaultZoom, 7));
+        REQUIRE_FALSE(polyline.IsCurrent(kDefaultZoom, 8));
+        REQUIRE_FALSE(polyline.IsCurrent(kCityZoom, 7));
+    }
+
+    THEN("there is one segment per pair of log entries")
+    {
+        REQUIRE(polyline.Size() == 2);
+    }
+
+    WHEN("looking up the segments in a view")
+    {
+        std::vector<TripComputer::PowerType> visible;
+        auto collect = [&visible](const auto& segment) { visible.push_back(segment.power); };
+
+        THEN("only the segments touching it are returned")
+        {
+            polyline.ForEachVisible(1100, 900, 1150, 1100, collect);
+            REQUIRE(visible == std::vector<TripComputer::PowerType> {200});
+
+            visible.clear();
+            polyline.ForEachVisible(1150, 900, 1250, 1100, collect);
+            REQUIRE(visible == std::vector<TripComputer::PowerType> {200, 300});
+
+            visible.clear();
+            polyline.ForEachVisible(0, 0, 500, 500, collect);
+            REQUIRE(visible.empty());
+        }
+    }
+
+    WHEN("the polyline is updated for another zoom")
+    {
+        polyline.Update(log, kCityZoom, 7);
+
+        THEN("the points are scaled to it")
+        {
+            std::vector<TripPolyline::Segment> segments;
+            polyline.ForEachVisible(0, 0, 10000, 10000, [&segments](const auto& segment) {
+                segments.push_back(segment);
+            });
+
+            REQUIRE(segments.size() == 2);
+            REQUIRE(segments[0].from.x == 250);
+            REQUIRE(segments[0].to.x == 300);
+            REQUIRE(segments[1].to.y == 1250);
+            REQUIRE(segments[1].to.zoom == kCityZoom);
+        }
+    }
+}
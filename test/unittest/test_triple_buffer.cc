@@ -0,0 +1,113 @@
+#include "test.hh"
+#include "triple_buffer.hh"
+
+#include <array>
+#include <thread>
+
+TEST_SUITE_BEGIN("triple_buffer");
+
+TEST_CASE("the triple buffer hands over the latest version")
+{
+    TripleBuffer<int> buffer;
+
+    auto [initial, initial_revision] = buffer.Read();
+    REQUIRE(initial == 0);
+    REQUIRE(initial_revision == 0);
+    REQUIRE(buffer.LatestRevision() == 0);
+
+    WHEN("a value is published")
+    {
+        buffer.WriteBuffer() = 17;
+        buffer.Publish();
+
+        THEN("the reader gets it, with the revision")
+        {
+            REQUIRE(buffer.LatestRevision() == 1);
+
+            auto [value, revision] = buffer.Read();
+            REQUIRE(value == 17);
+            REQUIRE(revision == 1);
+        }
+
+        AND_THEN("reading again gives the same snapshot")
+        {
+            auto first = buffer.Read();
+            auto second = buffer.Read();
+
+            REQUIRE(&first.value == &second.value);
+            REQUIRE(second.revision == 1);
+        }
+    }
+
+    WHEN("several values are published between reads")
+    {
+        for (auto i = 1; i <= 5; i++)
+        {
+            buffer.WriteBuffer() = i * 10;
+            buffer.Publish();
+        }
+
+        THEN("only the latest is seen")
+        {
+            auto [value, revision] = buffer.Read();
+            REQUIRE(value == 50);
+            REQUIRE(revision == 5);
+        }
+    }
+
+    WHEN("the reader holds a snapshot while the writer continues")
+    {
+        buffer.WriteBuffer() = 1;
+        buffer.Publish();
+
+        auto snapshot = buffer.Read();
+        for (auto i = 2; i <= 10; i++)
+        {
+            buffer.WriteBuffer() = i;
+            buffer.Publish();
+        }
+
+        THEN("the snapshot is left untouched")
+        {
+            REQUIRE(snapshot.value == 1);
+            REQUIRE(snapshot.revision == 1);
+        }
+    }
+}
+
+TEST_CASE("the triple buffer can be read while it is written")
+{
+    constexpr auto kVersions = 20000u;
+
+    // Each version is filled with its own number, so a torn read shows up as a mix
+    TripleBuffer<std::array<uint32_t, 64>> buffer;
+
+    auto writer = std::thread([&buffer]() {
+        for (auto i = 1u; i <= kVersions; i++)
+        {
+            buffer.WriteBuffer().fill(i);
+            buffer.Publish();
+        }
+    });
+
+    auto last_revision = 0u;
+    auto torn = false;
+    auto out_of_order = false;
+    while (last_revision < kVersions)
+    {
+        auto [value, revision] = buffer.Read();
+
+        for (auto v : value)
+        {
+            torn |= v != revision;
+        }
+        out_of_order |= revision < last_revision;
+        last_revision = revision;
+    }
+    writer.join();
+
+    REQUIRE_FALSE(torn);
+    REQUIRE_FALSE(out_of_order);
+}
+
+TEST_SUITE_END();
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+/**
+ * @brief Host micro-benchmarks of the hot paths, run with tools/benchmark/radbuzz_benchmark
+ *
+ * Each benchmark prints one line per case, with the time per call and whatever else it
+ * measures. Build in release mode, the sanitizers of the debug build dominate the times.
+ */
+namespace benchmark
+{
+
+// Results are stored here so that the compiler can't drop the work that produced them
+inline volatile uint32_t g_sink;
+
+// The average time of one call to fn, in nanoseconds
+template <typename Fn>
+double
+NanosecondsPerCall(uint32_t calls, Fn&& fn)
+{
+    // Warm up the caches first
+    for (auto i = 0u; i < calls / 10 + 1; i++)
+    {
+        fn();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto i = 0u; i < calls; i++)
+    {
+        fn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    return std::chrono::duration<double, std::nano>(elapsed).count() / calls;
+}
+
+void TileLookup();
+void PolylineRasterizer();
+void Rotation();
+void Simplification();
+
+} // namespace benchmark
@@ -0,0 +1,57 @@
+// Run the host micro-benchmarks, all of them or the ones named on the command line
+#include "benchmark.hh"
+
+#include <array>
+#include <string_view>
+#include <utility>
+
+namespace
+{
+
+constexpr auto kBenchmarks = std::array {
+    std::pair {std::string_view {"tile_lookup"}, &benchmark::TileLookup},
+    std::pair {std::string_view {"polyline"}, &benchmark::PolylineRasterizer},
+    std::pair {std::string_view {"rotation"}, &benchmark::Rotation},
+    std::pair {std::string_view {"simplification"}, &benchmark::Simplification},
+};
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+    auto selected = [argc, argv](std::string_view name) {
+        for (auto i = 1; i < argc; i++)
+        {
+            if (name == argv[i])
+            {
+                return true;
+            }
+        }
+
+        return argc == 1;
+    };
+
+    auto ran = false;
+    for (const auto& [name, run] : kBenchmarks)
+    {
+        if (selected(name))
+        {
+            printf("%s\n", name.data());
+            run();
+            ran = true;
+        }
+    }
+
+    if (!ran)
+    {
+        fprintf(stderr, "Usage: %s [benchmark...]\n", argv[0]);
+        for (const auto& [name, run] : kBenchmarks)
+        {
+            fprintf(stderr, "  %s\n", name.data());
+        }
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Drawing a trip line and a range circle with the scanline rasterizer, against the
+// per-segment painter lines it replaced
+#include "benchmark.hh"
+#include "cohen_sutherland.hh"
+#include "painter.hh"
+#include "polyline_rasterizer.hh"
+
+#include <cmath>
+#include <numbers>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+// The simulator display, which is what painter draws into
+constexpr auto kDisplayWidth = 800;
+constexpr auto kDisplayHeight = 480;
+constexpr auto kLineWidth = 5;
+constexpr auto kFrames = 500u;
+
+// A full display log, winding across the display and partly off it
+std::vector<polyline_rasterizer::Vertex>
+TripVertices()
+{
+    auto random = std::mt19937 {19};
+    auto noise = std::uniform_int_distribution<int32_t> {-20, 20};
+    std::vector<polyline_rasterizer::Vertex> out;
+
+    for (auto i = 0u; i < polyline_rasterizer::kMaxVertices; i++)
+    {
+        auto angle = static_cast<double>(i) / polyline_rasterizer::kMaxVertices * 3 *
+                     std::numbers::pi;
+
+        out.push_back({static_cast<int32_t>(kDisplayWidth / 2 + std::cos(angle) * 500) +
+                           noise(random),
+                       static_cast<int32_t>(kDisplayHeight / 2 + std::sin(2 * angle) * 200) +
+                           noise(random),
+                       static_cast<uint16_t>(i * 0x0841)});
+    }
+
+    return out;
+}
+
+} // namespace
+
+void
+benchmark::PolylineRasterizer()
+{
+    auto pixels = std::vector<uint16_t>(kDisplayWidth * kDisplayHeight, 0xffff);
+    auto dst = polyline_rasterizer::Target {pixels.data(), kDisplayWidth, kDisplayHeight};
+    auto scratch = polyline_rasterizer::Scratch {};
+    auto vertices = TripVertices();
+
+    // As MapScreen drew the trip log before, clipped and drawn one segment at a time
+    auto segments_ns = NanosecondsPerCall(kFrames, [&pixels, &vertices]() {
+        for (auto i = 1u; i < vertices.size(); i++)
+        {
+            int32_t from_x = vertices[i - 1].x;
+            int32_t from_y = vertices[i - 1].y;
+            int32_t to_x = vertices[i].x;
+            int32_t to_y = vertices[i].y;
+
+            if (cs::ClipLineToDisplay(from_x, from_y, to_x, to_y))
+            {
+                painter::DrawClippedLine<Point>(pixels.data(),
+                                                {from_x, from_y},
+                                                {to_x, to_y},
+                                                kLineWidth,
+                                                vertices[i].color);
+            }
+        }
+        g_sink = pixels[0];
+    });
+    auto polyline_ns = NanosecondsPerCall(kFrames, [&pixels, &dst, &vertices, &scratch]() {
+        polyline_rasterizer::DrawPolyline(dst, vertices, kLineWidth, scratch);
+        g_sink = pixels[0];
+    });
+    auto ring_ns = NanosecondsPerCall(kFrames, [&pixels, &dst]() {
+        polyline_rasterizer::DrawRing(
+            dst, kDisplayWidth / 2, kDisplayHeight / 2, 300, kLineWidth, 0x0000);
+        g_sink = pixels[0];
+    });
+
+    printf("  %zu vertices: per-segment %6.0f us/frame, polyline %6.0f us/frame\n",
+           vertices.size(),
+           segments_ns / 1000,
+           polyline_ns / 1000);
+    printf("  range ring: %6.0f us/frame\n", ring_ns / 1000);
+}
@@ -0,0 +1,227 @@
+// Visvalingam-Whyatt simplification of a long trip, as TripComputer::Log does it, and with
+// the stale triangle areas it had before the neighbours were updated on removals
+#include "benchmark.hh"
+#include "indexed_min_heap.hh"
+#include "wgs84_to_osm_point.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <numbers>
+#include <optional>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+// Three hours at one position per second
+constexpr auto kTraceSeconds = 3 * 60 * 60;
+// What the trip log skips, in pixels at kDefaultZoom
+constexpr auto kMinDistance = 5;
+constexpr auto kMaxPoints = 16384;
+constexpr auto kRuns = 10u;
+
+constexpr auto kNoPoint = std::numeric_limits<uint16_t>::max();
+
+// The same doubled area as the trip computer ranks entries by
+uint32_t
+TriangleArea(const Point& a, const Point& b, const Point& c)
+{
+    const auto doubled_area = static_cast<int64_t>(b.x - a.x) * (c.y - a.y) -
+                              static_cast<int64_t>(c.x - a.x) * (b.y - a.y);
+    return static_cast<uint32_t>(std::min<int64_t>(std::abs(doubled_area),
+                                                   std::numeric_limits<uint32_t>::max() - 1));
+}
+
+/*
+ * A ride through a city grid at zoom 15, roughly 2 pixels per second. The heading wanders
+ * a bit and turns at the corners, and the GPS noise is a pixel. Positions closer than
+ * kMinDistance are skipped, as in the log.
+ */
+std::vector<Point>
+RecordTrace()
+{
+    auto random = std::mt19937 {2024};
+    auto noise = std::normal_distribution<double> {0, 1};
+    auto turn = std::uniform_int_distribution<int> {0, 99};
+
+    std::vector<Point> out;
+    auto x = 17000.0 * kTileSize;
+    auto y = 9000.0 * kTileSize;
+    auto heading = 0.0;
+    auto straight = 0.0;
+
+    for (auto second = 0; second < kTraceSeconds; second++)
+    {
+        auto speed = second % 600 < 60 ? 0.0 : 2.0;
+
+        heading += noise(random) * 0.02;
+        straight += speed;
+        if (straight > 150 && turn(random) < 5)
+        {
+            heading += (turn(random) < 50 ? 0.5 : -0.5) * std::numbers::pi;
+            straight = 0;
+        }
+        x += std::cos(heading) * speed;
+        y += std::sin(heading) * speed;
+
+        auto position = Point {static_cast<int32_t>(x + noise(random)),
+                               static_cast<int32_t>(y + noise(random)),
+                               kDefaultZoom};
+        if (out.empty() || std::abs(position.x - out.back().x) >= kMinDistance ||
+            std::abs(position.y - out.back().y) >= kMinDistance)
+        {
+            out.push_back(position);
+        }
+    }
+
+    return out;
+}
+
+template <size_t Entries, bool kUpdateNeighbours>
+class Simplification
+{
+public:
+    explicit Simplification(const std::vector<Point>& trace)
+        : m_trace(trace)
+        , m_predecessor(trace.size(), kNoPoint)
+        , m_successor(trace.size(), kNoPoint)
+    {
+    }
+
+    // The indices of the retained points, oldest first
+    std::vector<uint16_t> Run()
+    {
+        std::optional<uint16_t> pending;
+
+        for (auto i = 0u; i < m_trace.size(); i++)
+        {
+            auto handle = static_cast<uint16_t>(i);
+
+            if (pending)
+            {
+                m_successor[*pending] = handle;
+                m_predecessor[handle] = *pending;
+
+                if (m_queue->Full())
+                {
+                    Remove(m_queue->Top());
+                }
+                m_queue->Push(*pending, Area(*pending));
+            }
+            pending = handle;
+        }
+
+        std::vector<uint16_t> out;
+        for (auto i = uint16_t {0}; i != kNoPoint; i = m_successor[i])
+        {
+            out.push_back(i);
+        }
+
+        return out;
+    }
+
+private:
+    uint32_t Area(uint16_t handle) const
+    {
+        if (m_predecessor[handle] == kNoPoint)
+        {
+            // The first point is never removed
+            return std::numeric_limits<uint32_t>::max();
+        }
+
+        return TriangleArea(m_trace[m_predecessor[handle]],
+                            m_trace[handle],
+                            m_trace[m_successor[handle]]);
+    }
+
+    void Remove(uint16_t handle)
+    {
+        auto predecessor = m_predecessor[handle];
+        auto successor = m_successor[handle];
+
+        m_successor[predecessor] = successor;
+        m_predecessor[successor] = predecessor;
+        m_queue->Erase(handle);
+
+        if (kUpdateNeighbours)
+        {
+            for (auto neighbour : {predecessor, successor})
+            {
+                if (m_queue->Contains(neighbour))
+                {
+                    m_queue->Update(neighbour, Area(neighbour));
+                }
+            }
+        }
+    }
+
+    const std::vector<Point>& m_trace;
+    std::vector<uint16_t> m_predecessor;
+    std::vector<uint16_t> m_successor;
+    std::unique_ptr<IndexedMinHeap<uint16_t, uint32_t, Entries, kMaxPoints>> m_queue {
+        std::make_unique<IndexedMinHeap<uint16_t, uint32_t, Entries, kMaxPoints>>()};
+};
+
+double
+DistanceToSegment(const Point& p, const Point& a, const Point& b)
+{
+    auto abx = static_cast<double>(b.x - a.x);
+    auto aby = static_cast<double>(b.y - a.y);
+    auto apx = static_cast<double>(p.x - a.x);
+    auto apy = static_cast<double>(p.y - a.y);
+    auto length_squared = abx * abx + aby * aby;
+    auto t = length_squared > 0 ? std::clamp((apx * abx + apy * aby) / length_squared, 0.0, 1.0)
+                                : 0.0;
+
+    return std::hypot(apx - t * abx, apy - t * aby);
+}
+
+template <size_t Entries, bool kUpdateNeighbours>
+void
+Run(const std::vector<Point>& trace, const char* name)
+{
+    std::vector<uint16_t> retained;
+    auto ns = benchmark::NanosecondsPerCall(kRuns, [&trace, &retained]() {
+        retained = Simplification<Entries, kUpdateNeighbours>(trace).Run();
+        benchmark::g_sink = retained.size();
+    });
+
+    // How far the points are from the line through the retained ones around them
+    auto max_error = 0.0;
+    auto total_error = 0.0;
+    for (auto i = 1u; i < retained.size(); i++)
+    {
+        for (auto point = retained[i - 1]; point < retained[i]; point++)
+        {
+            auto error =
+                DistanceToSegment(trace[point], trace[retained[i - 1]], trace[retained[i]]);
+
+            max_error = std::max(max_error, error);
+            total_error += error;
+        }
+    }
+
+    printf("  %4zu entries, %-18s %5.0f ns/point, error max %6.1f px, mean %5.2f px\n",
+           Entries,
+           name,
+           ns / trace.size(),
+           max_error,
+           total_error / trace.size());
+}
+
+} // namespace
+
+void
+benchmark::Simplification()
+{
+    auto trace = RecordTrace();
+    printf("  %zu points in %d hours\n", trace.size(), kTraceSeconds / 3600);
+
+    Run<128, true>(trace, "updated areas:");
+    Run<128, false>(trace, "stale areas:");
+    Run<1024, true>(trace, "updated areas:");
+    Run<1024, false>(trace, "stale areas:");
+}
@@ -0,0 +1,83 @@
+// The tile lookups of one frame, with the TileIndex and with the linear scan it replaced
+#include "benchmark.hh"
+#include "tile_cache.hh"
+#include "tile_index.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+namespace
+{
+
+// What MapScreen looks up per redraw, for its 960x960 background
+constexpr auto kFrameTilesPerSide = (960 + kTileSize - 1) / kTileSize + 1;
+constexpr auto kFrames = 20000u;
+
+template <size_t Slots>
+void
+Run()
+{
+    // The cache holds a square around the view, in the order the tiles were loaded in
+    const auto side = static_cast<int32_t>(std::sqrt(Slots));
+    const auto origin = Tile {17000, 9000, kDefaultZoom};
+    std::array<uint32_t, Slots> tiles {};
+    TileIndex<Slots> index;
+
+    auto order = std::array<uint16_t, Slots> {};
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::shuffle(order, std::mt19937 {1});
+    for (auto slot = 0u; slot < Slots; slot++)
+    {
+        auto i = static_cast<int32_t>(order[slot]);
+        auto tile = Tile {origin.x + i % side, origin.y + i / side, origin.zoom};
+
+        tiles[slot] = TileId(tile);
+        index.Insert(tiles[slot], slot);
+    }
+
+    // The view is at the edge of the cached square, so that some of its tiles are misses
+    auto frame = std::array<uint32_t, kFrameTilesPerSide * kFrameTilesPerSide> {};
+    for (auto i = 0; i < kFrameTilesPerSide * kFrameTilesPerSide; i++)
+    {
+        auto x = origin.x + side - kFrameTilesPerSide / 2 - 1 + i % kFrameTilesPerSide;
+        auto y = origin.y + side / 2 + i / kFrameTilesPerSide;
+
+        frame[i] = TileId(Tile {x, y, origin.zoom});
+    }
+
+    auto linear_ns = benchmark::NanosecondsPerCall(kFrames, [&tiles, &frame]() {
+        auto hits = 0u;
+        for (auto id : frame)
+        {
+            hits += std::ranges::find(tiles, id) != tiles.end();
+        }
+        benchmark::g_sink = hits;
+    });
+    auto hashed_ns = benchmark::NanosecondsPerCall(kFrames, [&index, &frame]() {
+        auto hits = 0u;
+        for (auto id : frame)
+        {
+            hits += index.Find(id).has_value();
+        }
+        benchmark::g_sink = hits;
+    });
+
+    printf("  %3zu MB cache (%4zu tiles): linear %8.0f ns/frame, hashed %6.0f ns/frame\n",
+           Slots * kTileSize * kTileSize * sizeof(uint16_t) / (1024 * 1024),
+           Slots,
+           linear_ns,
+           hashed_ns);
+}
+
+} // namespace
+
+void
+benchmark::TileLookup()
+{
+    Run<TilesBySize(8)>();
+    Run<TilesBySize(16)>();
+    Run<TilesBySize(32)>();
+    Run<TilesBySize(64)>();
+}
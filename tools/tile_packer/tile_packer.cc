@@ -0,0 +1,134 @@
+// Convert a tiles/{zoom}/{x}/{y}.png tree to packs/{zoom}.pack
+#include "tile_pack.hh"
+#include "wgs84_to_osm_point.hh"
+
+#include <charconv>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+std::optional<int32_t>
+ToInt(const std::string& s)
+{
+    int32_t out;
+
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+    if (ec != std::errc() || ptr != s.data() + s.size())
+    {
+        return std::nullopt;
+    }
+
+    return out;
+}
+
+// TileId only tells these zoom levels apart, and has room for the tiles up to kDefaultZoom
+bool
+IsSupportedTile(int32_t zoom, int32_t x, int32_t y)
+{
+    if (zoom != kDefaultZoom && zoom != kCityZoom && zoom != kLandscapeZoom)
+    {
+        return false;
+    }
+
+    return x >= 0 && y >= 0 && x < (1 << zoom) && y < (1 << zoom);
+}
+
+std::optional<std::vector<std::byte>>
+ReadFile(const fs::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<std::byte> out(fs::file_size(path));
+    file.read(reinterpret_cast<char*>(out.data()), out.size());
+    if (!file)
+    {
+        return std::nullopt;
+    }
+
+    return out;
+}
+
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <app_data/tiles> <app_data/packs>\n", argv[0]);
+        return 1;
+    }
+
+    auto tile_directory = fs::path(argv[1]);
+    auto pack_directory = fs::path(argv[2]);
+
+    // Sorted, to write the tiles of each pack in index order
+    std::map<uint8_t, std::map<uint32_t, fs::path>> tiles_by_zoom;
+
+    for (const auto& entry : fs::recursive_directory_iterator(tile_directory))
+    {
+        auto relative = fs::relative(entry.path(), tile_directory);
+        auto parts = std::vector<std::string>(relative.begin(), relative.end());
+
+        if (!entry.is_regular_file() || parts.size() != 3 ||
+            entry.path().extension() != ".png")
+        {
+            continue;
+        }
+
+        auto zoom = ToInt(parts[0]);
+        auto x = ToInt(parts[1]);
+        auto y = ToInt(entry.path().stem().string());
+        if (!zoom || !x || !y || !IsSupportedTile(*zoom, *x, *y))
+        {
+            fprintf(stderr, "Skipping %s\n", entry.path().c_str());
+            continue;
+        }
+
+        auto tile = Tile {*x, *y, static_cast<uint8_t>(*zoom)};
+        tiles_by_zoom[tile.zoom][TileId(tile)] = entry.path();
+    }
+
+    fs::create_directories(pack_directory);
+    for (const auto& [zoom, tiles] : tiles_by_zoom)
+    {
+        auto pack_path = pack_directory / std::format("{}.pack", zoom);
+        auto writer = TilePackWriter::Open(pack_path.string());
+
+        if (!writer)
+        {
+            fprintf(stderr, "Can't open %s\n", pack_path.c_str());
+            return 1;
+        }
+
+        for (const auto& [tile_id, path] : tiles)
+        {
+            auto data = ReadFile(path);
+
+            if (!data || !writer->Add(tile_id, *data))
+            {
+                fprintf(stderr, "Can't add %s\n", path.c_str());
+                return 1;
+            }
+        }
+
+        if (!writer->Commit())
+        {
+            fprintf(stderr, "Can't write the index of %s\n", pack_path.c_str());
+            return 1;
+        }
+        printf("%s: %zu tiles\n", pack_path.c_str(), tiles.size());
+    }
+
+    return 0;
+}